@@ -1,6 +1,7 @@
 -- CAVEATS:
--- CHIP-8 opcodes are always aligned to 2. If we're on an odd offset,
--- disassembling will be completely screwed.
+-- CHIP-8 opcodes are always aligned to 2, so instructions are decoded from
+-- even offsets in the file. If the program itself is misaligned, disassembling
+-- will be completely screwed.
 
 local huxdemp = require("huxdemp")
 
@@ -17,8 +18,9 @@ local styles = {
     skipped = "\x1b[38;5;7m",
 }
 
-local pbuffer = nil
-local skip_next_op = false
+-- Ask for a view instead of a table, so that instructions that straddle two
+-- lines can be read from the previous line (see "Writing plugins" in huxd(1)).
+M.view = true
 
 local function decode(buffer, index)
     local op = buffer[index] << 8 | buffer[index + 1]
@@ -124,6 +126,17 @@ local function decode(buffer, index)
     return opstring, optype or "chip8"
 end
 
+-- Whether the instruction at `index' is the operand of an F000 instruction.
+-- F000 can itself be an operand, so count how many precede it in a row.
+local function is_f000_operand(buffer, index)
+    local n = 0
+    while buffer[index - 1] and buffer[index - 2] == 0xF0 and buffer[index - 1] == 0x00 do
+        n = n + 1
+        index = index - 2
+    end
+    return n % 2 == 1
+end
+
 function M.main(buffer, offset, out)
     use_color = use_color or huxdemp.colors_enabled()
 
@@ -134,28 +147,40 @@ function M.main(buffer, offset, out)
         return text
     end
 
+    local len = #buffer
     local i = 1
 
-    if pbuffer then
-        buffer = {table.unpack(pbuffer), table.unpack(buffer)}
-        pbuffer = nil
+    -- Opcodes are aligned to 2, so if we start on an odd offset, the first
+    -- byte finishes off the last instruction of the previous line.
+    if offset % 2 == 1 then
+        i = 0
     end
 
-    while i <= #buffer do
-        if skip_next_op then
-            skip_next_op = false
-            out:write(s(styles.skipped, "**** "))
+    local skip_next_op = is_f000_operand(buffer, i)
+
+    while i <= len do
+        -- If we started dumping on an odd offset, there's no previous line
+        -- to look at, so the first byte can't be decoded.
+        if buffer[i] == nil then
+            out:write(s(styles.continued, "---- "))
             i = i + 2
             goto continue
         end
 
-        -- Buffer input if we don't have enough bytes.
-        if (#buffer + 1) - i < 2 then
-            pbuffer = {table.unpack(buffer, i, #buffer)}
+        -- The rest of this instruction is on the next line, so it'll be
+        -- displayed there.
+        if i == len then
             out:write(s(styles.continued, "---- "))
             break
         end
 
+        if skip_next_op then
+            skip_next_op = false
+            out:write(s(styles.skipped, "**** "))
+            i = i + 2
+            goto continue
+        end
+
         local opstring, optype = decode(buffer, i)
         out:write(s(styles[optype], opstring .. " "))
 
@@ -168,8 +193,8 @@ function M.main(buffer, offset, out)
     end
 
     local linewidth = huxdemp.linewidth()
-    if #buffer < linewidth then
-        local pad = math.floor(((linewidth / 2) - math.ceil(#buffer / 2)) * 5)
+    if len < linewidth then
+        local pad = math.floor(((linewidth / 2) - math.ceil(len / 2)) * 5)
         out:write((" "):rep(pad))
     end
 end
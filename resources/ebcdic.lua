@@ -45,6 +45,11 @@ local ebcdic_colors = {
 
 assert(#ebcdic_chars == 256)
 
+-- Two borders around a character per byte (see --bench-plugin in huxd(1)).
+function M.width(linewidth)
+    return linewidth + 2
+end
+
 function M.main(buffer, offset, out)
     use_color = use_color or huxdemp.colors_enabled()
 
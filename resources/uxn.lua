@@ -20,20 +20,21 @@ styles.kr  = styles.k .. styles.r
 styles.kr2 = styles.k .. styles.r .. styles["2"]
 styles.r2  = styles.r .. styles["2"]
 
-local LIT_STATE_WANT_2 = 2
-local LIT_STATE_WANT_1 = 1
-local LIT_STATE_UNSET  = 0
-
-local lit_state = LIT_STATE_UNSET
-local lit_accm = { val = 0, sz = 0 }
-
-local function decode(buffer, index)
-    local op = buffer[index]
+-- Run main() as a coroutine that pulls bytes from the input, so that LIT
+-- operands can be read as they come, even when they continue on the next line
+-- (see "Writing plugins" in huxd(1)).
+M.stream = true
+
+-- A 7-wide cell per byte (see --bench-plugin in huxd(1)).
+function M.width(linewidth)
+    return linewidth * 7
+end
 
-    local m_keep  = buffer[index] & 0x80
-    local m_ret   = buffer[index] & 0x40
-    local m_short = buffer[index] & 0x20
-    local opcode  = buffer[index] & 0x1F
+local function decode(op)
+    local m_keep  = op & 0x80
+    local m_ret   = op & 0x40
+    local m_short = op & 0x20
+    local opcode  = op & 0x1F
 
     local modestring = ""
     if m_keep  ~= 0 then modestring = modestring .. "k" end
@@ -56,66 +57,51 @@ local function decode(buffer, index)
     return opstring, modestring
 end
 
-function M.main(buffer, offset, out)
+function M.main(input, out)
     use_color = use_color or huxdemp.colors_enabled()
 
-    local i = 1
-    local cols = 0
+    local linewidth = huxdemp.linewidth()
 
+    -- Print a cell for the byte that was just read, padding the column once
+    -- we're at the end of a short line.
     local function puts(style, fmt, ...)
         local text = string.format("%-6s ", string.format(fmt, ...))
         if use_color then
             text = style .. text .. "\x1b[m"
         end
         out:write(text)
-        cols = cols + 1
+
+        if input:left() == 0 and input:size() < linewidth then
+            out:write((" "):rep((linewidth - input:size()) * 7))
+        end
     end
 
-    while i <= #buffer do
-        if lit_state ~= LIT_STATE_UNSET then
-            if lit_state == LIT_STATE_WANT_2 then
-                lit_state = LIT_STATE_WANT_1
+    while true do
+        local op = input:next()
+        if not op then return end
 
-                lit_accm.val = buffer[i]
-                lit_accm.sz = lit_accm.sz + 8
+        local opstring, modestring = decode(op)
+        local style = styles[modestring] or styles.normal
 
-                puts(styles.skipped, "---")
-            elseif lit_state == LIT_STATE_WANT_1 then
-                lit_state = LIT_STATE_UNSET
+        if opstring ~= "LIT" then
+            puts(style, "%s", opstring .. modestring)
+        elseif modestring:match("2") then
+            puts(styles.lit, "%s", opstring .. modestring)
 
-                lit_accm.val = (lit_accm.val << 8) | buffer[i]
-                lit_accm.sz = lit_accm.sz + 8
+            local hi = input:next()
+            if not hi then return end
+            puts(styles.skipped, "---")
 
-                if lit_accm.sz == 8 then
-                    puts(styles.normal, "#%02X", lit_accm.val)
-                elseif lit_accm.sz == 16 then
-                    puts(styles.normal, "#%04X", lit_accm.val)
-                end
-                lit_accm = { val = 0, sz = 0 }
-            end
+            local lo = input:next()
+            if not lo then return end
+            puts(styles.normal, "#%04X", hi << 8 | lo)
         else
-            local opstring, modestring = decode(buffer, i)
-            local style = styles[modestring] or styles.normal
-
-            if opstring == "LIT" then
-                if modestring:match("2") then
-                    lit_state = LIT_STATE_WANT_2
-                else
-                    lit_state = LIT_STATE_WANT_1
-                end
-                style = styles.lit
-            end
+            puts(styles.lit, "%s", opstring .. modestring)
 
-            puts(style, "%s", opstring .. modestring)
+            local lit = input:next()
+            if not lit then return end
+            puts(styles.normal, "#%02X", lit)
         end
-
-        i = i + 1
-    end
-
-    local linewidth = huxdemp.linewidth()
-    if cols < linewidth then
-        local pad = math.floor((linewidth - cols) * 7)
-        out:write((" "):rep(pad))
     end
 end
 
@@ -0,0 +1,450 @@
+/// Dumping a member of an archive without extracting it, by giving a path like
+/// `archive.tar//path/in/archive'.
+///
+/// The archive is opened as usual, and its member is found without reading any
+/// of the other members' data:
+///
+/// * tar (v7, ustar, GNU, and pax): the headers are walked from the start,
+///   skipping over each member's data. They're read through a big buffer, so
+///   that archives of many small files don't need a read for every header.
+///   GNU long names and pax `path' records are understood.
+///
+/// * cpio ("newc" and "odc", as written by GNU cpio and bsdcpio): the same, with
+///   cpio's headers.
+///
+/// * zip: the central directory at the end of the archive is read, so the
+///   member's local header can be seeked to directly. Zip64 is supported. Members
+///   that are stored are read as they are; deflated ones are inflated on the fly
+///   if huxdemp was built with zlib.
+///
+/// What comes out is a `struct Member', which input.c uses to read the member's
+/// bytes (and nothing else) from the archive. Offsets are relative to the start of
+/// the member.
+///
+#include <err.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Enough for a zip's end of central directory record with the longest comment
+ * (which can be 0xFFFF bytes long) after it. */
+#define ARCHIVE_READ_SZ (0xFFFF + 22)
+
+enum MemberMethod {
+	MM_Stored, MM_Deflated
+};
+
+struct Member {
+	/// Where the member's data starts in the archive, and how many bytes of it
+	/// there are there (`csize') and once it's decompressed (`size').
+	uint64_t start, csize, size;
+	enum MemberMethod method;
+};
+
+/// A read-ahead buffer over the archive, so that headers close to each other are
+/// read with a single pread(2).
+struct ArchiveReader {
+	int fd;
+	uint64_t off;
+	size_t len;
+	byte_t buf[ARCHIVE_READ_SZ];
+};
+
+/// Get `len' (at most ARCHIVE_READ_SZ) bytes at `off', or NULL if the archive ends
+/// before that.
+///
+static const byte_t *
+_archive_at(struct ArchiveReader *ar, uint64_t off, size_t len)
+{
+	if (off >= ar->off && off + len <= ar->off + ar->len)
+		return &ar->buf[off - ar->off];
+
+	ar->off = off, ar->len = 0;
+	while (ar->len < sizeof(ar->buf)) {
+		ssize_t r = pread(ar->fd, &ar->buf[ar->len], sizeof(ar->buf) - ar->len,
+			(off_t)(off + ar->len));
+		if (r <= 0) break;
+		ar->len += (size_t)r;
+	}
+
+	return len <= ar->len ? ar->buf : NULL;
+}
+
+static uint64_t
+_archive_num(const byte_t *p, size_t len, int base)
+{
+	uint64_t n = 0;
+	for (size_t i = 0; i < len; ++i) {
+		int d = p[i] >= '0' && p[i] <= '9' ? p[i] - '0'
+			: (p[i] | 0x20) >= 'a' && (p[i] | 0x20) <= 'f' ? (p[i] | 0x20) - 'a' + 10
+			: -1;
+		if (d < 0 || d >= base) {
+			if (n == 0 && p[i] == ' ') continue;
+			break;
+		}
+		n = n * (uint64_t)base + (uint64_t)d;
+	}
+	return n;
+}
+
+static inline uint64_t
+_archive_le(const byte_t *p, size_t len)
+{
+	uint64_t n = 0;
+	for (size_t i = len; i > 0; --i)
+		n = n << 8 | p[i - 1];
+	return n;
+}
+
+/// Whether the name of a member, as stored in the archive, is `want'. Leading
+/// "./" and "/" are ignored on both sides, as are trailing slashes.
+///
+static _Bool
+_archive_name_is(const char *name, size_t len, const char *want)
+{
+	while (len > 0 && (*name == '/' || (len > 1 && name[0] == '.' && name[1] == '/')))
+		++name, --len;
+	while (*want == '/' || (want[0] == '.' && want[1] == '/'))
+		++want;
+
+	while (len > 0 && name[len - 1] == '/') --len;
+	size_t want_len = strlen(want);
+	while (want_len > 0 && want[want_len - 1] == '/') --want_len;
+
+	return len == want_len && !memcmp(name, want, len);
+}
+
+static int
+_archive_tar(struct ArchiveReader *ar, const char *want, struct Member *m)
+{
+	/* A name from a GNU 'L' header or a pax 'x' header, for the next member. */
+	static char longname[4096];
+	size_t longname_len = 0;
+
+	for (uint64_t off = 0;;) {
+		const byte_t *h = _archive_at(ar, off, 512);
+		if (h == NULL || h[0] == '\0')
+			return -1;
+
+		/* GNU tar writes sizes that don't fit in octal as big-endian base-256. */
+		uint64_t size = 0;
+		if (h[124] & 0x80)
+			for (size_t i = 128; i < 136; ++i) size = size << 8 | h[i];
+		else
+			size = _archive_num(&h[124], 12, 8);
+
+		uint64_t data = off + 512;
+		off = data + (size + 511) / 512 * 512;
+		char type = (char)h[156];
+
+		if (type == 'L' || type == 'x') {
+			size_t n = (size_t)MIN(size, sizeof(longname) - 1);
+			const byte_t *p = _archive_at(ar, data, n);
+			if (p == NULL) return -1;
+
+			if (type == 'L') {
+				memcpy(longname, p, n);
+				longname_len = strnlen(longname, n);
+				continue;
+			}
+
+			/* pax records: "LEN path=NAME\n" */
+			for (size_t i = 0; i < n;) {
+				size_t reclen = (size_t)_archive_num(&p[i], n - i, 10);
+				if (reclen == 0 || i + reclen > n) break;
+				const char *rec = memchr(&p[i], ' ', reclen);
+				if (rec && !strncmp(rec + 1, "path=", 5)) {
+					rec += 6;
+					longname_len = (size_t)((const char *)&p[i] + reclen - 1 - rec);
+					memmove(longname, rec, longname_len);
+				}
+				i += reclen;
+			}
+			continue;
+		}
+
+		char name[256 + 1 + 100 + 1];
+		size_t name_len;
+		if (longname_len > 0) {
+			name_len = 0;
+		} else if (!memcmp(&h[257], "ustar", 5) && h[345]) {
+			size_t plen = strnlen((const char *)&h[345], 155);
+			memcpy(name, &h[345], plen);
+			name[plen] = '/';
+			size_t nlen = strnlen((const char *)h, 100);
+			memcpy(&name[plen + 1], h, nlen);
+			name_len = plen + 1 + nlen;
+		} else {
+			name_len = strnlen((const char *)h, 100);
+			memcpy(name, h, name_len);
+		}
+
+		const char *n = longname_len ? longname : name;
+		size_t nl = longname_len ? longname_len : name_len;
+		longname_len = 0;
+
+		if (!_archive_name_is(n, nl, want))
+			continue;
+		if (type != '0' && type != '\0' && type != '7') {
+			warnx("\"%s\" isn't a regular file in the archive", want);
+			return -2;
+		}
+
+		*m = (struct Member){ .start = data, .csize = size, .size = size };
+		return 0;
+	}
+}
+
+static int
+_archive_cpio(struct ArchiveReader *ar, const char *want, struct Member *m)
+{
+	for (uint64_t off = 0;;) {
+		const byte_t *h = _archive_at(ar, off, 76);
+		if (h == NULL)
+			return -1;
+
+		uint64_t mode, namesize, size, data;
+		if (!memcmp(h, "07070", 5) && (h[5] == '1' || h[5] == '2')) {
+			if ((h = _archive_at(ar, off, 110)) == NULL)
+				return -1;
+			mode = _archive_num(&h[14], 8, 16);
+			size = _archive_num(&h[54], 8, 16);
+			namesize = _archive_num(&h[94], 8, 16);
+			data = (off + 110 + namesize + 3) & ~(uint64_t)3;
+			h = _archive_at(ar, off + 110, (size_t)namesize);
+			off = (data + size + 3) & ~(uint64_t)3;
+		} else if (!memcmp(h, "070707", 6)) {
+			mode = _archive_num(&h[18], 6, 8);
+			namesize = _archive_num(&h[59], 6, 8);
+			size = _archive_num(&h[65], 11, 8);
+			data = off + 76 + namesize;
+			h = _archive_at(ar, off + 76, (size_t)namesize);
+			off = data + size;
+		} else {
+			return -1;
+		}
+
+		if (h == NULL || namesize == 0 || namesize > ARCHIVE_READ_SZ)
+			return -1;
+
+		const char *name = (const char *)h;
+		size_t name_len = strnlen(name, (size_t)namesize);
+		if (!strcmp(name, "TRAILER!!!"))
+			return -1;
+		if (!_archive_name_is(name, name_len, want))
+			continue;
+
+		if ((mode & 0170000) != 0100000) {
+			warnx("\"%s\" isn't a regular file in the archive", want);
+			return -2;
+		}
+
+		*m = (struct Member){ .start = data, .csize = size, .size = size };
+		return 0;
+	}
+}
+
+static int
+_archive_zip(struct ArchiveReader *ar, uint64_t archive_sz, const char *want,
+		struct Member *m)
+{
+	/* The end of central directory record is in the last ARCHIVE_READ_SZ bytes. */
+	uint64_t tail = archive_sz > ARCHIVE_READ_SZ ? archive_sz - ARCHIVE_READ_SZ : 0;
+	const byte_t *p = _archive_at(ar, tail, (size_t)(archive_sz - tail));
+	if (p == NULL)
+		return -1;
+
+	size_t eocd = SIZE_MAX;
+	for (size_t i = (size_t)(archive_sz - tail); i >= 22; --i) {
+		if (!memcmp(&p[i - 22], "PK\x05\x06", 4)) {
+			eocd = i - 22;
+			break;
+		}
+	}
+	if (eocd == SIZE_MAX)
+		return -3;
+
+	uint64_t entries = _archive_le(&p[eocd + 10], 2);
+	uint64_t cd_size = _archive_le(&p[eocd + 12], 4);
+	uint64_t cd_off  = _archive_le(&p[eocd + 16], 4);
+
+	/* Zip64: the real numbers are in the record the locator points to. */
+	if (eocd >= 20 && !memcmp(&p[eocd - 20], "PK\x06\x07", 4)) {
+		uint64_t z64 = _archive_le(&p[eocd - 20 + 8], 8);
+		const byte_t *z = _archive_at(ar, z64, 56);
+		if (z == NULL || memcmp(z, "PK\x06\x06", 4))
+			return -1;
+		entries = _archive_le(&z[32], 8);
+		cd_size = _archive_le(&z[40], 8);
+		cd_off  = _archive_le(&z[48], 8);
+	}
+
+	(void)cd_size;
+	for (uint64_t i = 0, off = cd_off; i < entries; ++i) {
+		const byte_t *e = _archive_at(ar, off, 46);
+		if (e == NULL || memcmp(e, "PK\x01\x02", 4))
+			return -1;
+
+		size_t name_len = (size_t)_archive_le(&e[28], 2);
+		size_t extra_len = (size_t)_archive_le(&e[30], 2);
+		size_t comment_len = (size_t)_archive_le(&e[32], 2);
+		uint64_t flags = _archive_le(&e[8], 2);
+		uint64_t method = _archive_le(&e[10], 2);
+		uint64_t csize = _archive_le(&e[20], 4);
+		uint64_t size = _archive_le(&e[24], 4);
+		uint64_t local = _archive_le(&e[42], 4);
+
+		e = _archive_at(ar, off, 46 + name_len + extra_len);
+		if (e == NULL)
+			return -1;
+		off += 46 + name_len + extra_len + comment_len;
+
+		if (!_archive_name_is((const char *)&e[46], name_len, want))
+			continue;
+
+		/* Zip64 extra field: whichever of these overflowed, in this order. */
+		for (size_t x = 46 + name_len; x + 4 <= 46 + name_len + extra_len;) {
+			uint64_t id = _archive_le(&e[x], 2), len = _archive_le(&e[x + 2], 2);
+			if (id == 0x0001) {
+				const byte_t *f = &e[x + 4];
+				if (size == 0xFFFFFFFF)  size  = _archive_le(f, 8), f += 8;
+				if (csize == 0xFFFFFFFF) csize = _archive_le(f, 8), f += 8;
+				if (local == 0xFFFFFFFF) local = _archive_le(f, 8);
+			}
+			x += 4 + (size_t)len;
+		}
+
+		if (name_len > 0 && e[46 + name_len - 1] == '/') {
+			warnx("\"%s\" isn't a regular file in the archive", want);
+			return -2;
+		}
+		if (flags & 1) {
+			warnx("\"%s\" is encrypted", want);
+			return -2;
+		}
+		if (method != 0 && method != 8) {
+			warnx("\"%s\" is compressed with method %lu, which huxdemp doesn't "
+				"understand", want, (unsigned long)method);
+			return -2;
+		}
+#ifndef HAVE_ZLIB
+		if (method == 8) {
+			warnx("\"%s\" is deflated, and huxdemp was built without zlib", want);
+			return -2;
+		}
+#endif
+
+		const byte_t *l = _archive_at(ar, local, 30);
+		if (l == NULL || memcmp(l, "PK\x03\x04", 4))
+			return -1;
+
+		*m = (struct Member){
+			.start = local + 30 + _archive_le(&l[26], 2) + _archive_le(&l[28], 2),
+			.csize = csize, .size = size,
+			.method = method == 8 ? MM_Deflated : MM_Stored,
+		};
+		return 0;
+	}
+
+	return -1;
+}
+
+/// If `path' names a member of an archive, return where the member's name starts
+/// in it (just after the `//'). The part before that has to be an existing file,
+/// so that paths that just happen to contain `//' still work.
+///
+static char *
+archive_member(const char *path)
+{
+	for (const char *sep = strstr(path, "//"); sep; sep = strstr(sep + 1, "//")) {
+		if (sep == path) continue;
+
+		char archive[PATH_MAX];
+		size_t len = (size_t)(sep - path);
+		if (len >= sizeof(archive)) break;
+		memcpy(archive, path, len);
+		archive[len] = '\0';
+
+		struct stat st;
+		if (stat(archive, &st) == 0 && S_ISREG(st.st_mode))
+			return (char *)sep + 2;
+	}
+
+	return NULL;
+}
+
+/// Open the archive in `path' (which archive_member() returned `name' for), and
+/// find the member in it. On failure, a warning is printed and NULL returned.
+///
+static FILE *
+archive_open(const char *path, const char *name, struct Member *m)
+{
+	static struct ArchiveReader ar;
+	char archive[PATH_MAX];
+	size_t len = (size_t)(name - 2 - path);
+	memcpy(archive, path, len);
+	archive[len] = '\0';
+
+	FILE *fp = fopen(archive, "r");
+	struct stat st;
+	if (fp == NULL || fstat(fileno(fp), &st) == -1) {
+		warn("\"%s\"", archive);
+		goto fail;
+	}
+
+	ar.fd = fileno(fp);
+	ar.off = ar.len = 0;
+
+	/* 0: found, -1: no such member, -2: already warned about, -3: not an archive. */
+	const byte_t *magic = _archive_at(&ar, 0, 6);
+	int r = -3;
+
+	if (magic == NULL) {
+		warnx("\"%s\": too short to be an archive", archive);
+		goto fail;
+	}
+
+	if (!memcmp(magic, "\x1f\x8b", 2) || !memcmp(magic, "BZh", 3)
+			|| !memcmp(magic, "\xfd" "7zXZ", 6) || !memcmp(magic, "\x28\xb5\x2f\xfd", 4)) {
+		warnx("\"%s\": compressed archives can't be looked into; "
+			"decompress it first", archive);
+		goto fail;
+	} else if (!memcmp(magic, "07070", 5)) {
+		r = _archive_cpio(&ar, name, m);
+	} else if (!memcmp(magic, "PK", 2)) {
+		r = _archive_zip(&ar, (uint64_t)st.st_size, name, m);
+	} else if (ar.len >= 512 && !memcmp(&magic[257], "ustar", 5)) {
+		r = _archive_tar(&ar, name, m);
+	} else if (ar.len >= 512) {
+		/* v7 tar has no magic, but its header checksum can be checked. */
+		uint64_t sum = 0;
+		for (size_t i = 0; i < 512; ++i)
+			sum += (i >= 148 && i < 156) ? ' ' : magic[i];
+		if (sum == _archive_num(&magic[148], 8, 8))
+			r = _archive_tar(&ar, name, m);
+	}
+
+	if (r == -3)
+		warnx("\"%s\": not a supported archive (tar, cpio, or zip)", archive);
+	else if (r == -1)
+		warnx("\"%s\": no member called \"%s\"", archive, name);
+	if (r != 0)
+		goto fail;
+
+	if (m->start + m->csize > (uint64_t)st.st_size) {
+		warnx("\"%s\": \"%s\" is cut short", archive, name);
+		m->csize = (uint64_t)st.st_size - MIN(m->start, (uint64_t)st.st_size);
+		if (m->method == MM_Stored)
+			m->size = m->csize;
+	}
+
+	return fp;
+
+fail:
+	if (fp) fclose(fp);
+	return NULL;
+}
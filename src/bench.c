@@ -0,0 +1,257 @@
+/// The plugin benchmark (--bench-plugin), which runs a single plugin column over a
+/// few generated inputs, without a terminal in the way, and reports how fast it
+/// was and how much garbage it made.
+///
+/// Each line's output goes into a memory stream instead of the terminal, so that
+/// its width can be checked: plugins can claim a width with `M.width' (either a
+/// number of cells, or a function that takes the line width and returns one), and
+/// every line must then be exactly that wide. Plugins that don't claim a width
+/// must at least be consistent from one line to the next. A plugin that doesn't
+/// conform makes huxdemp exit with an error, so that this can be used in scripts.
+///
+/// While benchmarking, Lua's garbage collector is stopped, and stepped manually
+/// after each call by however much the call allocated, so that the time it takes
+/// can be measured.
+///
+/// Besides the allocations the plugin asks Lua for, the number of calls that
+/// actually reached malloc(3) (see memory.c) is counted for each input. Once the
+/// Lua heap has grown to fit a line's garbage, that should stay at zero.
+///
+#include <err.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_SZ (1024 * 1024)
+
+enum BenchCorpus {
+	BC_Zeros, BC_Sequence, BC_Text, BC_Random, BC_Max
+};
+
+static void
+_bench_fill(enum BenchCorpus corpus, byte_t *buf, size_t sz)
+{
+	static const char text[] =
+		"The quick brown fox jumps over the lazy dog.\n"
+		"\tPack my box with five dozen liquor jugs!\r\n";
+	uint64_t x = 0x9E3779B97F4A7C15;
+
+	for (size_t i = 0; i < sz; ++i) {
+		switch (corpus) {
+		break; case BC_Zeros:
+			buf[i] = 0;
+		break; case BC_Sequence:
+			buf[i] = (byte_t)i;
+		break; case BC_Text:
+			buf[i] = (byte_t)text[i % (sizeof(text) - 1)];
+		break; case BC_Random:
+			x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+			buf[i] = (byte_t)(x >> 32);
+		break; case BC_Max:
+			break;
+		}
+	}
+}
+
+#ifndef HUXD_NO_MAIN
+static const char *bench_corpora[BC_Max] = {
+	[BC_Zeros]    = "zeros",
+	[BC_Sequence] = "sequence",
+	[BC_Text]     = "text",
+	[BC_Random]   = "random",
+};
+
+static struct {
+	lua_Alloc alloc;
+	void *ud;
+	uint64_t count, bytes;
+} bench_mem;
+
+static void *
+_bench_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	(void)ud;
+
+	/* When `ptr' is NULL, `osize' is the type of the object instead. */
+	if (nsize > 0 && (ptr == NULL || nsize > osize)) {
+		++bench_mem.count;
+		bench_mem.bytes += ptr ? nsize - osize : nsize;
+	}
+
+	return bench_mem.alloc(bench_mem.ud, ptr, osize, nsize);
+}
+
+/// How many cells `s' takes up on the terminal, not counting escape sequences.
+///
+static size_t
+_bench_width(const char *s, size_t len)
+{
+	size_t width = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		byte_t c = (byte_t)s[i];
+
+		if (c == '\x1b') {
+			if (i + 1 < len && s[i + 1] == '[') {
+				for (i += 2; i < len && (s[i] < 0x40 || s[i] > 0x7E); ++i);
+			} else {
+				++i;
+			}
+			continue;
+		}
+
+		if (c >= 0x20 && (c & 0xC0) != 0x80)
+			++width;
+	}
+
+	return width;
+}
+
+/// The width claimed by the plugin with `M.width', or -1 if it didn't claim one.
+///
+static long
+_bench_claimed_width(const char *plugin)
+{
+	long width = -1;
+
+	lua_getglobal(L, plugin);
+	lua_getfield(L, -1, "width");
+
+	if (lua_isfunction(L, -1)) {
+		lua_pushinteger(L, (lua_Integer)options.linelen);
+		if (lua_pcall(L, 1, 1, 0) != LUA_OK)
+			luau_panic(L);
+	}
+
+	if (lua_isinteger(L, -1))
+		width = (long)lua_tointeger(L, -1);
+	else if (!lua_isnil(L, -1))
+		errx(1, "%s.width must be a number or a function returning one.", plugin);
+
+	lua_pop(L, 2);
+	return width;
+}
+
+static int
+bench_plugin(char *name)
+{
+	strcpy(options.dfunc_names[0], name);
+	options.dfuncs[0] = CO_Plugin;
+	options.dfuncs_sz = 1;
+
+	load_plugin(name);
+	plugin_reset();
+
+	char plugin[sizeof(options.dfunc_names[0])];
+	strcpy(plugin, name);
+	strtok(plugin, "-");
+
+	long claimed = _bench_claimed_width(plugin);
+	size_t sz = options.length > 0 ? (size_t)options.length : BENCH_SZ;
+
+	byte_t *corpus = mem_alloc(sz);
+	char *sink_buf = NULL;
+	size_t sink_sz = 0;
+	FILE *sink = open_memstream(&sink_buf, &sink_sz);
+	if (corpus == NULL || sink == NULL)
+		err(1, "--bench-plugin");
+
+	bench_mem.alloc = lua_getallocf(L, &bench_mem.ud);
+	lua_setallocf(L, _bench_alloc, NULL);
+	lua_gc(L, LUA_GCCOLLECT);
+	lua_gc(L, LUA_GCSTOP);
+
+	printf("benchmarking \"%s\": %zu bytes per line, %zu bytes per input\n\n",
+		name, options.linelen, sz);
+	printf("input          lines      lines/s  allocs/line   bytes/line  mallocs     gc(ms)  width\n");
+
+	_Bool conforms = true;
+
+	for (enum BenchCorpus c = 0; c < BC_Max; ++c) {
+		_bench_fill(c, corpus, sz);
+		plugin_reset();
+
+		uint64_t lines = 0, call_ns = 0, gc_ns = 0;
+		uint64_t count = bench_mem.count, bytes = bench_mem.bytes;
+		uint64_t mallocs = memory.mallocs;
+		uint64_t pending = 0;
+		size_t min_width = SIZE_MAX, max_width = 0, bad = 0, first_bad = 0;
+		long expected = claimed;
+
+		for (size_t line = 0; line < sz; line += options.linelen) {
+			size_t n = MIN(options.linelen, sz - line);
+
+			++plugin_line;
+			plugin_window.lo = &corpus[line - MIN(line, WINDOW_SZ)];
+			plugin_window.hi = &corpus[MIN(sz, line + n + WINDOW_SZ)];
+			plugin_window.last = line + n == sz;
+
+			fseek(sink, 0, SEEK_SET);
+			uint64_t before = bench_mem.bytes;
+
+			int64_t start = profile_now();
+			call_plugin(0, &corpus[line], n, line, sink);
+			int64_t end = profile_now();
+			call_ns += (uint64_t)(end - start);
+
+			pending += bench_mem.bytes - before;
+			if (pending >= 1024) {
+				lua_gc(L, LUA_GCSTEP, (int)(pending / 1024));
+				pending %= 1024;
+				gc_ns += (uint64_t)(profile_now() - end);
+			}
+
+			fflush(sink);
+			size_t width = _bench_width(sink_buf, (size_t)ftell(sink));
+			min_width = MIN(min_width, width);
+			max_width = MAX(max_width, width);
+
+			if (expected < 0)
+				expected = (long)width;
+			if (width != (size_t)expected && bad++ == 0)
+				first_bad = line;
+
+			++lines;
+		}
+
+		printf("%-10s %9lu %12.1f %12.1f %12.1f %8lu %10.3f  ",
+			bench_corpora[c], (unsigned long)lines,
+			call_ns ? lines / (call_ns / 1e9) : 0,
+			(double)(bench_mem.count - count) / lines,
+			(double)(bench_mem.bytes - bytes) / lines,
+			(unsigned long)(memory.mallocs - mallocs),
+			gc_ns / 1e6);
+		if (min_width == max_width)
+			printf("%zu\n", min_width);
+		else
+			printf("%zu-%zu\n", min_width, max_width);
+
+		if (bad > 0) {
+			conforms = false;
+			if (claimed >= 0)
+				warnx("%s: %zu lines of \"%s\" weren't %ld cells wide "
+					"(first at offset 0x%zx)", name, bad,
+					bench_corpora[c], claimed, first_bad);
+			else
+				warnx("%s: lines of \"%s\" aren't all the same width "
+					"(first change at offset 0x%zx)", name,
+					bench_corpora[c], first_bad);
+		}
+	}
+
+	if (claimed < 0)
+		printf("\n(\"%s\" doesn't claim a width with M.width)\n", plugin);
+
+	lua_gc(L, LUA_GCRESTART);
+	lua_setallocf(L, bench_mem.alloc, bench_mem.ud);
+
+	fclose(sink);
+	free(sink_buf);
+	mem_free(corpus, sz);
+
+	return conforms ? 0 : 1;
+}
+#endif
@@ -0,0 +1,342 @@
+/// The bitmap view (-b), which draws the input as an image instead of dumping it,
+/// one pixel per block of bytes. This is meant to give a quick overview of the
+/// structure of big files (where the compressed data is, where the runs of zeroes
+/// are, and so on).
+///
+/// Each pixel's color is either the most common color (from `styles') among the
+/// bytes of its block, or a shade of grey from the average value of those bytes.
+///
+/// For files that can be seeked in, we don't read everything: each pixel only
+/// looks at the first BITMAP_SAMPLE_SZ bytes of its block, and the pixels are split
+/// between several threads that pread(2) their samples independently. Pipes and
+/// the like are read up front with a block size of LINELEN bytes instead.
+///
+/// Pixels are then drawn either with Unicode half-blocks (two pixels per cell,
+/// the top one with the foreground color and the bottom with the background) or
+/// as a sixel image.
+///
+#include <err.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define BITMAP_SAMPLE_SZ   4096
+#define BITMAP_MAX_THREADS 16
+#define BITMAP_SIXEL_W     256
+#define BITMAP_SIXEL_H     256
+#define BITMAP_SIXEL_SCALE 2
+
+struct BitmapJob {
+	int fd;
+	const byte_t *mem;
+	uint64_t start, end;
+	uint64_t bpp;
+	byte_t *pixels;
+	size_t first, last;
+};
+
+/// Decide the color of a pixel, as an index in the 256-color palette.
+///
+/// In greyscale mode the average is mapped onto the grey ramp (232-255); otherwise
+/// we tally up the color of each byte and pick whichever is most common.
+///
+static byte_t
+_bitmap_color(const byte_t *p, size_t n)
+{
+	if (options.bitmap_gray) {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < n; ++i)
+			sum += p[i];
+		return 232 + (byte_t)((sum / n) * 24 / 256);
+	}
+
+	uint32_t counts[256] = {0};
+	for (size_t i = 0; i < n; ++i)
+		++counts[styles[p[i]]];
+
+	size_t best = 0;
+	for (size_t i = 1; i < 256; ++i)
+		if (counts[i] > counts[best]) best = i;
+	return (byte_t)best;
+}
+
+static void *
+_bitmap_worker(void *arg)
+{
+	struct BitmapJob *job = (struct BitmapJob *)arg;
+	byte_t sample[BITMAP_SAMPLE_SZ];
+
+	for (size_t i = job->first; i < job->last; ++i) {
+		uint64_t off = job->start + i * job->bpp;
+		size_t n = (size_t)MIN(MIN(job->bpp, BITMAP_SAMPLE_SZ), job->end - off);
+
+		if (job->mem) {
+			job->pixels[i] = _bitmap_color(&job->mem[off - job->start], n);
+			continue;
+		}
+
+		size_t got = 0;
+		while (got < n) {
+			ssize_t r = pread(job->fd, &sample[got], n - got, (off_t)(off + got));
+			if (r <= 0) break;
+			got += (size_t)r;
+		}
+		job->pixels[i] = got ? _bitmap_color(sample, got) : 16;
+	}
+
+	return NULL;
+}
+
+/// Fill in `pixels' from the bytes between `start' and `end', either in the file
+/// `fd' or in `mem' (if it's not NULL).
+///
+static void
+_bitmap_sample(int fd, const byte_t *mem, uint64_t start, uint64_t end,
+		uint64_t bpp, byte_t *pixels, size_t npixels)
+{
+	struct BitmapJob jobs[BITMAP_MAX_THREADS];
+	pthread_t threads[BITMAP_MAX_THREADS];
+
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = (size_t)MAX(MIN(ncpu, BITMAP_MAX_THREADS), 1);
+	nthreads = MIN(nthreads, (npixels + 63) / 64);
+	if (mem) nthreads = 1;
+
+	for (size_t t = 0; t < nthreads; ++t) {
+		jobs[t] = (struct BitmapJob){
+			.fd = fd, .mem = mem, .start = start, .end = end,
+			.bpp = bpp, .pixels = pixels,
+			.first = npixels * t / nthreads,
+			.last = npixels * (t + 1) / nthreads,
+		};
+	}
+
+	/* If a thread can't be started, just do its share on this one. */
+	_Bool started[BITMAP_MAX_THREADS] = {0};
+	for (size_t t = 1; t < nthreads; ++t) {
+		started[t] = !pthread_create(&threads[t], NULL, _bitmap_worker, &jobs[t]);
+		if (!started[t]) _bitmap_worker(&jobs[t]);
+	}
+
+	_bitmap_worker(&jobs[0]);
+
+	for (size_t t = 1; t < nthreads; ++t)
+		if (started[t]) pthread_join(threads[t], NULL);
+}
+
+/// Draw two rows of pixels per line of text, with the upper half block in the
+/// colors of both. The colors are mapped to the terminal's color depth the same
+/// way as the theme's (see _theme_params()).
+///
+static void
+_bitmap_blocks(byte_t *pixels, size_t npixels, size_t width, FILE *out)
+{
+	static char fgs[256][24], bgs[256][24];
+	for (size_t c = 0; c < 256; ++c) {
+		_theme_params((uint32_t)c, false, fgs[c], sizeof(fgs[c]));
+		_theme_params((uint32_t)c, true, bgs[c], sizeof(bgs[c]));
+	}
+
+	for (size_t row = 0; row * width < npixels; row += 2) {
+		int fg = -1, bg = -1;
+
+		for (size_t x = 0; x < width; ++x) {
+			size_t top = row * width + x, bot = top + width;
+
+			if (top >= npixels) {
+				fprintf(out, "\x1b[m ");
+				fg = bg = -1;
+				continue;
+			}
+
+			if (pixels[top] != fg) {
+				fg = pixels[top];
+				fprintf(out, "\x1b[%sm", fgs[fg]);
+			}
+
+			if (bot >= npixels && bg != 256) {
+				bg = 256;
+				fprintf(out, "\x1b[49m");
+			} else if (bot < npixels && pixels[bot] != bg) {
+				bg = pixels[bot];
+				fprintf(out, "\x1b[%sm", bgs[bg]);
+			}
+
+			fprintf(out, "▀");
+		}
+
+		fprintf(out, "\x1b[m\n");
+	}
+}
+
+static void
+_bitmap_sixel_run(FILE *out, int ch, size_t run)
+{
+	if (run > 3)
+		fprintf(out, "!%zu%c", run, ch);
+	else
+		while (run--) fputc(ch, out);
+}
+
+static void
+_bitmap_sixel(byte_t *pixels, size_t npixels, size_t width, FILE *out)
+{
+	size_t height = (npixels + width - 1) / width;
+	size_t sw = width * BITMAP_SIXEL_SCALE, sh = height * BITMAP_SIXEL_SCALE;
+
+	_Bool used[256] = {0};
+	for (size_t i = 0; i < npixels; ++i)
+		used[pixels[i]] = true;
+
+	fprintf(out, "\x1bPq\"1;1;%zu;%zu", sw, sh);
+	for (size_t c = 0; c < 256; ++c) {
+		if (!used[c]) continue;
+		byte_t rgb[3];
+		theme_rgb(c, rgb);
+		fprintf(out, "#%zu;2;%d;%d;%d", c,
+			rgb[0] * 100 / 255, rgb[1] * 100 / 255, rgb[2] * 100 / 255);
+	}
+
+	/// Each band of six rows is drawn once per color, with a '$' (carriage return)
+	/// in between. A sixel character is 63 plus a bitmask of which of the six rows
+	/// have that color; runs of the same character are run-length encoded.
+	byte_t *line = arena_alloc(&arena_scratch, sw);
+	if (line == NULL) {
+		warnx("sixel: not enough memory left in the budget");
+		return;
+	}
+
+	for (size_t band = 0; band < sh; band += 6) {
+		for (size_t c = 0; c < 256; ++c) {
+			if (!used[c]) continue;
+
+			size_t len = 0;
+			for (size_t sx = 0; sx < sw; ++sx) {
+				byte_t bits = 0;
+				for (size_t r = 0; r < 6 && band + r < sh; ++r) {
+					size_t i = (band + r) / BITMAP_SIXEL_SCALE * width
+						+ sx / BITMAP_SIXEL_SCALE;
+					if (i < npixels && pixels[i] == c)
+						bits |= 1 << r;
+				}
+				line[sx] = bits;
+				if (bits) len = sx + 1;
+			}
+
+			if (len == 0) continue;
+
+			fprintf(out, "#%zu", c);
+			for (size_t sx = 0; sx < len;) {
+				size_t run = 1;
+				while (sx + run < len && line[sx + run] == line[sx])
+					++run;
+				_bitmap_sixel_run(out, 63 + line[sx], run);
+				sx += run;
+			}
+			fprintf(out, "$");
+		}
+		fprintf(out, "-");
+	}
+
+	fprintf(out, "\x1b\\\n");
+}
+
+static void
+_bitmap_termsize(size_t *cols, size_t *rows)
+{
+	struct winsize ws;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col && ws.ws_row) {
+		*cols = ws.ws_col, *rows = MAX(ws.ws_row, 3);
+		return;
+	}
+
+	char *env_COLUMNS = getenv("COLUMNS"), *env_LINES = getenv("LINES");
+	*cols = env_COLUMNS ? (size_t)MAX(strtol(env_COLUMNS, NULL, 10), 1) : 80;
+	*rows = env_LINES ? (size_t)MAX(strtol(env_LINES, NULL, 10), 3) : 24;
+}
+
+static void
+bitmap(char *path, FILE *out)
+{
+	FILE *fp = !strcmp(path, "-") ? stdin : fopen(path, "r");
+	if (fp == NULL) {
+		warn("\"%s\"", path);
+		return;
+	}
+
+	size_t cols, rows, width, maxpixels;
+	_bitmap_termsize(&cols, &rows);
+	if (options.bitmap == BM_Sixel) {
+		width = BITMAP_SIXEL_W;
+		maxpixels = BITMAP_SIXEL_W * BITMAP_SIXEL_H;
+	} else {
+		width = cols;
+		maxpixels = cols * (rows - 1) * 2;
+	}
+
+	int fd = fileno(fp);
+	byte_t *mem = NULL;
+	size_t cap = 0;
+	uint64_t start = options.offset, end, bpp;
+
+	/// Seekable inputs: work out how many bytes each pixel stands for from the size
+	/// of the input. Everything else: slurp up to `maxpixels' lines.
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size != -1) {
+		end = (uint64_t)size;
+		if (options.length > 0)
+			end = MIN(end, start + options.length);
+		if (start >= end) goto cleanup;
+		bpp = MAX((end - start + maxpixels - 1) / maxpixels, 1);
+	} else {
+		bpp = options.linelen;
+		cap = maxpixels * bpp;
+		if (options.length > 0)
+			cap = MIN(cap, options.length);
+
+		/* If the budget is tight, draw as many lines as fit in it. */
+		size_t want = cap;
+		mem = mem_alloc_shrink(&cap, bpp, bpp);
+		if (mem == NULL) {
+			warnx("\"%s\": not enough memory left in the budget", path);
+			goto cleanup;
+		}
+		if (cap < want)
+			warnx("\"%s\": only drawing the first %zu bytes, to stay in the "
+				"memory budget", path, cap);
+
+		/* There's no seeking in a pipe, so read through what -s skips. */
+		for (uint64_t skip = start; skip > 0; ) {
+			size_t r = fread(mem, 1, (size_t)MIN(skip, cap), fp);
+			if (r == 0) goto cleanup;
+			skip -= r;
+		}
+
+		size_t got = fread(mem, 1, cap, fp);
+		if (got == 0) goto cleanup;
+		start = 0, end = got;
+	}
+
+	size_t npixels = (size_t)((end - start + bpp - 1) / bpp);
+	byte_t *pixels = arena_alloc(&arena_scratch, npixels);
+	if (pixels == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", path);
+		goto cleanup;
+	}
+
+	_bitmap_sample(fd, mem, start, end, bpp, pixels, npixels);
+
+	if (options.bitmap == BM_Sixel)
+		_bitmap_sixel(pixels, npixels, width, out);
+	else
+		_bitmap_blocks(pixels, npixels, width, out);
+
+cleanup:
+	arena_reset(&arena_scratch);
+	mem_free(mem, cap);
+	if (fp != stdin)
+		fclose(fp);
+}
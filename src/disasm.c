@@ -0,0 +1,1917 @@
+/// Disassembly columns for x86-64 and AArch64 machine code (-f x86_64, aarch64),
+/// which list the instructions that start on each line, the way objdump(1) prints
+/// them: in Intel syntax for x86, and in ARM's syntax for AArch64.
+///
+/// Instructions are decoded from where the last one ended, so the column follows
+/// the code from line to line (`disasm_next' is where the next one starts). One
+/// that starts on a line is listed on it, with the rest of its bytes looked up in
+/// the plugin window; if they haven't arrived yet (on an interactive input), it's
+/// listed on the next line instead. The dump is taken to start on an instruction
+/// boundary, as it does again after a hole or at the start of a --ranges slice.
+///
+/// Both decoders are table-driven:
+///
+/// * x86-64: each opcode's entry in the opcode maps below spells out its operands
+///   the way the opcode maps in Intel's manual do ("Ev,Gv" is a register or memory
+///   operand and then a register, both of the operand size). The entries are
+///   parsed once, into `x86_info', so that the length of an instruction is found
+///   with a few table lookups; the operands are only spelled out again when it's
+///   printed.
+///
+/// * AArch64: instructions are four bytes, aligned to four, and the first entry
+///   in `a64_ops' whose mask and value match one says how to print it.
+///
+/// Neither knows every instruction. Unknown ones are printed as "(bad)" on x86,
+/// where their length can't be known either, and as ".inst 0x..." on AArch64.
+/// x86 instructions with an EVEX prefix (AVX-512) are only printed by name.
+///
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Where the next instruction starts: where the last one that was decoded ended,
+/// or SIZE_MAX if the next line starts afresh.
+static size_t disasm_next = SIZE_MAX;
+
+/// An instruction's text, as it's put together.
+struct DisText {
+	char s[192];
+	size_t len;
+};
+
+static void
+_dis_put(struct DisText *t, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+
+	/* Most of the pieces are plain strings, which are just copied. */
+	const char *str = NULL;
+	size_t n = 0;
+	if (!strcmp(fmt, "%s")) {
+		str = va_arg(ap, const char *), n = strlen(str);
+	} else if (!strcmp(fmt, "%.*s")) {
+		n = (size_t)va_arg(ap, int), str = va_arg(ap, const char *);
+		n = strnlen(str, n);
+	} else if (!strchr(fmt, '%')) {
+		str = fmt, n = strlen(fmt);
+	}
+
+	if (str) {
+		n = MIN(n, sizeof(t->s) - 1 - t->len);
+		memcpy(&t->s[t->len], str, n);
+		t->len += n;
+		t->s[t->len] = '\0';
+	} else {
+		int r = vsnprintf(&t->s[t->len], sizeof(t->s) - t->len, fmt, ap);
+		if (r > 0)
+			t->len = MIN(t->len + (size_t)r, sizeof(t->s) - 1);
+	}
+	va_end(ap);
+}
+
+/// Put `v' in hex, after `prefix'; numbers are most of what vsnprintf() would be
+/// needed for.
+///
+static void
+_dis_hex(struct DisText *t, const char *prefix, uint64_t v)
+{
+	char buf[24], *p = &buf[sizeof(buf)];
+	*--p = '\0';
+	do
+		*--p = "0123456789abcdef"[v & 15];
+	while (v >>= 4);
+	*--p = 'x', *--p = '0';
+	_dis_put(t, "%s", prefix);
+	_dis_put(t, "%s", p);
+}
+
+/// ---
+///
+/// x86-64.
+///
+/// An entry is either empty (the opcode isn't valid), a mnemonic followed by its
+/// operands, or up to four of those separated by `|', for when there's no prefix,
+/// or a 66, F3, or F2 prefix (which select between SSE instructions). Operands
+/// are an addressing method and a size, as in the opcode maps of Intel's manual:
+///
+///   E  ModRM r/m: a register or memory     G  ModRM reg: a register
+///   M  ModRM r/m, memory only              R  ModRM r/m, register only
+///   V  ModRM reg: an XMM register          W  ModRM r/m: an XMM register or memory
+///   U  ModRM r/m: an XMM register only     H  VEX.vvvv: an XMM register
+///   B  VEX.vvvv: a register                P, Q, N  like V, W, U, for MMX registers
+///   S  ModRM reg: a segment register       C, D  ModRM reg: a control, debug register
+///   K  ModRM reg: a mask register      A  ModRM r/m: a mask register or memory
+///   L  VEX.vvvv: a mask register        Z  the low three bits of the opcode: a register
+///   I  an immediate                        J  a branch offset
+///   O  an absolute address                 X, Y  ds:[rsi], es:[rdi]
+///   T  ds:[rbx]                            F  an immediate byte: an XMM register
+///
+///   b  byte     w  word     d  doubleword     q  quadword     t  ten bytes
+///   v  16, 32, or 64 bits, depending on the operand size (66, REX.W)
+///   z  16 or 32 bits (an immediate that's sign-extended to 64 bits)
+///   y  32 or 64 bits (REX.W)      f  64 bits, or 16 bits with 66 (stack operations)
+///   x  128 or 256 bits (VEX.L)    p  a far pointer (FWORD)
+///   k  the size of a mask instruction: 16 or 64 bits with no prefix, 8 or 32
+///      bits with 66, and 32 or 64 bits with F2 (REX.W picks)
+///   s  (immediates only) a byte that's sign-extended to the operand size
+///
+/// Operands in lowercase (al, cl, dx, 1, st, st(i)) are printed as-is, and rAX
+/// and eAX are the accumulator of the operand size (v or z). H and B operands
+/// only exist with a VEX prefix, and are left out without one.
+///
+/// Other notation:
+///
+/// * "#N ops": the instruction is in group N (x86_groups) by its ModRM reg field,
+///   with the operands given here unless the group gives its own.
+/// * "a~b": `a' without a VEX prefix, and `b' with one.
+/// * "a^b": `a' for a memory operand, `b' for a register (ModRM mod == 3).
+/// * "a/b/c" in a mnemonic: the name for a 16, 32, or 64-bit operand size; "a/b"
+///   picks by REX.W (or VEX.W).
+/// * "!": only exists with a VEX prefix. Other instructions are only valid with
+///   one if they have XMM operands, and then get a `v' in front of their name.
+/// * "@": printed by _x86_special().
+///
+
+#define X86_SSE(M)  M " Vx,Hx,Wx|" M " Vx,Hx,Wx||"
+#define X86_MMX(M)  M " Pq,Qq|" M " Vx,Hx,Wx||"
+#define X86_PS(M)   M "ps Vx,Hx,Wx|" M "pd Vx,Hx,Wx|" M "ss Vx,Hx,Wd|" M "sd Vx,Hx,Wq"
+#define X86_ALU(M)  M " Eb,Gb", M " Ev,Gv", M " Gb,Eb", M " Gv,Ev", M " al,Ib", M " rAX,Iz"
+#define X86_K(M, O)  "!" M "w/" M "q " O "|!" M "b/" M "d " O "||"
+#define X86_CC(M, O) \
+	M "o " O, M "no " O, M "b " O, M "ae " O, M "e " O, M "ne " O, M "be " O, M "a " O, \
+	M "s " O, M "ns " O, M "p " O, M "np " O, M "l " O, M "ge " O, M "le " O, M "g " O
+
+static const char *x86_one[256] = {
+	X86_ALU("add"), "", "",
+	X86_ALU("or"), "", "",
+	X86_ALU("adc"), "", "",
+	X86_ALU("sbb"), "", "",
+	X86_ALU("and"), "", "",
+	X86_ALU("sub"), "", "",
+	X86_ALU("xor"), "", "",
+	X86_ALU("cmp"), "", "",
+	[0x40] = "", "", "", "", "", "", "", "", "", "", "", "", "", "", "", "",
+	"push Zf", "push Zf", "push Zf", "push Zf", "push Zf", "push Zf", "push Zf", "push Zf",
+	"pop Zf", "pop Zf", "pop Zf", "pop Zf", "pop Zf", "pop Zf", "pop Zf", "pop Zf",
+	"", "", "", "movsxd Gv,Ed", "", "", "", "",
+	"push Iz", "imul Gv,Ev,Iz", "push Is", "imul Gv,Ev,Is",
+	"ins Yb,dx", "ins Yz,dx", "outs dx,Xb", "outs dx,Xz",
+	[0x70] = "jo Jb", "jno Jb", "jb Jb", "jae Jb", "je Jb", "jne Jb", "jbe Jb", "ja Jb",
+	"js Jb", "jns Jb", "jp Jb", "jnp Jb", "jl Jb", "jge Jb", "jle Jb", "jg Jb",
+	"#1 Eb,Ib", "#1 Ev,Iz", "", "#1 Ev,Is",
+	"test Eb,Gb", "test Ev,Gv", "xchg Eb,Gb", "xchg Ev,Gv",
+	"mov Eb,Gb", "mov Ev,Gv", "mov Gb,Eb", "mov Gv,Ev",
+	"mov Ew,Sw^mov Rv,Sw", "lea Gv,M", "mov Sw,Ew^mov Sw,Rv", "#10 Ef",
+	"@", "xchg Zv,rAX", "xchg Zv,rAX", "xchg Zv,rAX",
+	"xchg Zv,rAX", "xchg Zv,rAX", "xchg Zv,rAX", "xchg Zv,rAX",
+	"cbw/cwde/cdqe", "cwd/cdq/cqo", "", "fwait", "pushf", "popf", "sahf", "lahf",
+	"movabs al,Ob", "movabs rAX,Ov", "movabs Ob,al", "movabs Ov,rAX",
+	"movs Yb,Xb", "movs Yv,Xv", "cmps Xb,Yb", "cmps Xv,Yv",
+	"test al,Ib", "test rAX,Iz", "stos Yb,al", "stos Yv,rAX",
+	"lods al,Xb", "lods rAX,Xv", "scas al,Yb", "scas rAX,Yv",
+	"mov Zb,Ib", "mov Zb,Ib", "mov Zb,Ib", "mov Zb,Ib",
+	"mov Zb,Ib", "mov Zb,Ib", "mov Zb,Ib", "mov Zb,Ib",
+	"mov Zv,Iv", "mov Zv,Iv", "mov Zv,Iv", "mov Zv,Iv",
+	"mov Zv,Iv", "mov Zv,Iv", "mov Zv,Iv", "mov Zv,Iv",
+	"#2 Eb,Ib", "#2 Ev,Ib", "ret Iw", "ret", "", "", "#11 Eb,Ib", "#12 Ev,Iz",
+	"enter Iw,Ib", "leave", "retf Iw", "retf", "int3", "int Ib", "", "iretw/iret/iretq",
+	"#2 Eb,1", "#2 Ev,1", "#2 Eb,cl", "#2 Ev,cl", "", "", "", "xlat Tb",
+	"@", "@", "@", "@", "@", "@", "@", "@",
+	"loopne Jb", "loope Jb", "loop Jb", "jrcxz Jb",
+	"in al,Ib", "in eAX,Ib", "out Ib,al", "out Ib,eAX",
+	"call Jz", "jmp Jz", "", "jmp Jb", "in al,dx", "in eAX,dx", "out dx,al", "out dx,eAX",
+	"", "int1", "", "", "hlt", "cmc", "#3 Eb", "#4 Ev",
+	"clc", "stc", "cli", "sti", "cld", "std", "#5", "#6",
+};
+
+static const char *x86_0f[256] = {
+	"#13 Ew", "#14", "lar Gv,Ew", "lsl Gv,Ew", "", "syscall", "clts", "sysret",
+	"invd", "wbinvd", "", "ud2", "", "#15 Mb", "", "",
+	"movups Vx,Wx|movupd Vx,Wx|movss Vx,Hx,Wd|movsd Vx,Hx,Wq",
+	"movups Wx,Vx|movupd Wx,Vx|movss Wd,Hx,Vx|movsd Wq,Hx,Vx",
+	"movlps Vq,Hq,Mq^movhlps Vq,Hq,Uq|movlpd Vq,Hq,Mq|movsldup Vx,Wx|movddup Vx,Wq",
+	"movlps Mq,Vq|movlpd Mq,Vq||",
+	"unpcklps Vx,Hx,Wx|unpcklpd Vx,Hx,Wx||",
+	"unpckhps Vx,Hx,Wx|unpckhpd Vx,Hx,Wx||",
+	"movhps Vq,Hq,Mq^movlhps Vq,Hq,Uq|movhpd Vq,Hq,Mq|movshdup Vx,Wx|",
+	"movhps Mq,Vq|movhpd Mq,Vq||",
+	"#16 Mb", "nop Ev", "nop Ev", "nop Ev", "nop Ev", "nop Ev", "@", "nop Ev",
+	"mov Rq,Cq", "mov Rq,Dq", "mov Cq,Rq", "mov Dq,Rq", "", "", "", "",
+	"movaps Vx,Wx|movapd Vx,Wx||",
+	"movaps Wx,Vx|movapd Wx,Vx||",
+	"cvtpi2ps Vx,Qq|cvtpi2pd Vx,Qq|cvtsi2ss Vx,Hx,Ey|cvtsi2sd Vx,Hx,Ey",
+	"movntps Mx,Vx|movntpd Mx,Vx||",
+	"cvttps2pi Pq,Wq|cvttpd2pi Pq,Wx|cvttss2si Gy,Wd|cvttsd2si Gy,Wq",
+	"cvtps2pi Pq,Wq|cvtpd2pi Pq,Wx|cvtss2si Gy,Wd|cvtsd2si Gy,Wq",
+	"ucomiss Vd,Wd|ucomisd Vq,Wq||",
+	"comiss Vd,Wd|comisd Vq,Wq||",
+	"wrmsr", "rdtsc", "rdmsr", "rdpmc", "sysenter", "sysexit", "", "getsec",
+	"", "", "", "", "", "", "", "",
+	"cmovo Gv,Ev", "cmovno Gv,Ev~" X86_K("kand", "Kk,Lk,Ak"),
+	"cmovb Gv,Ev~" X86_K("kandn", "Kk,Lk,Ak"), "cmovae Gv,Ev",
+	"cmove Gv,Ev~" X86_K("knot", "Kk,Ak"), "cmovne Gv,Ev~" X86_K("kor", "Kk,Lk,Ak"),
+	"cmovbe Gv,Ev~" X86_K("kxnor", "Kk,Lk,Ak"), "cmova Gv,Ev~" X86_K("kxor", "Kk,Lk,Ak"),
+	"cmovs Gv,Ev", "cmovns Gv,Ev", "cmovp Gv,Ev~" X86_K("kadd", "Kk,Lk,Ak"),
+	"cmovnp Gv,Ev~!kunpckwd/kunpckdq Kk,Lk,Ak|!kunpckbw Kk,Lk,Ak||",
+	"cmovl Gv,Ev", "cmovge Gv,Ev", "cmovle Gv,Ev", "cmovg Gv,Ev",
+	"movmskps Gd,Ux|movmskpd Gd,Ux||",
+	X86_PS("sqrt"),
+	"rsqrtps Vx,Wx||rsqrtss Vx,Hx,Wd|",
+	"rcpps Vx,Wx||rcpss Vx,Hx,Wd|",
+	"andps Vx,Hx,Wx|andpd Vx,Hx,Wx||",
+	"andnps Vx,Hx,Wx|andnpd Vx,Hx,Wx||",
+	"orps Vx,Hx,Wx|orpd Vx,Hx,Wx||",
+	"xorps Vx,Hx,Wx|xorpd Vx,Hx,Wx||",
+	X86_PS("add"), X86_PS("mul"),
+	"cvtps2pd Vx,Wq|cvtpd2ps Vx,Wx|cvtss2sd Vx,Hx,Wd|cvtsd2ss Vx,Hx,Wq",
+	"cvtdq2ps Vx,Wx|cvtps2dq Vx,Wx|cvttps2dq Vx,Wx|",
+	X86_PS("sub"), X86_PS("min"), X86_PS("div"), X86_PS("max"),
+	X86_MMX("punpcklbw"), X86_MMX("punpcklwd"), X86_MMX("punpckldq"), X86_MMX("packsswb"),
+	X86_MMX("pcmpgtb"), X86_MMX("pcmpgtw"), X86_MMX("pcmpgtd"), X86_MMX("packuswb"),
+	X86_MMX("punpckhbw"), X86_MMX("punpckhwd"), X86_MMX("punpckhdq"), X86_MMX("packssdw"),
+	"|punpcklqdq Vx,Hx,Wx||", "|punpckhqdq Vx,Hx,Wx||",
+	"movd/movq Pq,Ey|movd/movq Vx,Ey||",
+	"movq Pq,Qq|movdqa Vx,Wx|movdqu Vx,Wx|",
+	"pshufw Pq,Qq,Ib|pshufd Vx,Wx,Ib|pshufhw Vx,Wx,Ib|pshuflw Vx,Wx,Ib",
+	"#17", "#18", "#19",
+	X86_MMX("pcmpeqb"), X86_MMX("pcmpeqw"), X86_MMX("pcmpeqd"), "@",
+	"", "", "", "", "|haddpd Vx,Hx,Wx||haddps Vx,Hx,Wx", "|hsubpd Vx,Hx,Wx||hsubps Vx,Hx,Wx",
+	"movd/movq Ey,Pq|movd/movq Ey,Vx|movq Vx,Wq|",
+	"movq Qq,Pq|movdqa Wx,Vx|movdqu Wx,Vx|",
+	X86_CC("j", "Jz"),
+	"seto Eb~" X86_K("kmov", "Kk,Ak"), "setno Eb~" X86_K("kmov", "Mk,Kk"),
+	"setb Eb~!kmovw Kk,Rd|!kmovb Kk,Rd||!kmovd/kmovq Kk,Ry",
+	"setae Eb~!kmovw Gd,Ak|!kmovb Gd,Ak||!kmovd/kmovq Gy,Ak",
+	"sete Eb", "setne Eb", "setbe Eb", "seta Eb",
+	"sets Eb~" X86_K("kortest", "Kk,Ak"), "setns Eb~" X86_K("ktest", "Kk,Ak"),
+	"setp Eb", "setnp Eb", "setl Eb", "setge Eb", "setle Eb", "setg Eb",
+	"push fs", "pop fs", "cpuid", "bt Ev,Gv", "shld Ev,Gv,Ib", "shld Ev,Gv,cl", "", "",
+	"push gs", "pop gs", "rsm", "bts Ev,Gv", "shrd Ev,Gv,Ib", "shrd Ev,Gv,cl", "#20", "imul Gv,Ev",
+	"cmpxchg Eb,Gb", "cmpxchg Ev,Gv", "lss Gv,Mp", "btr Ev,Gv",
+	"lfs Gv,Mp", "lgs Gv,Mp", "movzx Gv,Eb", "movzx Gv,Ew",
+	"||popcnt Gv,Ev|", "ud1 Gv,Ev", "#21 Ev,Ib", "btc Ev,Gv",
+	"bsf Gv,Ev|bsf Gv,Ev|tzcnt Gv,Ev|", "bsr Gv,Ev|bsr Gv,Ev|lzcnt Gv,Ev|",
+	"movsx Gv,Eb", "movsx Gv,Ew",
+	"xadd Eb,Gb", "xadd Ev,Gv",
+	"cmpps Vx,Hx,Wx,Ib|cmppd Vx,Hx,Wx,Ib|cmpss Vx,Hx,Wd,Ib|cmpsd Vx,Hx,Wq,Ib",
+	"movnti My,Gy", "pinsrw Pq,Ed,Ib|pinsrw Vx,Hx,Ed,Ib||", "pextrw Gd,Nq,Ib|pextrw Gd,Ux,Ib||",
+	"shufps Vx,Hx,Wx,Ib|shufpd Vx,Hx,Wx,Ib||", "#22",
+	"bswap Zy", "bswap Zy", "bswap Zy", "bswap Zy", "bswap Zy", "bswap Zy", "bswap Zy", "bswap Zy",
+	"|addsubpd Vx,Hx,Wx||addsubps Vx,Hx,Wx",
+	X86_MMX("psrlw"), X86_MMX("psrld"), X86_MMX("psrlq"), X86_MMX("paddq"), X86_MMX("pmullw"),
+	"|movq Wq,Vx||", "pmovmskb Gd,Nq|pmovmskb Gd,Ux||",
+	X86_MMX("psubusb"), X86_MMX("psubusw"), X86_MMX("pminub"), X86_MMX("pand"),
+	X86_MMX("paddusb"), X86_MMX("paddusw"), X86_MMX("pmaxub"), X86_MMX("pandn"),
+	X86_MMX("pavgb"), X86_MMX("psraw"), X86_MMX("psrad"), X86_MMX("pavgw"),
+	X86_MMX("pmulhuw"), X86_MMX("pmulhw"),
+	"|cvttpd2dq Vx,Wx|cvtdq2pd Vx,Wq|cvtpd2dq Vx,Wx", "movntq Mq,Pq|movntdq Mx,Vx||",
+	X86_MMX("psubsb"), X86_MMX("psubsw"), X86_MMX("pminsw"), X86_MMX("por"),
+	X86_MMX("paddsb"), X86_MMX("paddsw"), X86_MMX("pmaxsw"), X86_MMX("pxor"),
+	"|||lddqu Vx,Mx", X86_MMX("psllw"), X86_MMX("pslld"), X86_MMX("psllq"),
+	X86_MMX("pmuludq"), X86_MMX("pmaddwd"), X86_MMX("psadbw"), "maskmovq Pq,Nq|maskmovdqu Vx,Ux||",
+	X86_MMX("psubb"), X86_MMX("psubw"), X86_MMX("psubd"), X86_MMX("psubq"),
+	X86_MMX("paddb"), X86_MMX("paddw"), X86_MMX("paddd"), "ud0 Gv,Ev",
+};
+
+static const char *x86_0f38[256] = {
+	X86_MMX("pshufb"), X86_MMX("phaddw"), X86_MMX("phaddd"), X86_MMX("phaddsw"),
+	X86_MMX("pmaddubsw"), X86_MMX("phsubw"), X86_MMX("phsubd"), X86_MMX("phsubsw"),
+	X86_MMX("psignb"), X86_MMX("psignw"), X86_MMX("psignd"), X86_MMX("pmulhrsw"),
+	"|!permilps Vx,Hx,Wx||", "|!permilpd Vx,Hx,Wx||", "|!testps Vx,Wx||", "|!testpd Vx,Wx||",
+	"|pblendvb Vx,Wx,xmm0||", "", "", "|!cvtph2ps Vx,Wq||",
+	"|blendvps Vx,Wx,xmm0||", "|blendvpd Vx,Wx,xmm0||", "|!permps Vx,Hx,Wx||", "|ptest Vx,Wx||",
+	"|!broadcastss Vx,Wd||", "|!broadcastsd Vx,Wq||", "|!broadcastf128 Vx,Mx||", "",
+	"pabsb Pq,Qq|pabsb Vx,Wx||", "pabsw Pq,Qq|pabsw Vx,Wx||", "pabsd Pq,Qq|pabsd Vx,Wx||", "",
+	"|pmovsxbw Vx,Wq||", "|pmovsxbd Vx,Wd||", "|pmovsxbq Vx,Ww||", "|pmovsxwd Vx,Wq||",
+	"|pmovsxwq Vx,Wd||", "|pmovsxdq Vx,Wq||", "", "",
+	X86_SSE("pmuldq"), X86_SSE("pcmpeqq"), "|movntdqa Vx,Mx||", X86_SSE("packusdw"),
+	"|!maskmovps Vx,Hx,Mx||", "|!maskmovpd Vx,Hx,Mx||", "|!maskmovps Mx,Hx,Vx||", "|!maskmovpd Mx,Hx,Vx||",
+	"|pmovzxbw Vx,Wq||", "|pmovzxbd Vx,Wd||", "|pmovzxbq Vx,Ww||", "|pmovzxwd Vx,Wq||",
+	"|pmovzxwq Vx,Wd||", "|pmovzxdq Vx,Wq||", "|!permd Vx,Hx,Wx||", X86_SSE("pcmpgtq"),
+	X86_SSE("pminsb"), X86_SSE("pminsd"), X86_SSE("pminuw"), X86_SSE("pminud"),
+	X86_SSE("pmaxsb"), X86_SSE("pmaxsd"), X86_SSE("pmaxuw"), X86_SSE("pmaxud"),
+	X86_SSE("pmulld"), "|phminposuw Vx,Wx||", "", "",
+	"", "|!psrlvd/psrlvq Vx,Hx,Wx||", "|!psravd Vx,Hx,Wx||", "|!psllvd/psllvq Vx,Hx,Wx||",
+	[0x58] = "|!pbroadcastd Vx,Wd||", "|!pbroadcastq Vx,Wq||", "|!broadcasti128 Vx,Mx||",
+	[0x78] = "|!pbroadcastb Vx,Wb||", "|!pbroadcastw Vx,Ww||",
+	[0x8c] = "|!pmaskmovd/pmaskmovq Vx,Hx,Mx||", "", "|!pmaskmovd/pmaskmovq Mx,Hx,Vx||",
+	[0x96] = "|!fmaddsub132ps/fmaddsub132pd Vx,Hx,Wx||",
+	"|!fmsubadd132ps/fmsubadd132pd Vx,Hx,Wx||",
+	"|!fmadd132ps/fmadd132pd Vx,Hx,Wx||", "|!fmadd132ss/fmadd132sd Vx,Hx,Wy||",
+	"|!fmsub132ps/fmsub132pd Vx,Hx,Wx||", "|!fmsub132ss/fmsub132sd Vx,Hx,Wy||",
+	"|!fnmadd132ps/fnmadd132pd Vx,Hx,Wx||", "|!fnmadd132ss/fnmadd132sd Vx,Hx,Wy||",
+	"|!fnmsub132ps/fnmsub132pd Vx,Hx,Wx||", "|!fnmsub132ss/fnmsub132sd Vx,Hx,Wy||",
+	[0xa6] = "|!fmaddsub213ps/fmaddsub213pd Vx,Hx,Wx||",
+	"|!fmsubadd213ps/fmsubadd213pd Vx,Hx,Wx||",
+	"|!fmadd213ps/fmadd213pd Vx,Hx,Wx||", "|!fmadd213ss/fmadd213sd Vx,Hx,Wy||",
+	"|!fmsub213ps/fmsub213pd Vx,Hx,Wx||", "|!fmsub213ss/fmsub213sd Vx,Hx,Wy||",
+	"|!fnmadd213ps/fnmadd213pd Vx,Hx,Wx||", "|!fnmadd213ss/fnmadd213sd Vx,Hx,Wy||",
+	"|!fnmsub213ps/fnmsub213pd Vx,Hx,Wx||", "|!fnmsub213ss/fnmsub213sd Vx,Hx,Wy||",
+	[0xb6] = "|!fmaddsub231ps/fmaddsub231pd Vx,Hx,Wx||",
+	"|!fmsubadd231ps/fmsubadd231pd Vx,Hx,Wx||",
+	"|!fmadd231ps/fmadd231pd Vx,Hx,Wx||", "|!fmadd231ss/fmadd231sd Vx,Hx,Wy||",
+	"|!fmsub231ps/fmsub231pd Vx,Hx,Wx||", "|!fmsub231ss/fmsub231sd Vx,Hx,Wy||",
+	"|!fnmadd231ps/fnmadd231pd Vx,Hx,Wx||", "|!fnmadd231ss/fnmadd231sd Vx,Hx,Wy||",
+	"|!fnmsub231ps/fnmsub231pd Vx,Hx,Wx||", "|!fnmsub231ss/fnmsub231sd Vx,Hx,Wy||",
+	[0xc8] = "sha1nexte Vx,Wx", "sha1msg1 Vx,Wx", "sha1msg2 Vx,Wx", "sha256rnds2 Vx,Wx,xmm0",
+	"sha256msg1 Vx,Wx", "sha256msg2 Vx,Wx",
+	[0xdb] = "|aesimc Vx,Wx||", X86_SSE("aesenc"), X86_SSE("aesenclast"),
+	X86_SSE("aesdec"), X86_SSE("aesdeclast"),
+	[0xf0] = "movbe Gv,Mv|movbe Gv,Mv||crc32 Gd,Eb", "movbe Mv,Gv|movbe Mv,Gv||crc32 Gd,Ev",
+	"!andn Gy,By,Ey", "#23 Ey", "", "!bzhi Gy,Ey,By||!pext Gy,By,Ey|!pdep Gy,By,Ey",
+	"|adcx Gy,Ey|adox Gy,Ey|!mulx Gy,By,Ey",
+	"!bextr Gy,Ey,By|!shlx Gy,Ey,By|!sarx Gy,Ey,By|!shrx Gy,Ey,By",
+};
+
+static const char *x86_0f3a[256] = {
+	"|!permq Vx,Wx,Ib||", "|!permpd Vx,Wx,Ib||", "|!pblendd Vx,Hx,Wx,Ib||", "",
+	"|!permilps Vx,Wx,Ib||", "|!permilpd Vx,Wx,Ib||", "|!perm2f128 Vx,Hx,Wx,Ib||", "",
+	"|roundps Vx,Wx,Ib||", "|roundpd Vx,Wx,Ib||", "|roundss Vx,Hx,Wd,Ib||", "|roundsd Vx,Hx,Wq,Ib||",
+	"|blendps Vx,Hx,Wx,Ib||", "|blendpd Vx,Hx,Wx,Ib||", "|pblendw Vx,Hx,Wx,Ib||",
+	"palignr Pq,Qq,Ib|palignr Vx,Hx,Wx,Ib||",
+	[0x14] = "|pextrb Ed,Vx,Ib||", "|pextrw Ed,Vx,Ib||", "|pextrd/pextrq Ey,Vx,Ib||",
+	"|extractps Ed,Vx,Ib||",
+	"|!insertf128 Vx,Hx,Wq,Ib||", "|!extractf128 Wq,Vx,Ib||", [0x1d] = "|!cvtps2ph Wq,Vx,Ib||",
+	[0x20] = "|pinsrb Vx,Hx,Ed,Ib||", "|insertps Vx,Hx,Wd,Ib||", "|pinsrd/pinsrq Vx,Hx,Ey,Ib||",
+	[0x38] = "|!inserti128 Vx,Hx,Wq,Ib||", "|!extracti128 Wq,Vx,Ib||",
+	[0x40] = "|dpps Vx,Hx,Wx,Ib||", "|dppd Vx,Hx,Wx,Ib||", "|mpsadbw Vx,Hx,Wx,Ib||", "",
+	"|pclmulqdq Vx,Hx,Wx,Ib||", "", "|!perm2i128 Vx,Hx,Wx,Ib||",
+	[0x4a] = "|!blendvps Vx,Hx,Wx,Fx||", "|!blendvpd Vx,Hx,Wx,Fx||", "|!pblendvb Vx,Hx,Wx,Fx||",
+	[0x60] = "|pcmpestrm Vx,Wx,Ib||", "|pcmpestri Vx,Wx,Ib||",
+	"|pcmpistrm Vx,Wx,Ib||", "|pcmpistri Vx,Wx,Ib||",
+	[0xcc] = "sha1rnds4 Vx,Wx,Ib",
+	[0xdf] = "|aeskeygenassist Vx,Wx,Ib||",
+	[0xf0] = "|||!rorx Gy,Ey,Ib",
+};
+
+/// Groups: the instructions picked by the reg field of the ModRM byte.
+static const char *x86_groups[][8] = {
+	[1]  = { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" },
+	[2]  = { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" },
+	[3]  = { "test Eb,Ib", "test Eb,Ib", "not", "neg", "mul", "imul", "div", "idiv" },
+	[4]  = { "test Ev,Iz", "test Ev,Iz", "not", "neg", "mul", "imul", "div", "idiv" },
+	[5]  = { "inc Eb", "dec Eb" },
+	[6]  = { "inc Ev", "dec Ev", "call Ef", "call Mp", "jmp Ef", "jmp Mp", "push Ef" },
+	[10] = { "pop" },
+	[11] = { "mov", [7] = "^xabort Ib" },
+	[12] = { "mov", [7] = "^xbegin Jz" },
+	[13] = { "sldt", "str", "lldt", "ltr", "verr", "verw" },
+	[14] = { "sgdt M^@", "sidt M^@", "lgdt M^@", "lidt M^@", "smsw Ew", "^@", "lmsw Ew", "invlpg Mb^@" },
+	[15] = { "prefetch^", "prefetchw^", "prefetchwt1^", "prefetch^",
+		"prefetch^", "prefetch^", "prefetch^", "prefetch^" },
+	[16] = { "prefetchnta^nop Ev", "prefetcht0^nop Ev", "prefetcht1^nop Ev",
+		"prefetcht2^nop Ev", "nop Ev", "nop Ev", "nop Ev", "nop Ev" },
+	[17] = { "", "", "^psrlw Nq,Ib|^psrlw Hx,Ux,Ib||", "", "^psraw Nq,Ib|^psraw Hx,Ux,Ib||",
+		"", "^psllw Nq,Ib|^psllw Hx,Ux,Ib||" },
+	[18] = { "", "", "^psrld Nq,Ib|^psrld Hx,Ux,Ib||", "", "^psrad Nq,Ib|^psrad Hx,Ux,Ib||",
+		"", "^pslld Nq,Ib|^pslld Hx,Ux,Ib||" },
+	[19] = { "", "", "^psrlq Nq,Ib|^psrlq Hx,Ux,Ib||", "|^psrldq Hx,Ux,Ib||", "", "",
+		"^psllq Nq,Ib|^psllq Hx,Ux,Ib||", "|^pslldq Hx,Ux,Ib||" },
+	[20] = { "fxsave M^|||rdfsbase Ry", "fxrstor M^|||rdgsbase Ry",
+		"ldmxcsr Md^|||wrfsbase Ry~!vldmxcsr Md^", "stmxcsr Md^|||wrgsbase Ry~!vstmxcsr Md^",
+		"xsave M^", "xrstor M^lfence", "xsaveopt M^mfence", "clflush Mb^sfence" },
+	[21] = { "", "", "", "", "bt", "bts", "btr", "btc" },
+	[22] = { "", "cmpxchg8b/cmpxchg16b Mq^", "", "", "", "",
+		"vmptrld Mq^rdrand Rv", "vmptrst Mq^rdseed Rv" },
+	[23] = { "", "!blsr By,Ey", "!blsmsk By,Ey", "!blsi By,Ey" },
+};
+
+/// The x87 instructions (D8 to DF) with a memory operand, by the reg field.
+static const char *x86_x87_mem[8][8] = {
+	{ "fadd Md", "fmul Md", "fcom Md", "fcomp Md", "fsub Md", "fsubr Md", "fdiv Md", "fdivr Md" },
+	{ "fld Md", "", "fst Md", "fstp Md", "fldenv M", "fldcw Mw", "fnstenv M", "fnstcw Mw" },
+	{ "fiadd Md", "fimul Md", "ficom Md", "ficomp Md", "fisub Md", "fisubr Md", "fidiv Md", "fidivr Md" },
+	{ "fild Md", "fisttp Md", "fist Md", "fistp Md", "", "fld Mt", "", "fstp Mt" },
+	{ "fadd Mq", "fmul Mq", "fcom Mq", "fcomp Mq", "fsub Mq", "fsubr Mq", "fdiv Mq", "fdivr Mq" },
+	{ "fld Mq", "fisttp Mq", "fst Mq", "fstp Mq", "frstor M", "", "fnsave M", "fnstsw Mw" },
+	{ "fiadd Mw", "fimul Mw", "ficom Mw", "ficomp Mw", "fisub Mw", "fisubr Mw", "fidiv Mw", "fidivr Mw" },
+	{ "fild Mw", "fisttp Mw", "fist Mw", "fistp Mw", "fbld Mt", "fild Mq", "fbstp Mt", "fistp Mq" },
+};
+
+/// ...and with a register operand. The ones in `x86_x87_one' go by the whole
+/// ModRM byte instead.
+static const char *x86_x87_reg[8][8] = {
+	{ "fadd st,st(i)", "fmul st,st(i)", "fcom st(i)", "fcomp st(i)",
+	  "fsub st,st(i)", "fsubr st,st(i)", "fdiv st,st(i)", "fdivr st,st(i)" },
+	{ "fld st(i)", "fxch st(i)" },
+	{ "fcmovb st,st(i)", "fcmove st,st(i)", "fcmovbe st,st(i)", "fcmovu st,st(i)" },
+	{ "fcmovnb st,st(i)", "fcmovne st,st(i)", "fcmovnbe st,st(i)", "fcmovnu st,st(i)",
+	  "", "fucomi st,st(i)", "fcomi st,st(i)" },
+	{ "fadd st(i),st", "fmul st(i),st", "", "", "fsubr st(i),st", "fsub st(i),st",
+	  "fdivr st(i),st", "fdiv st(i),st" },
+	{ "ffree st(i)", "", "fst st(i)", "fstp st(i)", "fucom st(i)", "fucomp st(i)" },
+	{ "faddp st(i),st", "fmulp st(i),st", "", "", "fsubrp st(i),st", "fsubp st(i),st",
+	  "fdivrp st(i),st", "fdivp st(i),st" },
+	{ "ffreep st(i)", "", "", "", "", "fucomip st,st(i)", "fcomip st,st(i)" },
+};
+
+static const struct { byte_t op, modrm; const char *name; } x86_x87_one[] = {
+	{ 0xd9, 0xd0, "fnop" }, { 0xd9, 0xe0, "fchs" }, { 0xd9, 0xe1, "fabs" },
+	{ 0xd9, 0xe4, "ftst" }, { 0xd9, 0xe5, "fxam" }, { 0xd9, 0xe8, "fld1" },
+	{ 0xd9, 0xe9, "fldl2t" }, { 0xd9, 0xea, "fldl2e" }, { 0xd9, 0xeb, "fldpi" },
+	{ 0xd9, 0xec, "fldlg2" }, { 0xd9, 0xed, "fldln2" }, { 0xd9, 0xee, "fldz" },
+	{ 0xd9, 0xf0, "f2xm1" }, { 0xd9, 0xf1, "fyl2x" }, { 0xd9, 0xf2, "fptan" },
+	{ 0xd9, 0xf3, "fpatan" }, { 0xd9, 0xf4, "fxtract" }, { 0xd9, 0xf5, "fprem1" },
+	{ 0xd9, 0xf6, "fdecstp" }, { 0xd9, 0xf7, "fincstp" }, { 0xd9, 0xf8, "fprem" },
+	{ 0xd9, 0xf9, "fyl2xp1" }, { 0xd9, 0xfa, "fsqrt" }, { 0xd9, 0xfb, "fsincos" },
+	{ 0xd9, 0xfc, "frndint" }, { 0xd9, 0xfd, "fscale" }, { 0xd9, 0xfe, "fsin" },
+	{ 0xd9, 0xff, "fcos" }, { 0xda, 0xe9, "fucompp" }, { 0xdb, 0xe2, "fnclex" },
+	{ 0xdb, 0xe3, "fninit" }, { 0xde, 0xd9, "fcompp" }, { 0xdf, 0xe0, "fnstsw ax" },
+};
+
+/// The instructions of group 7 (0F 01) with a register operand, by ModRM byte.
+static const struct { byte_t modrm; const char *name; } x86_grp7[] = {
+	{ 0xc1, "vmcall" }, { 0xc2, "vmlaunch" }, { 0xc3, "vmresume" }, { 0xc4, "vmxoff" },
+	{ 0xc8, "monitor" }, { 0xc9, "mwait" }, { 0xca, "clac" }, { 0xcb, "stac" },
+	{ 0xd0, "xgetbv" }, { 0xd1, "xsetbv" }, { 0xd5, "xend" }, { 0xd6, "xtest" },
+	{ 0xee, "rdpkru" }, { 0xef, "wrpkru" }, { 0xf8, "swapgs" }, { 0xf9, "rdtscp" },
+};
+
+enum X86Map {
+	XM_One, XM_0F, XM_0F38, XM_0F3A, XM_Max
+};
+
+static const char **x86_maps[XM_Max] = { x86_one, x86_0f, x86_0f38, x86_0f3a };
+
+/// How long an instruction's immediates are.
+enum X86Imm {
+	XI_None, XI_B, XI_W, XI_Z, XI_V, XI_D, XI_O, XI_WB
+};
+
+/// What an opcode's entry says about how long its instructions are, worked out
+/// by _x86_tables(). Groups have their own, for each reg field.
+struct X86Info {
+	byte_t valid : 1, modrm : 1, group : 6;
+	byte_t imm;
+};
+
+static struct X86Info x86_info[XM_Max][256];
+static struct X86Info x86_ginfo[ARRAY_LEN(x86_groups)][8];
+
+static enum X86Imm
+_x86_imm(const char *ops)
+{
+	if (ops == NULL)
+		return XI_None;
+	if (strstr(ops, "Iw,Ib"))
+		return XI_WB;
+
+	for (const char *s = ops; (s = strpbrk(s, "IJOF")) != NULL; ++s) {
+		if (s > ops && s[-1] != ',' && s[-1] != ' ')
+			continue;
+		switch (s[0] == 'O' ? 'o' : s[0] == 'F' ? 'b' : s[1]) {
+		break; case 'b': case 's':
+			return XI_B;
+		break; case 'w':
+			return XI_W;
+		break; case 'z':
+			return s[0] == 'J' ? XI_D : XI_Z;
+		break; case 'v':
+			return XI_V;
+		break; case 'o':
+			return XI_O;
+		}
+	}
+	return XI_None;
+}
+
+/// Whether the operands `ops' include one that's encoded in a ModRM byte.
+static _Bool
+_x86_has_modrm(const char *ops)
+{
+	for (const char *s = ops; s && *s; ++s)
+		if (strchr("EGMRSCDVWUPQNKA", *s) && (s == ops || s[-1] == ',' || s[-1] == ' '))
+			return true;
+	return false;
+}
+
+/// The operands of the entry `e', which are the first ones given in it (all of
+/// an entry's alternatives are encoded the same way).
+static const char *
+_x86_ops(const char *e)
+{
+	const char *sp = strchr(e, ' '), *bar = strchr(e, '|'), *caret = strchr(e, '^');
+	if (sp && (!bar || sp < bar) && (!caret || sp < caret))
+		return sp + 1;
+	return NULL;
+}
+
+static void
+_x86_tables(void)
+{
+	static _Bool done = false;
+	if (done)
+		return;
+	done = true;
+
+	for (size_t g = 1; g < ARRAY_LEN(x86_groups); ++g) {
+		for (size_t r = 0; r < 8; ++r) {
+			const char *e = x86_groups[g][r];
+			if (e == NULL || *e == '\0')
+				continue;
+			const char *ops = NULL;
+			for (const char *v = e; v && !ops; v = strpbrk(v, "|^"), v = v ? v + 1 : v)
+				ops = _x86_ops(v);
+			x86_ginfo[g][r] = (struct X86Info){ .valid = 1, .modrm = 1,
+				.imm = (byte_t)_x86_imm(ops) };
+		}
+	}
+
+	for (size_t m = 0; m < XM_Max; ++m) {
+		for (size_t op = 0; op < 256; ++op) {
+			const char *e = x86_maps[m][op];
+			struct X86Info *in = &x86_info[m][op];
+			if (e == NULL || *e == '\0')
+				continue;
+
+			in->valid = 1;
+			if (e[0] == '@') {
+				/* x87, and 0F 1E; 90 and 0F 77 have no operands. */
+				in->modrm = (m == XM_One && op >= 0xd8 && op <= 0xdf)
+					|| (m == XM_0F && op == 0x1e);
+			} else if (e[0] == '#') {
+				in->group = (byte_t)strtoul(&e[1], NULL, 10);
+				in->modrm = 1;
+				in->imm = (byte_t)_x86_imm(_x86_ops(e));
+			} else {
+				const char *ops = NULL;
+				for (const char *v = e; v && !ops; v = strpbrk(v, "|^"), v = v ? v + 1 : v)
+					ops = _x86_ops(v);
+				in->modrm = _x86_has_modrm(ops);
+				in->imm = (byte_t)_x86_imm(ops);
+			}
+		}
+	}
+}
+
+/// An instruction, as far as x86_parse() has taken it apart.
+struct X86 {
+	size_t len;
+	enum X86Map map;
+	byte_t op;
+
+	/// Prefixes: the last segment override, F2 or F3, and how many 66 there
+	/// were. `rex' is also filled in from VEX and EVEX prefixes.
+	byte_t seg, rep, lock, osz, asz, rex;
+
+	/// VEX and EVEX: the register in vvvv, VEX.L, and the implied prefix (0 for
+	/// none, 1 for 66, 2 for F3, 3 for F2).
+	_Bool vex, evex;
+	byte_t vvvv, vl, pp;
+
+	/// The ModRM byte, split up, with the REX bits added to `reg' and `rm'.
+	_Bool has_modrm;
+	byte_t mod, reg, rm;
+
+	/// The memory operand: -1 for no base or index register, -2 for rip. The
+	/// scale is 0 if there's no SIB byte.
+	int base, index, scale;
+	int64_t disp;
+
+	uint64_t imm, imm2;
+	byte_t imm_sz;
+
+	/// The opcode isn't in the tables, but the instruction's length is known.
+	_Bool unknown;
+
+	/// The REX prefix is followed by another prefix, so it's all there is.
+	_Bool rex_alone;
+};
+
+#define X86_MAX_LEN 15
+
+/// Take apart the instruction at `p', of which `avail' bytes can be looked at.
+/// Returns its length, or 0 if it goes on past `avail'. Instructions that aren't
+/// valid (or aren't known) are as long as their prefixes and opcode; `x->map' is
+/// then XM_Max.
+///
+static size_t
+x86_parse(const byte_t *p, size_t avail, struct X86 *x)
+{
+	size_t i = 0;
+	*x = (struct X86){ .base = -1, .index = -1 };
+
+#define X86_NEED(N) do { if (i + (N) > avail) return 0; } while (0)
+
+	for (;; ++i) {
+		X86_NEED(1);
+		if (i == X86_MAX_LEN - 1)
+			break;
+		switch (p[i]) {
+		break; case 0xf0: x->lock = 1;
+		break; case 0xf2: case 0xf3: x->rep = p[i];
+		break; case 0x2e: case 0x36: case 0x3e: case 0x26: case 0x64: case 0x65:
+			x->seg = p[i];
+		break; case 0x66: ++x->osz;
+		break; case 0x67: x->asz = 1;
+		break; default:
+			goto prefixes_done;
+		}
+	}
+prefixes_done:
+	if ((p[i] & 0xf0) == 0x40) {
+		x->rex = p[i++];
+		X86_NEED(1);
+		/* A REX prefix that isn't right before the opcode does nothing, and
+		 * is shown as an instruction of its own. */
+		if ((p[i] & 0xf0) == 0x40
+				|| (p[i] && strchr("\xf0\xf2\xf3\x2e\x36\x3e\x26\x64\x65\x66\x67", p[i]))) {
+			x->map = XM_Max;
+			x->rex_alone = true;
+			return x->len = i;
+		}
+	}
+
+	byte_t b = p[i++];
+	x->map = XM_One;
+	if (b == 0x0f) {
+		X86_NEED(1);
+		b = p[i++];
+		x->map = XM_0F;
+		if (b == 0x38 || b == 0x3a) {
+			X86_NEED(1);
+			x->map = b == 0x38 ? XM_0F38 : XM_0F3A;
+			b = p[i++];
+		}
+	} else if ((b == 0xc4 || b == 0xc5) && !x->rex) {
+		X86_NEED(b == 0xc4 ? 3 : 2);
+		byte_t v1 = p[i++], v2 = b == 0xc4 ? p[i++] : 0;
+		x->vex = true;
+		if (b == 0xc5) {
+			x->rex = 0x40 | (~v1 >> 5 & 4);
+			v2 = v1;
+			x->map = XM_0F;
+		} else {
+			x->rex = 0x40 | (~v1 >> 5 & 7) | (v2 >> 4 & 8);
+			x->map = (enum X86Map)(v1 & 0x1f);
+			if (x->map < XM_0F || x->map > XM_0F3A) {
+				x->map = XM_Max;
+				return x->len = 1;
+			}
+		}
+		x->vvvv = ~v2 >> 3 & 0xf;
+		x->vl = v2 >> 2 & 1;
+		x->pp = v2 & 3;
+		b = p[i++];
+	} else if (b == 0x62) {
+		X86_NEED(4);
+		byte_t p0 = p[i], p1 = p[i + 1], p2 = p[i + 2];
+		i += 3;
+		x->evex = true;
+		x->rex = 0x40 | (~p0 >> 5 & 7) | (p1 >> 4 & 8);
+		x->map = (enum X86Map)(p0 & 3);
+		if (x->map == XM_One || p0 & 0x0c || !(p1 & 4)) {
+			x->map = XM_Max;
+			return x->len = 1;
+		}
+		x->vvvv = (~p1 >> 3 & 0xf) | (~p2 << 1 & 0x10);
+		x->vl = p2 >> 5 & 3;
+		x->pp = p1 & 3;
+		b = p[i++];
+	}
+	x->op = b;
+
+	struct X86Info in = x->map < XM_Max ? x86_info[x->map][b] : (struct X86Info){0};
+	if (!in.valid && x->map < XM_Max && (x->map >= XM_0F38 || x->vex || x->evex)) {
+		/* Everything in these maps has a ModRM byte (and the ones in 0F3A an
+		 * immediate byte), so even the ones that aren't known can be skipped. */
+		in = (struct X86Info){ .valid = 1, .modrm = 1,
+			.imm = x->map == XM_0F3A ? XI_B : XI_None };
+		x->unknown = true;
+	}
+	if (!in.valid) {
+		x->map = XM_Max;
+		return x->len = i;
+	}
+
+	if (in.modrm) {
+		X86_NEED(1);
+		byte_t m = p[i++];
+		x->has_modrm = true;
+		x->mod = m >> 6;
+		x->reg = (m >> 3 & 7) | (x->rex & 4) << 1;
+		x->rm = m & 7;
+
+		if (x->mod != 3) {
+			size_t disp = x->mod == 1 ? 1 : x->mod == 2 ? 4 : 0;
+			if (x->rm == 4) {
+				X86_NEED(1);
+				byte_t sib = p[i++];
+				x->scale = 1 << (sib >> 6);
+				x->index = (sib >> 3 & 7) | (x->rex & 2) << 2;
+				if (x->index == 4)
+					x->index = -1;
+				x->base = (sib & 7) | (x->rex & 1) << 3;
+				if ((sib & 7) == 5 && x->mod == 0)
+					x->base = -1, disp = 4;
+			} else if (x->rm == 5 && x->mod == 0) {
+				x->base = -2, disp = 4;
+			} else {
+				x->base = x->rm | (x->rex & 1) << 3;
+			}
+
+			X86_NEED(disp);
+			for (size_t k = disp; k > 0; --k)
+				x->disp = x->disp << 8 | p[i + k - 1];
+			if (disp == 1)
+				x->disp = (int8_t)x->disp;
+			else if (disp == 4)
+				x->disp = (int32_t)x->disp;
+			i += disp;
+		}
+		x->rm |= (x->rex & 1) << 3;
+
+		if (in.group) {
+			struct X86Info g = x86_ginfo[in.group][x->reg & 7];
+			if (!g.valid) {
+				x->map = XM_Max;
+				return x->len = i;
+			}
+			if (g.imm)
+				in.imm = g.imm;
+		}
+	}
+
+	size_t w = x->rex & 8 ? 8 : x->osz ? 2 : 4, imm = 0, imm2 = 0;
+	switch ((enum X86Imm)in.imm) {
+	break; case XI_None:
+	break; case XI_B: imm = 1;
+	break; case XI_W: imm = 2;
+	break; case XI_Z: imm = w == 2 ? 2 : 4;
+	break; case XI_V: imm = w;
+	break; case XI_D: imm = 4;
+	break; case XI_O: imm = x->asz ? 4 : 8;
+	break; case XI_WB: imm = 2, imm2 = 1;
+	}
+	X86_NEED(imm + imm2);
+	for (size_t k = imm; k > 0; --k)
+		x->imm = x->imm << 8 | p[i + k - 1];
+	x->imm_sz = (byte_t)imm;
+	i += imm;
+	if (imm2)
+		x->imm2 = p[i++];
+
+#undef X86_NEED
+
+	if (i > X86_MAX_LEN) {
+		x->map = XM_Max;
+		i = 1;
+	}
+	return x->len = i;
+}
+
+static const char x86_gprs[4][16][5] = {
+	{ "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+	  "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+	{ "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+	  "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+	{ "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+	  "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+	{ "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+	  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+static const char *
+_x86_gpr(const struct X86 *x, unsigned n, unsigned bits)
+{
+	static const char high8[4][3] = { "ah", "ch", "dh", "bh" };
+	if (bits == 8 && !x->rex && n >= 4 && n < 8)
+		return high8[n - 4];
+	return x86_gprs[bits == 8 ? 0 : bits == 16 ? 1 : bits == 32 ? 2 : 3][n & 15];
+}
+
+/// How many bits the operand size letter `c' stands for.
+static unsigned
+_x86_bits(const struct X86 *x, char c)
+{
+	_Bool w = x->rex & 8;
+	switch (c) {
+	break; case 'b': return 8;
+	break; case 'w': return 16;
+	break; case 'd': return 32;
+	break; case 'q': return 64;
+	break; case 't': return 80;
+	break; case 'v': return w ? 64 : x->osz ? 16 : 32;
+	break; case 'z': return x->osz && !w ? 16 : 32;
+	break; case 'y': return w ? 64 : 32;
+	break; case 'f': return x->osz ? 16 : 64;
+	break; case 'x': return x->vl ? 256 : 128;
+	break; case 'p': return w ? 80 : 48;
+	break; case 'k': return x->pp == 1 ? (w ? 32 : 8) : x->pp == 3 ? (w ? 64 : 32) : (w ? 64 : 16);
+	}
+	return 0;
+}
+
+/// Print a memory operand of `bits' bits, with the segment `seg' unless it's
+/// overridden by fs or gs (only those have a base other than zero).
+///
+static void
+_x86_mem(const struct X86 *x, unsigned bits, const char *seg, struct DisText *t)
+{
+	static const struct { unsigned bits; const char *name; } ptrs[] = {
+		{ 8, "BYTE" }, { 16, "WORD" }, { 32, "DWORD" }, { 48, "FWORD" },
+		{ 64, "QWORD" }, { 80, "TBYTE" }, { 128, "XMMWORD" }, { 256, "YMMWORD" },
+	};
+	for (size_t i = 0; i < ARRAY_LEN(ptrs); ++i) {
+		if (ptrs[i].bits == bits) {
+			_dis_put(t, "%s", ptrs[i].name);
+			_dis_put(t, " PTR ");
+		}
+	}
+
+	if (x->seg == 0x64 || x->seg == 0x65)
+		seg = x->seg == 0x64 ? "fs:" : "gs:";
+	unsigned abits = x->asz ? 32 : 64;
+
+	if (x->base == -1 && x->index == -1) {
+		uint64_t a = (uint64_t)x->disp;
+		_dis_hex(t, seg ? seg : "ds:", x->asz ? a & 0xffffffff : a);
+		return;
+	}
+
+	_dis_put(t, "%s[", seg ? seg : "");
+	if (x->base == -2)
+		_dis_put(t, x->asz ? "eip" : "rip");
+	else if (x->base >= 0)
+		_dis_put(t, "%s", _x86_gpr(x, (unsigned)x->base, abits));
+
+	if (x->index >= 0 || (x->scale && x->base >= 0 && (x->base & 7) != 4))
+		_dis_put(t, "%s%s*%d", x->base == -1 ? "" : "+",
+			x->index >= 0 ? _x86_gpr(x, (unsigned)x->index, abits)
+			: x->asz ? "eiz" : "riz", x->scale);
+
+	/* Like objdump, rip-relative offsets are shown as unsigned. */
+	if (x->base == -2)
+		_dis_hex(t, "+", x->asz ? (uint32_t)x->disp : (uint64_t)x->disp);
+	else if (x->mod != 0 || x->base < 0)
+		_dis_hex(t, x->disp < 0 ? "-" : "+",
+			x->disp < 0 ? -(uint64_t)x->disp : (uint64_t)x->disp);
+	_dis_put(t, "]");
+}
+
+/// A register, in the register file that the addressing method `m' picks.
+static void
+_x86_reg(const struct X86 *x, char m, unsigned n, unsigned bits, struct DisText *t)
+{
+	static const char segs[8][3] = { "es", "cs", "ss", "ds", "fs", "gs", "?", "?" };
+	switch (m) {
+	break; case 'V': case 'W': case 'U': case 'H':
+		_dis_put(t, "%cmm%u", bits == 256 ? 'y' : 'x', n);
+	break; case 'P': case 'Q': case 'N':
+		_dis_put(t, "mm%u", n & 7);
+	break; case 'K': case 'A': case 'L':
+		_dis_put(t, "k%u", n & 7);
+	break; case 'S':
+		_dis_put(t, "%s", segs[n & 7]);
+	break; case 'C':
+		_dis_put(t, "cr%u", n);
+	break; case 'D':
+		_dis_put(t, "db%u", n);
+	break; default:
+		_dis_put(t, "%s", _x86_gpr(x, n, bits));
+	}
+}
+
+static uint64_t
+_x86_sext(uint64_t v, unsigned bits)
+{
+	return bits >= 64 ? v : (v ^ (1ULL << (bits - 1))) - (1ULL << (bits - 1));
+}
+
+static uint64_t
+_x86_trunc(uint64_t v, unsigned bits)
+{
+	return bits >= 64 ? v : v & ((1ULL << bits) - 1);
+}
+
+/// Print the operand `op' (which is `n' characters long). `bits' is the size of
+/// the ones before it, for the immediates that are as wide as they are.
+///
+static void
+_x86_operand(const struct X86 *x, uint64_t addr, const char *op, size_t n,
+	unsigned *bits, int *imms, struct DisText *t)
+{
+	char m = op[0];
+	unsigned sz = n > 1 ? _x86_bits(x, op[1]) : 0;
+
+	if (n == 3 && (!memcmp(op, "rAX", 3) || !memcmp(op, "eAX", 3))) {
+		sz = _x86_bits(x, op[0] == 'r' ? 'v' : 'z');
+		_dis_put(t, "%s", _x86_gpr(x, 0, sz));
+		*bits = *bits ? *bits : sz;
+		return;
+	}
+	if (islower(m)) {
+		if (n == 5 && !memcmp(op, "st(i)", 5))
+			_dis_put(t, "st(%d)", x->rm & 7);
+		else
+			_dis_put(t, "%.*s", (int)n, op);
+		return;
+	}
+
+	switch (m) {
+	break; case 'E': case 'W': case 'Q': case 'A':
+		if (x->mod == 3)
+			_x86_reg(x, m, x->rm, sz, t);
+		else
+			_x86_mem(x, sz, NULL, t);
+	break; case 'M':
+		_x86_mem(x, sz, NULL, t);
+	break; case 'G': case 'V': case 'P': case 'S': case 'C': case 'D': case 'K':
+		_x86_reg(x, m, x->reg, sz, t);
+	break; case 'R': case 'U': case 'N':
+		_x86_reg(x, m, x->rm, sz, t);
+	break; case 'H': case 'B': case 'L':
+		_x86_reg(x, m == 'B' ? 'G' : m, x->vvvv & 15, sz, t);
+	break; case 'Z':
+		_x86_reg(x, 'G', (x->op & 7) | (x->rex & 1) << 3, sz, t);
+	break; case 'I': {
+		uint64_t v = (*imms)++ ? x->imm2 : x->imm;
+		unsigned to = *bits ? *bits : _x86_bits(x, 'f');
+		if (op[1] == 's')
+			v = _x86_trunc(_x86_sext(v, 8), to);
+		else if (op[1] == 'z')
+			v = _x86_trunc(_x86_sext(v, x->imm_sz * 8), to);
+		_dis_hex(t, "", v);
+		sz = 0;
+	}
+	break; case 'J':
+		_dis_hex(t, "", addr + x->len + _x86_sext(x->imm, x->imm_sz * 8));
+	break; case 'O':
+		_dis_hex(t, x->seg == 0x64 ? "fs:" : x->seg == 0x65 ? "gs:" : "ds:", x->imm);
+	break; case 'F':
+		_x86_reg(x, 'V', (unsigned)(x->imm >> 4), sz, t);
+		++*imms;
+	break; case 'X': case 'Y': case 'T': {
+		/* The string instructions read from ds:[rsi] (which can be
+		 * overridden) and write to es:[rdi] (which can't). */
+		struct X86 s = *x;
+		s.base = m == 'X' ? 6 : m == 'T' ? 3 : 7, s.index = -1, s.scale = 0, s.mod = 0;
+		if (m == 'Y')
+			s.seg = 0;
+		_x86_mem(&s, sz, m == 'Y' ? "es:" : "ds:", t);
+	}
+	break; default:
+		_dis_put(t, "%.*s", (int)n, op);
+	}
+	if (!*bits && sz)
+		*bits = sz;
+}
+
+/// Print a REX prefix that isn't all used, like objdump does: "rex.WB".
+static void
+_x86_rex(byte_t rex, struct DisText *t)
+{
+	_dis_put(t, "rex%s%s%s%s%s", rex & 0xf ? "." : "", rex & 8 ? "W" : "",
+		rex & 4 ? "R" : "", rex & 2 ? "X" : "", rex & 1 ? "B" : "");
+}
+
+/// The alternative in the entry `e' that the instruction's prefixes and ModRM
+/// byte pick; it ends at `*end'. `*used' is set to the prefix that picked it, if
+/// any, which isn't printed then.
+///
+static const char *
+_x86_pick(const struct X86 *x, const char *e, const char **end, byte_t *used)
+{
+	const char *tilde = strchr(e, '~');
+	if (tilde && (x->vex || x->evex))
+		e = tilde + 1;
+
+	const char *v[4] = { e, "", "", "" };
+	size_t n = 1, k = 0;
+	for (const char *s = e; n < 4 && (s = strpbrk(s, "|~")) != NULL && *s == '|'; ++s)
+		v[n++] = s + 1;
+
+#define X86_HAS(K) ((K) < n && v[K][0] != '|' && v[K][0] != '\0')
+	if (n == 1)
+		k = 0;
+	else if (x->vex || x->evex)
+		k = x->pp;
+	else if (x->rep == 0xf3 && X86_HAS(2))
+		k = 2, *used = 0xf3;
+	else if (x->rep == 0xf2 && X86_HAS(3))
+		k = 3, *used = 0xf2;
+	else if (x->osz && X86_HAS(1))
+		k = 1, *used = 0x66;
+#undef X86_HAS
+
+	const char *s = v[k];
+	*end = s + strcspn(s, "|~");
+	const char *caret = memchr(s, '^', (size_t)(*end - s));
+	if (caret && x->mod == 3)
+		s = caret + 1;
+	else if (caret)
+		*end = caret;
+	return s;
+}
+
+/// The entries marked with `@', as an entry of their own (or NULL for one that
+/// isn't valid).
+///
+static const char *
+_x86_special(const struct X86 *x, byte_t *used)
+{
+	byte_t modrm = (byte_t)(x->mod << 6 | (x->reg & 7) << 3 | (x->rm & 7));
+
+	if (x->map == XM_One && x->op == 0x90) {
+		if (x->rep == 0xf3)
+			return *used = 0xf3, "pause";
+		return x->rex & 1 || x->osz ? "xchg Zv,rAX" : "nop";
+	}
+	if (x->map == XM_One) {
+		size_t esc = x->op - 0xd8u;
+		if (x->mod != 3)
+			return x86_x87_mem[esc][x->reg & 7];
+		for (size_t i = 0; i < ARRAY_LEN(x86_x87_one); ++i)
+			if (x86_x87_one[i].op == x->op && x86_x87_one[i].modrm == modrm)
+				return x86_x87_one[i].name;
+		return x86_x87_reg[esc][x->reg & 7];
+	}
+	if (x->op == 0x1e) {
+		if (x->rep == 0xf3 && (modrm == 0xfa || modrm == 0xfb))
+			return *used = 0xf3, modrm == 0xfa ? "endbr64" : "endbr32";
+		return "nop Ev";
+	}
+	if (x->op == 0x77)
+		return !x->vex ? "emms" : x->vl ? "vzeroall" : "vzeroupper";
+
+	for (size_t i = 0; i < ARRAY_LEN(x86_grp7); ++i)
+		if (x86_grp7[i].modrm == modrm)
+			return x86_grp7[i].name;
+	return NULL;
+}
+
+/// Whether the instruction is a string instruction, which a rep prefix repeats
+/// (and which of them compare).
+static int
+_x86_string_op(const struct X86 *x)
+{
+	if (x->map != XM_One || x->vex || x->evex)
+		return 0;
+	switch (x->op) {
+	break; case 0x6c: case 0x6d: case 0x6e: case 0x6f: case 0xa4: case 0xa5:
+	       case 0xaa: case 0xab: case 0xac: case 0xad:
+		return 1;
+	break; case 0xa6: case 0xa7: case 0xae: case 0xaf:
+		return 2;
+	}
+	return 0;
+}
+
+static _Bool
+_x86_branch(const struct X86 *x)
+{
+	if (x->map == XM_0F)
+		return x->op >= 0x80 && x->op < 0x90;
+	return x->map == XM_One && ((x->op >= 0x70 && x->op < 0x80) || x->op == 0xc2
+		|| x->op == 0xc3 || x->op == 0xe8 || x->op == 0xe9 || x->op == 0xeb
+		|| (x->op == 0xff && (x->reg & 7) >= 2 && (x->reg & 7) <= 5));
+}
+
+/// Print the instruction that x86_parse() took apart, which is at `addr'.
+///
+static void
+x86_format(const struct X86 *x, uint64_t addr, struct DisText *t)
+{
+	char spec[96];
+	byte_t used = 0;
+
+	if (x->rex_alone) {
+		_x86_rex(x->rex, t);
+		return;
+	}
+	if (x->map == XM_Max) {
+		_dis_put(t, "(bad)");
+		return;
+	}
+
+	const char *e = x86_maps[x->map][x->op], *end, *v = NULL;
+	if (x->unknown)
+		e = "";
+	size_t group = x86_info[x->map][x->op].group;
+	if (group && x86_groups[group][x->reg & 7]) {
+		v = _x86_pick(x, x86_groups[group][x->reg & 7], &end, &used);
+		const char *ops = _x86_ops(e);
+		if (v < end && !memchr(v, ' ', (size_t)(end - v)) && v[0] != '@' && ops)
+			snprintf(spec, sizeof(spec), "%.*s %s", (int)(end - v), v, ops);
+		else
+			snprintf(spec, sizeof(spec), "%.*s", (int)(end - v), v);
+	} else if (!group) {
+		v = _x86_pick(x, e, &end, &used);
+		size_t n = MIN((size_t)(end - v), sizeof(spec) - 1);
+		memcpy(spec, v, n);
+		spec[n] = '\0';
+	}
+
+	if (v == NULL)
+		spec[0] = '\0';
+	_Bool special = spec[0] == '@';
+	if (special) {
+		const char *sp = _x86_special(x, &used);
+		snprintf(spec, sizeof(spec), "%s", sp ? sp : "");
+	}
+	if (x->unknown || (x->evex && spec[0] == '\0')) {
+		_dis_put(t, "%s(unknown)", x->evex ? "{evex} " : "");
+		return;
+	}
+	if (spec[0] == '\0') {
+		_dis_put(t, "(bad)");
+		return;
+	}
+
+	/* Split it into the mnemonic and the operands. */
+	_Bool vex_only = spec[0] == '!';
+	char *mnem = &spec[vex_only], *ops = strchr(mnem, ' ');
+	if (ops)
+		*ops++ = '\0';
+
+	_Bool xmm = false;
+	for (const char *o = ops; o && *o; o = strchr(o, ','), o = o ? o + 1 : o)
+		xmm |= strchr("VWUH", *o) != NULL;
+	if (!special && ((x->vex || x->evex) ? !xmm && !vex_only : vex_only)) {
+		_dis_put(t, "(bad)");
+		return;
+	}
+
+	/* The prefixes that aren't part of the instruction (or its operands). */
+	if (x->lock)
+		_dis_put(t, "lock ");
+	if (x->rep && x->rep != used) {
+		int str = _x86_string_op(x);
+		if (x->rep == 0xf3)
+			_dis_put(t, str == 1 ? "rep " : "repz ");
+		else
+			_dis_put(t, !str && _x86_branch(x) ? "bnd " : "repnz ");
+	}
+	/* And the ones that don't change anything: a 66 or REX.W where the operand
+	 * size doesn't matter, or a 67 without a memory operand. */
+	_Bool sized = strchr(mnem, '/') != NULL, mem = x->has_modrm && x->mod != 3;
+	for (const char *o = ops; o && *o; o = strchr(o, ','), o = o ? o + 1 : o)
+		sized |= (*o != 'I' && *o != 'J' && o[1] && strchr("vyzpk", o[1]))
+			|| !strncmp(o, "rAX", 3) || !strncmp(o, "eAX", 3);
+	_Bool bytes = false;
+	for (const char *o = ops; o && *o; o = strchr(o, ','), o = o ? o + 1 : o)
+		bytes |= strchr("EGRZ", *o) && o[1] == 'b';
+	for (size_t i = used == 0x66 || (sized && !(x->rex & 8)); i < x->osz; ++i)
+		_dis_put(t, "data16 ");
+	if (x->asz && !mem && !_x86_string_op(x) && !(ops && strpbrk(ops, "OJT")))
+		_dis_put(t, "addr32 ");
+	if (!x->vex && !x->evex && ((x->rex & 8 && !sized) || (x->rex == 0x40 && !bytes)
+			|| (x->rex & 4 && !x->has_modrm)
+			|| (x->rex & 2 && !x->scale)
+			|| (x->rex & 1 && !x->has_modrm && !(ops && strchr(ops, 'Z'))))) {
+		_x86_rex(x->rex, t);
+		_dis_put(t, " ");
+	}
+	if (x->seg == 0x3e && x->map == XM_One && x->op == 0xff && _x86_branch(x))
+		_dis_put(t, "notrack ");
+	else if (x->seg && (!mem || (x->seg != 0x64 && x->seg != 0x65)) && !_x86_string_op(x)
+			&& !(ops && strchr(ops, 'O')))
+		_dis_put(t, "%s ", x->seg == 0x2e ? "cs" : x->seg == 0x36 ? "ss"
+			: x->seg == 0x3e ? "ds" : x->seg == 0x26 ? "es"
+			: x->seg == 0x64 ? "fs" : "gs");
+	if (x->evex)
+		_dis_put(t, "{evex} ");
+
+	/* The mnemonic: "a/b/c" by the operand size, "a/b" by REX.W. */
+	size_t slashes = 0, pick = 0;
+	for (const char *c = mnem; (c = strchr(c, '/')) != NULL; ++c)
+		++slashes;
+	if (slashes == 2)
+		pick = x->rex & 8 ? 2 : x->osz ? 0 : 1;
+	else if (slashes == 1)
+		pick = x->rex & 8 ? 1 : 0;
+	for (; pick > 0; --pick)
+		mnem = strchr(mnem, '/') + 1;
+	size_t mlen = strcspn(mnem, "/");
+
+	if (mlen == 3 && !memcmp(mnem, "mov", 3) && x->imm_sz == 8)
+		mnem = "movabs", mlen = 6;
+
+	/* Comparisons are named after their predicate, which is left out. */
+	static const char preds[32][9] = {
+		"eq", "lt", "le", "unord", "neq", "nlt", "nle", "ord",
+		"eq_uq", "nge", "ngt", "false", "neq_oq", "ge", "gt", "true",
+		"eq_os", "lt_oq", "le_oq", "unord_s", "neq_us", "nlt_uq", "nle_uq", "ord_s",
+		"eq_us", "nge_uq", "ngt_uq", "false_os", "neq_os", "ge_oq", "gt_oq", "true_us",
+	};
+	_Bool pred = x->map == XM_0F && x->op == 0xc2 && x->imm < (x->vex ? 32u : 8u);
+	if (pred) {
+		_dis_put(t, "%scmp%s%.*s", x->vex ? "v" : "", preds[x->imm], (int)mlen - 3, mnem + 3);
+		mlen = 0;
+	}
+	if (mlen && (x->vex || x->evex) && xmm)
+		_dis_put(t, "v");
+	if (mlen)
+		_dis_put(t, "%.*s", (int)mlen, mnem);
+	if (x->evex || !ops)
+		return;
+
+	/* VEX movss and movsd only merge with vvvv between registers. */
+	_Bool no_h = x->map == XM_0F && (x->op == 0x10 || x->op == 0x11) && x->pp >= 2
+		&& x->mod != 3;
+
+	unsigned bits = 0;
+	int imms = 0;
+	char sep = ' ';
+	for (const char *o = ops; *o; ) {
+		size_t n = strcspn(o, ",");
+		if (!((o[0] == 'H' || o[0] == 'B') && (!x->vex || no_h)) && !(pred && o[0] == 'I')) {
+			_dis_put(t, sep == ' ' ? " " : ",");
+			_x86_operand(x, addr, o, n, &bits, &imms, t);
+			sep = ',';
+		}
+		o += n + (o[n] == ',');
+	}
+}
+
+/// ---
+///
+/// AArch64.
+///
+/// An entry's format is printed as-is, other than these, which print a field
+/// of the instruction (its bits [hi:lo]):
+///
+///   %<class><field>  a register: the class is r (x or w by bit 31, xzr for 31),
+///                    R (the same, but sp for 31), x, X, w, W (always x or w,
+///                    with sp for X and W), z (x or w by bit 30), b, h, s, d, q
+///                    (SIMD and FP registers), or f (s, d, or h by bits [23:22]);
+///                    the field is d [4:0], n [9:5], m [20:16], or a [14:10]
+///   %i   an add or sub immediate, [21:10], shifted by 12 if bit 22 is set
+///   %l   a bitmask immediate, N [22], immr [21:16], imms [15:10]
+///   %Z, %N, %k  the immediate of movz, movn, and movk, [20:5] shifted by [22:21]
+///   %jNN a branch target: the NN-bit offset in words at [25:0], [23:5], or [18:5]
+///   %a, %A  the target of adr and adrp
+///   %c, %C  a condition, [15:12] or [3:0]
+///   %o   a shift of a register: the type [23:22] and amount [15:10]
+///   %O   the same, for add and sub (which can't rotate)
+///   %e   the register [20:16] of an extended register operand, and its extension
+///   %UN  an address: the base register, and the unsigned offset [21:10] scaled
+///        by N bits
+///   %9   an address with the signed offset [20:12], either unscaled or pre- or
+///        post-indexed, by [11:10]
+///   %7N  an address with the signed offset [21:15] scaled by N bits, either
+///        post-indexed, signed, or pre-indexed, by [24:23]
+///   %XN  an address with a register offset [20:16], extended by [15:13] and
+///        scaled by N bits if bit 12 is set
+///   %L   the target of a literal load, [23:5]
+///   %b   the bit number of tbz and tbnz: [31] and [23:19]
+///   %uHHLL, %hHHLL  the field [HH:LL], in decimal or in hex
+///   %S   a system register, [20:5]
+///   %D   a barrier option, [11:8]
+///   %p   a prefetch operation, [4:0]
+///   %8   the floating point immediate of fmov, [20:13]
+///
+/// Entries that start with `@' are printed by _a64_special(), and ones with no
+/// format at all aren't valid.
+///
+
+struct A64Op {
+	uint32_t mask, value;
+	const char *fmt;
+};
+
+/// A load or store of one register, named OP (or UOP, unscaled), with an
+/// unsigned offset, a signed one, or a register one.
+#define A64_LS(V, OP, UOP, R, N) \
+	{ 0xffc00000, V | 0x01000000, OP " %" R "d, %U" #N }, \
+	{ 0xffe00c00, V, UOP " %" R "d, %9" }, \
+	{ 0xffe00400, V | 0x400, OP " %" R "d, %9" }, \
+	{ 0xffe00c00, V | 0x00200800, OP " %" R "d, %X" #N }
+
+/// A load or store of a pair of registers, named NPOP without an index.
+#define A64_PAIR(V, OP, NPOP, R, N) \
+	{ 0xffc00000, V, NPOP " %" R "d, %" R "a, %7" #N }, \
+	{ 0xfe400000, V, OP " %" R "d, %" R "a, %7" #N }
+
+static const struct A64Op a64_ops[] = {
+	/* Branches, exceptions, and system instructions. */
+	{ 0xfc000000, 0x14000000, "b %j26" },
+	{ 0xfc000000, 0x94000000, "bl %j26" },
+	{ 0xff000010, 0x54000000, "b.%C %j19" },
+	{ 0x7f000000, 0x34000000, "cbz %rd, %j19" },
+	{ 0x7f000000, 0x35000000, "cbnz %rd, %j19" },
+	{ 0x7f000000, 0x36000000, "tbz %rd, %b, %j14" },
+	{ 0x7f000000, 0x37000000, "tbnz %rd, %b, %j14" },
+	{ 0xfffffc1f, 0xd61f0000, "br %xn" },
+	{ 0xfffffc1f, 0xd63f0000, "blr %xn" },
+	{ 0xffffffff, 0xd65f03c0, "ret" },
+	{ 0xfffffc1f, 0xd65f0000, "ret %xn" },
+	{ 0xffe0001f, 0xd4000001, "svc %h2005" },
+	{ 0xffe0001f, 0xd4000002, "hvc %h2005" },
+	{ 0xffe0001f, 0xd4000003, "smc %h2005" },
+	{ 0xffe0001f, 0xd4200000, "brk %h2005" },
+	{ 0xffe0001f, 0xd4400000, "hlt %h2005" },
+	{ 0xffffffff, 0xd503201f, "nop" },
+	{ 0xffffffff, 0xd503203f, "yield" },
+	{ 0xffffffff, 0xd503205f, "wfe" },
+	{ 0xffffffff, 0xd503207f, "wfi" },
+	{ 0xffffffff, 0xd503209f, "sev" },
+	{ 0xffffffff, 0xd50320bf, "sevl" },
+	{ 0xffffffff, 0xd50320ff, "xpaclri" },
+	{ 0xffffffff, 0xd503233f, "paciasp" },
+	{ 0xffffffff, 0xd503237f, "pacibsp" },
+	{ 0xffffffff, 0xd50323bf, "autiasp" },
+	{ 0xffffffff, 0xd50323ff, "autibsp" },
+	{ 0xffffffff, 0xd503241f, "bti" },
+	{ 0xffffffff, 0xd503245f, "bti c" },
+	{ 0xffffffff, 0xd503249f, "bti j" },
+	{ 0xffffffff, 0xd50324df, "bti jc" },
+	{ 0xffffffff, 0xd50320df, "dgh" },
+	{ 0xfffff01f, 0xd503201f, "hint %u1105" },
+	{ 0xffffffff, 0xd5033f5f, "clrex" },
+	{ 0xfffff0ff, 0xd503305f, "clrex %u1108" },
+	{ 0xffffffff, 0xd503309f, "ssbb" },
+	{ 0xffffffff, 0xd503349f, "pssbb" },
+	{ 0xfffff0ff, 0xd503309f, "dsb %D" },
+	{ 0xfffff0ff, 0xd50330bf, "dmb %D" },
+	{ 0xffffffff, 0xd5033fdf, "isb" },
+	{ 0xfffff0ff, 0xd50330df, "isb %u1108" },
+	{ 0xfff00000, 0xd5300000, "mrs %xd, %S" },
+	{ 0xfff00000, 0xd5100000, "msr %S, %xd" },
+
+	/* Data processing with an immediate. */
+	{ 0x9f000000, 0x10000000, "adr %xd, %a" },
+	{ 0x9f000000, 0x90000000, "adrp %xd, %A" },
+	{ 0x7ffffc00, 0x11000000, "@mov" },
+	{ 0x7f80001f, 0x3100001f, "cmn %Rn, %i" },
+	{ 0x7f80001f, 0x7100001f, "cmp %Rn, %i" },
+	{ 0x7f800000, 0x11000000, "add %Rd, %Rn, %i" },
+	{ 0x7f800000, 0x31000000, "adds %rd, %Rn, %i" },
+	{ 0x7f800000, 0x51000000, "sub %Rd, %Rn, %i" },
+	{ 0x7f800000, 0x71000000, "subs %rd, %Rn, %i" },
+	{ 0x7f80001f, 0x7200001f, "tst %rn, %l" },
+	{ 0x7f800000, 0x12000000, "and %Rd, %rn, %l" },
+	{ 0x7f800000, 0x32000000, "@orr" },
+	{ 0x7f800000, 0x52000000, "eor %Rd, %rn, %l" },
+	{ 0x7f800000, 0x72000000, "ands %rd, %rn, %l" },
+	{ 0x7f800000, 0x12800000, "@movn" },
+	{ 0x7f800000, 0x52800000, "@movz" },
+	{ 0x7f800000, 0x72800000, "movk %rd, %k" },
+	{ 0x7f800000, 0x13000000, "@sbfm" },
+	{ 0x7f800000, 0x33000000, "@bfm" },
+	{ 0x7f800000, 0x53000000, "@ubfm" },
+	{ 0x7fa00000, 0x13800000, "@extr" },
+
+	/* Data processing with registers. */
+	{ 0x7fe0ffe0, 0x2a0003e0, "mov %rd, %rm" },
+	{ 0x7f2003e0, 0x2a2003e0, "mvn %rd, %rm%o" },
+	{ 0x7f20001f, 0x6a00001f, "tst %rn, %rm%o" },
+	{ 0x7f200000, 0x0a000000, "and %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x0a200000, "bic %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x2a000000, "orr %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x2a200000, "orn %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x4a000000, "eor %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x4a200000, "eon %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x6a000000, "ands %rd, %rn, %rm%o" },
+	{ 0x7f200000, 0x6a200000, "bics %rd, %rn, %rm%o" },
+	{ 0x7f20001f, 0x2b00001f, "cmn %rn, %rm%O" },
+	{ 0x7f20001f, 0x6b00001f, "cmp %rn, %rm%O" },
+	{ 0x7f2003e0, 0x4b0003e0, "neg %rd, %rm%O" },
+	{ 0x7f2003e0, 0x6b0003e0, "negs %rd, %rm%O" },
+	{ 0x7f200000, 0x0b000000, "add %rd, %rn, %rm%O" },
+	{ 0x7f200000, 0x2b000000, "adds %rd, %rn, %rm%O" },
+	{ 0x7f200000, 0x4b000000, "sub %rd, %rn, %rm%O" },
+	{ 0x7f200000, 0x6b000000, "subs %rd, %rn, %rm%O" },
+	{ 0x7fe0001f, 0x2b20001f, "cmn %Rn, %e" },
+	{ 0x7fe0001f, 0x6b20001f, "cmp %Rn, %e" },
+	{ 0x7fe00000, 0x0b200000, "add %Rd, %Rn, %e" },
+	{ 0x7fe00000, 0x2b200000, "adds %rd, %Rn, %e" },
+	{ 0x7fe00000, 0x4b200000, "sub %Rd, %Rn, %e" },
+	{ 0x7fe00000, 0x6b200000, "subs %rd, %Rn, %e" },
+	{ 0x7fe0fc00, 0x1a000000, "adc %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x3a000000, "adcs %rd, %rn, %rm" },
+	{ 0x7fe0ffe0, 0x5a0003e0, "ngc %rd, %rm" },
+	{ 0x7fe0ffe0, 0x7a0003e0, "ngcs %rd, %rm" },
+	{ 0x7fe0fc00, 0x5a000000, "sbc %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x7a000000, "sbcs %rd, %rn, %rm" },
+	{ 0x7fe00c10, 0x3a400000, "ccmn %rn, %rm, %u0300, %c" },
+	{ 0x7fe00c10, 0x3a400800, "ccmn %rn, %u2016, %u0300, %c" },
+	{ 0x7fe00c10, 0x7a400000, "ccmp %rn, %rm, %u0300, %c" },
+	{ 0x7fe00c10, 0x7a400800, "ccmp %rn, %u2016, %u0300, %c" },
+	{ 0x7fe00800, 0x1a800000, "@csel" },
+	{ 0x7fe00800, 0x5a800000, "@csel" },
+	{ 0x7fe0fc00, 0x1ac00800, "udiv %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x1ac00c00, "sdiv %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x1ac02000, "lsl %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x1ac02400, "lsr %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x1ac02800, "asr %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x1ac02c00, "ror %rd, %rn, %rm" },
+	{ 0x7ffffc00, 0x5ac00000, "rbit %rd, %rn" },
+	{ 0x7ffffc00, 0x5ac00400, "rev16 %rd, %rn" },
+	{ 0xfffffc00, 0x5ac00800, "rev %rd, %rn" },
+	{ 0xfffffc00, 0xdac00800, "rev32 %rd, %rn" },
+	{ 0xfffffc00, 0xdac00c00, "rev %rd, %rn" },
+	{ 0x7ffffc00, 0x5ac01000, "clz %rd, %rn" },
+	{ 0x7ffffc00, 0x5ac01400, "cls %rd, %rn" },
+	{ 0x7fe0fc00, 0x1b007c00, "mul %rd, %rn, %rm" },
+	{ 0x7fe0fc00, 0x1b00fc00, "mneg %rd, %rn, %rm" },
+	{ 0x7fe08000, 0x1b000000, "madd %rd, %rn, %rm, %ra" },
+	{ 0x7fe08000, 0x1b008000, "msub %rd, %rn, %rm, %ra" },
+	{ 0xffe0fc00, 0x9b207c00, "smull %xd, %wn, %wm" },
+	{ 0xffe0fc00, 0x9ba07c00, "umull %xd, %wn, %wm" },
+	{ 0xffe0fc00, 0x9b20fc00, "smnegl %xd, %wn, %wm" },
+	{ 0xffe0fc00, 0x9ba0fc00, "umnegl %xd, %wn, %wm" },
+	{ 0xffe08000, 0x9b200000, "smaddl %xd, %wn, %wm, %xa" },
+	{ 0xffe08000, 0x9b208000, "smsubl %xd, %wn, %wm, %xa" },
+	{ 0xffe08000, 0x9ba00000, "umaddl %xd, %wn, %wm, %xa" },
+	{ 0xffe08000, 0x9ba08000, "umsubl %xd, %wn, %wm, %xa" },
+	{ 0xffe0fc00, 0x9b407c00, "smulh %xd, %xn, %xm" },
+	{ 0xffe0fc00, 0x9bc07c00, "umulh %xd, %xn, %xm" },
+
+	/* Loads and stores. */
+	A64_LS(0x38000000, "strb", "sturb", "w", 0),
+	A64_LS(0x38400000, "ldrb", "ldurb", "w", 0),
+	A64_LS(0x38800000, "ldrsb", "ldursb", "x", 0),
+	A64_LS(0x38c00000, "ldrsb", "ldursb", "w", 0),
+	A64_LS(0x78000000, "strh", "sturh", "w", 1),
+	A64_LS(0x78400000, "ldrh", "ldurh", "w", 1),
+	A64_LS(0x78800000, "ldrsh", "ldursh", "x", 1),
+	A64_LS(0x78c00000, "ldrsh", "ldursh", "w", 1),
+	A64_LS(0xb8000000, "str", "stur", "w", 2),
+	A64_LS(0xb8400000, "ldr", "ldur", "w", 2),
+	A64_LS(0xb8800000, "ldrsw", "ldursw", "x", 2),
+	A64_LS(0xf8000000, "str", "stur", "x", 3),
+	A64_LS(0xf8400000, "ldr", "ldur", "x", 3),
+	A64_LS(0x3c000000, "str", "stur", "b", 0),
+	A64_LS(0x3c400000, "ldr", "ldur", "b", 0),
+	A64_LS(0x3c800000, "str", "stur", "q", 4),
+	A64_LS(0x3cc00000, "ldr", "ldur", "q", 4),
+	A64_LS(0x7c000000, "str", "stur", "h", 1),
+	A64_LS(0x7c400000, "ldr", "ldur", "h", 1),
+	A64_LS(0xbc000000, "str", "stur", "s", 2),
+	A64_LS(0xbc400000, "ldr", "ldur", "s", 2),
+	A64_LS(0xfc000000, "str", "stur", "d", 3),
+	A64_LS(0xfc400000, "ldr", "ldur", "d", 3),
+	{ 0xffc00000, 0xf9800000, "prfm %p, %U3" },
+	{ 0xffe00c00, 0xf8800000, "prfum %p, %9" },
+	{ 0xffe00c00, 0xf8a00800, "prfm %p, %X3" },
+	{ 0xff000000, 0x18000000, "ldr %wd, %L" },
+	{ 0xff000000, 0x58000000, "ldr %xd, %L" },
+	{ 0xff000000, 0x98000000, "ldrsw %xd, %L" },
+	{ 0xff000000, 0xd8000000, "prfm %p, %L" },
+	{ 0xff000000, 0x1c000000, "ldr %sd, %L" },
+	{ 0xff000000, 0x5c000000, "ldr %dd, %L" },
+	{ 0xff000000, 0x9c000000, "ldr %qd, %L" },
+	A64_PAIR(0x28000000, "stp", "stnp", "w", 2),
+	A64_PAIR(0x28400000, "ldp", "ldnp", "w", 2),
+	{ 0xffc00000, 0x68400000, NULL },
+	{ 0xfe400000, 0x68400000, "ldpsw %xd, %xa, %72" },
+	A64_PAIR(0xa8000000, "stp", "stnp", "x", 3),
+	A64_PAIR(0xa8400000, "ldp", "ldnp", "x", 3),
+	A64_PAIR(0x2c000000, "stp", "stnp", "s", 2),
+	A64_PAIR(0x2c400000, "ldp", "ldnp", "s", 2),
+	A64_PAIR(0x6c000000, "stp", "stnp", "d", 3),
+	A64_PAIR(0x6c400000, "ldp", "ldnp", "d", 3),
+	A64_PAIR(0xac000000, "stp", "stnp", "q", 4),
+	A64_PAIR(0xac400000, "ldp", "ldnp", "q", 4),
+	{ 0xbffffc00, 0x885f7c00, "ldxr %zd, [%Xn]" },
+	{ 0xbffffc00, 0x885ffc00, "ldaxr %zd, [%Xn]" },
+	{ 0xbfe0fc00, 0x88007c00, "stxr %wm, %zd, [%Xn]" },
+	{ 0xbfe0fc00, 0x8800fc00, "stlxr %wm, %zd, [%Xn]" },
+	{ 0xbffffc00, 0x88dffc00, "ldar %zd, [%Xn]" },
+	{ 0xbffffc00, 0x889ffc00, "stlr %zd, [%Xn]" },
+	{ 0xfffffc00, 0x085f7c00, "ldxrb %wd, [%Xn]" },
+	{ 0xfffffc00, 0x085ffc00, "ldaxrb %wd, [%Xn]" },
+	{ 0xffe0fc00, 0x08007c00, "stxrb %wm, %wd, [%Xn]" },
+	{ 0xffe0fc00, 0x0800fc00, "stlxrb %wm, %wd, [%Xn]" },
+	{ 0xfffffc00, 0x08dffc00, "ldarb %wd, [%Xn]" },
+	{ 0xfffffc00, 0x089ffc00, "stlrb %wd, [%Xn]" },
+	{ 0xfffffc00, 0x485f7c00, "ldxrh %wd, [%Xn]" },
+	{ 0xfffffc00, 0x485ffc00, "ldaxrh %wd, [%Xn]" },
+	{ 0xffe0fc00, 0x48007c00, "stxrh %wm, %wd, [%Xn]" },
+	{ 0xffe0fc00, 0x4800fc00, "stlxrh %wm, %wd, [%Xn]" },
+	{ 0xfffffc00, 0x48dffc00, "ldarh %wd, [%Xn]" },
+	{ 0xfffffc00, 0x489ffc00, "stlrh %wd, [%Xn]" },
+
+	/* Floating point. */
+	{ 0xff3ffc00, 0x1e204000, "fmov %fd, %fn" },
+	{ 0xff3ffc00, 0x1e20c000, "fabs %fd, %fn" },
+	{ 0xff3ffc00, 0x1e214000, "fneg %fd, %fn" },
+	{ 0xff3ffc00, 0x1e21c000, "fsqrt %fd, %fn" },
+	{ 0xfffffc00, 0x1e22c000, "fcvt %dd, %sn" },
+	{ 0xfffffc00, 0x1e624000, "fcvt %sd, %dn" },
+	{ 0xff20fc00, 0x1e200800, "fmul %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e201800, "fdiv %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e202800, "fadd %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e203800, "fsub %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e204800, "fmax %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e205800, "fmin %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e206800, "fmaxnm %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e207800, "fminnm %fd, %fn, %fm" },
+	{ 0xff20fc00, 0x1e208800, "fnmul %fd, %fn, %fm" },
+	{ 0xff20fc1f, 0x1e202000, "fcmp %fn, %fm" },
+	{ 0xff3ffc1f, 0x1e202008, "fcmp %fn, #0.0" },
+	{ 0xff20fc1f, 0x1e202010, "fcmpe %fn, %fm" },
+	{ 0xff3ffc1f, 0x1e202018, "fcmpe %fn, #0.0" },
+	{ 0xff200c00, 0x1e200c00, "fcsel %fd, %fn, %fm, %c" },
+	{ 0xff201fe0, 0x1e201000, "fmov %fd, %8" },
+	{ 0xff208000, 0x1f000000, "fmadd %fd, %fn, %fm, %fa" },
+	{ 0xff208000, 0x1f008000, "fmsub %fd, %fn, %fm, %fa" },
+	{ 0xff208000, 0x1f200000, "fnmadd %fd, %fn, %fm, %fa" },
+	{ 0xff208000, 0x1f208000, "fnmsub %fd, %fn, %fm, %fa" },
+	{ 0x7f3ffc00, 0x1e220000, "scvtf %fd, %rn" },
+	{ 0x7f3ffc00, 0x1e230000, "ucvtf %fd, %rn" },
+	{ 0x7f3ffc00, 0x1e380000, "fcvtzs %rd, %fn" },
+	{ 0x7f3ffc00, 0x1e390000, "fcvtzu %rd, %fn" },
+	{ 0x7f3ffc00, 0x1e200000, "fcvtns %rd, %fn" },
+	{ 0x7f3ffc00, 0x1e240000, "fcvtas %rd, %fn" },
+	{ 0x7f3ffc00, 0x1e280000, "fcvtps %rd, %fn" },
+	{ 0x7f3ffc00, 0x1e300000, "fcvtms %rd, %fn" },
+	{ 0xfffffc00, 0x1e260000, "fmov %wd, %sn" },
+	{ 0xfffffc00, 0x1e270000, "fmov %sd, %wn" },
+	{ 0xfffffc00, 0x9e660000, "fmov %xd, %dn" },
+	{ 0xfffffc00, 0x9e670000, "fmov %dd, %xn" },
+};
+
+static inline uint32_t
+_a64_bits(uint32_t w, unsigned hi, unsigned lo)
+{
+	return (w >> lo) & (uint32_t)((1ULL << (hi - lo + 1)) - 1);
+}
+
+static inline int64_t
+_a64_sbits(uint32_t w, unsigned hi, unsigned lo)
+{
+	uint64_t v = _a64_bits(w, hi, lo), sign = 1ULL << (hi - lo);
+	return (int64_t)((v ^ sign) - sign);
+}
+
+/// Print register `n' of the class `c' (see above).
+static void
+_a64_reg(uint32_t w, char c, unsigned n, struct DisText *t)
+{
+	_Bool x = c == 'x' || c == 'X' || ((c == 'r' || c == 'R') && w >> 31)
+		|| (c == 'z' && w >> 30 & 1);
+	switch (c) {
+	break; case 'r': case 'R': case 'x': case 'X': case 'w': case 'W': case 'z':
+		if (n == 31 && (c == 'R' || c == 'X' || c == 'W'))
+			_dis_put(t, x ? "sp" : "wsp");
+		else if (n == 31)
+			_dis_put(t, x ? "xzr" : "wzr");
+		else
+			_dis_put(t, "%c%u", x ? 'x' : 'w', n);
+	break; case 'f': {
+		static const char types[4] = { 's', 'd', '?', 'h' };
+		_dis_put(t, "%c%u", types[_a64_bits(w, 23, 22)], n);
+	}
+	break; default:
+		_dis_put(t, "%c%u", c, n);
+	}
+}
+
+/// The bitmask immediate that N, immr, and imms encode, for a register of
+/// `width' bits; 0 if they aren't valid.
+///
+static uint64_t
+_a64_bitmask(unsigned n, unsigned immr, unsigned imms, unsigned width)
+{
+	unsigned len = n ? 6 : 0;
+	if (!n)
+		for (unsigned i = 5; i > 0 && !len; --i)
+			if (!(imms >> i & 1))
+				len = i;
+	if (len == 0 || (n && width == 32))
+		return 0;
+
+	unsigned size = 1u << len, s = imms & (size - 1), r = immr & (size - 1);
+	if (s == size - 1)
+		return 0;
+	uint64_t elem = (s + 1 == 64) ? ~0ULL : (1ULL << (s + 1)) - 1;
+	if (r)
+		elem = (elem >> r | elem << (size - r)) & (size == 64 ? ~0ULL : (1ULL << size) - 1);
+	for (unsigned e = size; e < width; e *= 2)
+		elem |= elem << e;
+	return width == 32 ? elem & 0xffffffff : elem;
+}
+
+static const char a64_conds[16][3] = {
+	"eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc",
+	"hi", "ls", "ge", "lt", "gt", "le", "al", "nv",
+};
+
+/// The base register and offset of a load or store, as in "[x0, #8]".
+static void
+_a64_addr(uint32_t w, int64_t off, int mode, struct DisText *t)
+{
+	_dis_put(t, "[");
+	_a64_reg(w, 'X', _a64_bits(w, 9, 5), t);
+	if (mode == 1)
+		_dis_put(t, "], #%lld", (long long)off);
+	else if (mode == 3)
+		_dis_put(t, ", #%lld]!", (long long)off);
+	else
+		_dis_put(t, off ? ", #%lld]" : "]", (long long)off);
+}
+
+/// Print the operand of the escape at `*f' (after its `%'), and move `*f' past
+/// it. Returns false if the instruction isn't valid after all.
+///
+static _Bool
+_a64_escape(uint32_t w, uint64_t addr, const char **f, struct DisText *t)
+{
+	unsigned sf = w >> 31, width = sf ? 64 : 32;
+	char c = *(*f)++;
+
+	if (strchr("rRxXwWzbhsdqf", c) && strchr("dnma", **f)) {
+		char field = *(*f)++;
+		if (c == 'f' && _a64_bits(w, 23, 22) == 2)
+			return false;
+		unsigned lo = field == 'd' ? 0 : field == 'n' ? 5 : field == 'm' ? 16 : 10;
+		_a64_reg(w, c, _a64_bits(w, lo + 4, lo), t);
+		return true;
+	}
+
+	switch (c) {
+	break; case 'i':
+		_dis_put(t, "#%u", _a64_bits(w, 21, 10));
+		if (w >> 22 & 1)
+			_dis_put(t, ", lsl #12");
+	break; case 'l': {
+		uint64_t v = _a64_bitmask(w >> 22 & 1, _a64_bits(w, 21, 16), _a64_bits(w, 15, 10), width);
+		if (v == 0)
+			return false;
+		_dis_put(t, "#0x%llx", (unsigned long long)v);
+	}
+	break; case 'Z': case 'N': case 'k': {
+		unsigned hw = _a64_bits(w, 22, 21) * 16;
+		uint64_t imm = _a64_bits(w, 20, 5);
+		if (!sf && hw >= 32)
+			return false;
+		if (c == 'k') {
+			_dis_put(t, "#%llu", (unsigned long long)imm);
+			if (hw)
+				_dis_put(t, ", lsl #%u", hw);
+			break;
+		}
+		uint64_t v = imm << hw;
+		if (c == 'N')
+			v = ~v;
+		_dis_put(t, "#%lld", (long long)(sf ? (int64_t)v : (int64_t)(int32_t)v));
+	}
+	break; case 'j': {
+		unsigned bits = (unsigned)strtoul(*f, (char **)f, 10);
+		int64_t off = bits == 26 ? _a64_sbits(w, 25, 0) : bits == 19 ? _a64_sbits(w, 23, 5)
+			: _a64_sbits(w, 18, 5);
+		_dis_put(t, "0x%llx", (unsigned long long)(addr + (uint64_t)(off * 4)));
+	}
+	break; case 'a': case 'A': {
+		int64_t imm = _a64_sbits(w, 23, 5) * 4 | _a64_bits(w, 30, 29);
+		uint64_t target = c == 'a' ? addr + (uint64_t)imm
+			: (addr & ~0xfffULL) + (uint64_t)(imm * 4096);
+		_dis_put(t, "0x%llx", (unsigned long long)target);
+	}
+	break; case 'c':
+		_dis_put(t, "%s", a64_conds[_a64_bits(w, 15, 12)]);
+	break; case 'C':
+		_dis_put(t, "%s", a64_conds[_a64_bits(w, 3, 0)]);
+	break; case 'o': case 'O': {
+		static const char shifts[4][4] = { "lsl", "lsr", "asr", "ror" };
+		unsigned amount = _a64_bits(w, 15, 10), type = _a64_bits(w, 23, 22);
+		if ((!sf && amount >= 32) || (c == 'O' && type == 3))
+			return false;
+		if (amount || type)
+			_dis_put(t, ", %s #%u", shifts[type], amount);
+	}
+	break; case 'e': {
+		static const char exts[8][5] = {
+			"uxtb", "uxth", "uxtw", "uxtx", "sxtb", "sxth", "sxtw", "sxtx",
+		};
+		unsigned opt = _a64_bits(w, 15, 13), amount = _a64_bits(w, 12, 10);
+		if (amount > 4)
+			return false;
+		_a64_reg(w, sf && (opt & 3) == 3 ? 'x' : 'w', _a64_bits(w, 20, 16), t);
+		_Bool sp = _a64_bits(w, 9, 5) == 31 || (_a64_bits(w, 4, 0) == 31 && !(w >> 29 & 1));
+		if (sp && opt == (sf ? 3 : 2))
+			_dis_put(t, amount ? ", lsl #%u" : "", amount);
+		else
+			_dis_put(t, amount ? ", %s #%u" : ", %s", exts[opt], amount);
+	}
+	break; case 'U': {
+		unsigned scale = (unsigned)(*(*f)++ - '0');
+		_a64_addr(w, (int64_t)_a64_bits(w, 21, 10) << scale, 2, t);
+	}
+	break; case '9':
+		_a64_addr(w, _a64_sbits(w, 20, 12), (int)_a64_bits(w, 11, 10), t);
+	break; case '7': {
+		unsigned scale = (unsigned)(*(*f)++ - '0'), idx = _a64_bits(w, 24, 23);
+		_a64_addr(w, _a64_sbits(w, 21, 15) * (1 << scale), idx == 1 ? 1 : idx == 3 ? 3 : 2, t);
+	}
+	break; case 'X': {
+		static const char exts[8][5] = { "", "", "uxtw", "lsl", "", "", "sxtw", "sxtx" };
+		unsigned scale = (unsigned)(*(*f)++ - '0'), opt = _a64_bits(w, 15, 13);
+		_Bool s = w >> 12 & 1;
+		if (!(opt & 2))
+			return false;
+		_dis_put(t, "[");
+		_a64_reg(w, 'X', _a64_bits(w, 9, 5), t);
+		_dis_put(t, ", ");
+		_a64_reg(w, opt & 1 ? 'x' : 'w', _a64_bits(w, 20, 16), t);
+		if (opt != 3 || s)
+			_dis_put(t, ", %s", exts[opt]);
+		if (s)
+			_dis_put(t, " #%u", scale);
+		_dis_put(t, "]");
+	}
+	break; case 'L':
+		_dis_put(t, "0x%llx", (unsigned long long)(addr + (uint64_t)(_a64_sbits(w, 23, 5) * 4)));
+	break; case 'b':
+		_dis_put(t, "#%u", (w >> 31) << 5 | _a64_bits(w, 23, 19));
+	break; case 'u': case 'h': {
+		unsigned hi = (unsigned)((*f)[0] - '0') * 10 + (unsigned)((*f)[1] - '0');
+		unsigned lo = (unsigned)((*f)[2] - '0') * 10 + (unsigned)((*f)[3] - '0');
+		*f += 4;
+		_dis_put(t, c == 'u' ? "#%u" : "#0x%x", _a64_bits(w, hi, lo));
+	}
+	break; case 'S': {
+		static const struct { uint32_t enc; const char *name; } regs[] = {
+			{ 0xda10, "nzcv" }, { 0xda20, "fpcr" }, { 0xda21, "fpsr" },
+			{ 0xd801, "ctr_el0" }, { 0xd807, "dczid_el0" }, { 0xde82, "tpidr_el0" },
+			{ 0xde83, "tpidrro_el0" }, { 0xdf01, "cntpct_el0" }, { 0xdf02, "cntvct_el0" },
+			{ 0xdf00, "cntfrq_el0" }, { 0xc000, "midr_el1" }, { 0xc005, "mpidr_el1" },
+		};
+		uint32_t enc = _a64_bits(w, 20, 5);
+		for (size_t i = 0; i < ARRAY_LEN(regs); ++i)
+			if (regs[i].enc == enc) {
+				_dis_put(t, "%s", regs[i].name);
+				return true;
+			}
+		_dis_put(t, "S%u_%u_C%u_C%u_%u", enc >> 14, enc >> 11 & 7, enc >> 7 & 15,
+			enc >> 3 & 15, enc & 7);
+	}
+	break; case 'D': {
+		static const char *opts[16] = {
+			NULL, "oshld", "oshst", "osh", NULL, "nshld", "nshst", "nsh",
+			NULL, "ishld", "ishst", "ish", NULL, "ld", "st", "sy",
+		};
+		unsigned o = _a64_bits(w, 11, 8);
+		if (opts[o])
+			_dis_put(t, "%s", opts[o]);
+		else
+			_dis_put(t, "#%u", o);
+	}
+	break; case 'p': {
+		static const char types[4][4] = { "pld", "pli", "pst", "" };
+		unsigned op = _a64_bits(w, 4, 0);
+		if (op >> 3 == 3 || (op >> 1 & 3) == 3)
+			_dis_put(t, "#%u", op);
+		else
+			_dis_put(t, "%sl%u%s", types[op >> 3], (op >> 1 & 3) + 1, op & 1 ? "strm" : "keep");
+	}
+	break; case '8': {
+		/* imm8 is a sign, three bits of exponent, and four of fraction. */
+		unsigned imm = _a64_bits(w, 20, 13);
+		int exp = (int)((imm >> 4 & 7) ^ 4) - 3;
+		double v = (16 + (imm & 15)) / 16.0;
+		for (; exp > 0; --exp)
+			v *= 2;
+		for (; exp < 0; ++exp)
+			v /= 2;
+		_dis_put(t, "#%s%.8f", imm & 0x80 ? "-" : "", v);
+	}
+	break; default:
+		_dis_put(t, "%%%c", c);
+	}
+	return true;
+}
+
+/// Whether movz or movn can make `v' (of `width' bits).
+static _Bool
+_a64_movable(uint64_t v, unsigned width)
+{
+	for (unsigned hw = 0; hw < width; hw += 16) {
+		uint64_t rest = v & ~(0xffffULL << hw), inv = ~v & ~(0xffffULL << hw);
+		if (width == 32)
+			inv &= 0xffffffff;
+		if (rest == 0 || inv == 0)
+			return true;
+	}
+	return false;
+}
+
+/// The instructions whose name depends on more than their encoding: the
+/// aliases of the bitfield moves, extr, the conditional selects, add, orr,
+/// movz, and movn.
+///
+static const char *
+_a64_special(uint32_t w, const char *name, char *buf, size_t buf_sz)
+{
+	unsigned sf = w >> 31, size = sf ? 64 : 32;
+	unsigned rd = _a64_bits(w, 4, 0), rn = _a64_bits(w, 9, 5), rm = _a64_bits(w, 20, 16);
+	unsigned immr = _a64_bits(w, 21, 16), imms = _a64_bits(w, 15, 10);
+
+	if (!strcmp(name, "@mov"))
+		return rd == 31 || rn == 31 ? "mov %Rd, %Rn" : "add %Rd, %Rn, %i";
+
+	if (!strcmp(name, "@extr")) {
+		if ((w >> 22 & 1) != sf || (!sf && imms >= 32))
+			return NULL;
+		return rn == rm ? "ror %rd, %rn, %u1510" : "extr %rd, %rn, %rm, %u1510";
+	}
+
+	/* mov is preferred for the immediates that movz and movn can't make, and
+	 * for all the ones they can, other than the ones with no bits set in
+	 * their halfword (and 0xffff for a 32-bit movn). */
+	unsigned hw = _a64_bits(w, 22, 21), imm16 = _a64_bits(w, 20, 5);
+	if (!strcmp(name, "@movz"))
+		return imm16 == 0 && hw ? "movz %rd, %k" : "mov %rd, %Z";
+	if (!strcmp(name, "@movn"))
+		return (imm16 == 0 && hw) || (!sf && imm16 == 0xffff) ? "movn %rd, %k" : "mov %rd, %N";
+	if (!strcmp(name, "@orr")) {
+		uint64_t v = _a64_bitmask(w >> 22 & 1, immr, imms, size);
+		if (v == 0)
+			return NULL;
+		if (rn != 31 || _a64_movable(v, size))
+			return "orr %Rd, %rn, %l";
+		snprintf(buf, buf_sz, "mov %%Rd, #%lld", sf ? (long long)v : (long long)(int32_t)v);
+		return buf;
+	}
+
+	if (!strcmp(name, "@csel")) {
+		unsigned op = w >> 30 & 1, o2 = w >> 10 & 1, cond = _a64_bits(w, 15, 12);
+		static const char *names[2][2] = { { "csel", "csinc" }, { "csinv", "csneg" } };
+		if (op == 0 && o2 == 0)
+			return "csel %rd, %rn, %rm, %c";
+		if ((cond >> 1) != 7 && rn == rm) {
+			/* The aliases are printed with the opposite condition. */
+			const char *alias = rn == 31 ? (op ? (o2 ? NULL : "csetm") : "cset")
+				: (op ? (o2 ? "cneg" : "cinv") : "cinc");
+			if (alias) {
+				snprintf(buf, buf_sz, "%s %%rd, %s%s", alias, rn == 31 ? "" : "%rn, ",
+					a64_conds[cond ^ 1]);
+				return buf;
+			}
+		}
+		snprintf(buf, buf_sz, "%s %%rd, %%rn, %%rm, %%c", names[op][o2]);
+		return buf;
+	}
+
+	if (!sf && (immr >= 32 || imms >= 32 || w >> 22 & 1))
+		return NULL;
+	if ((w >> 22 & 1) != sf)
+		return NULL;
+
+	if (!strcmp(name, "@sbfm")) {
+		if (imms == size - 1)
+			return "asr %rd, %rn, %u2116";
+		if (immr == 0 && (imms == 7 || imms == 15 || (imms == 31 && sf))) {
+			snprintf(buf, buf_sz, "sxt%c %%rd, %%wn", imms == 7 ? 'b' : imms == 15 ? 'h' : 'w');
+			return buf;
+		}
+		if (imms < immr)
+			snprintf(buf, buf_sz, "sbfiz %%rd, %%rn, #%u, #%u", size - immr, imms + 1);
+		else
+			snprintf(buf, buf_sz, "sbfx %%rd, %%rn, #%u, #%u", immr, imms - immr + 1);
+		return buf;
+	}
+	if (!strcmp(name, "@ubfm")) {
+		if (imms != size - 1 && imms + 1 == immr)
+			snprintf(buf, buf_sz, "lsl %%rd, %%rn, #%u", size - 1 - imms);
+		else if (imms == size - 1)
+			return "lsr %rd, %rn, %u2116";
+		else if (immr == 0 && !sf && (imms == 7 || imms == 15))
+			snprintf(buf, buf_sz, "uxt%c %%wd, %%wn", imms == 7 ? 'b' : 'h');
+		else if (imms < immr)
+			snprintf(buf, buf_sz, "ubfiz %%rd, %%rn, #%u, #%u", size - immr, imms + 1);
+		else
+			snprintf(buf, buf_sz, "ubfx %%rd, %%rn, #%u, #%u", immr, imms - immr + 1);
+		return buf;
+	}
+	if (imms < immr)
+		snprintf(buf, buf_sz, rn == 31 ? "bfc %%rd, #%u, #%u" : "bfi %%rd, %%rn, #%u, #%u",
+			size - immr, imms + 1);
+	else
+		snprintf(buf, buf_sz, "bfxil %%rd, %%rn, #%u, #%u", immr, imms - immr + 1);
+	return buf;
+}
+
+/// Print the AArch64 instruction `w', which is at `addr'.
+///
+static void
+a64_format(uint32_t w, uint64_t addr, struct DisText *t)
+{
+	char buf[48];
+	const char *f = NULL;
+	for (size_t i = 0; i < ARRAY_LEN(a64_ops); ++i)
+		if ((w & a64_ops[i].mask) == a64_ops[i].value) {
+			f = a64_ops[i].fmt;
+			break;
+		}
+	if (f && f[0] == '@')
+		f = _a64_special(w, f, buf, sizeof(buf));
+
+	size_t start = t->len;
+	while (f && *f) {
+		size_t n = strcspn(f, "%");
+		_dis_put(t, "%.*s", (int)n, f);
+		f += n;
+		if (*f == '%' && (++f, !_a64_escape(w, addr, &f, t)))
+			f = NULL;
+	}
+	if (f == NULL) {
+		t->len = start;
+		_dis_put(t, ".inst 0x%08x", w);
+	}
+}
@@ -0,0 +1,791 @@
+/// Dumping the disk inside a virtual disk image (--disk), instead of the image
+/// file itself.
+///
+/// Images are sparse: only the parts of the disk that have been written to are
+/// stored, in clusters (qcow2) or grains (VMDK), and a two-level table says where
+/// each of them is in the image. Both are called clusters here. The tables are
+/// looked up as the disk is read, so opening even a huge image is instant:
+///
+/// * qcow2 (versions 2 and 3): the L1 table is read when the image is opened,
+///   and L2 tables are read as they're needed.
+///
+/// * VMDK (hosted sparse extents, like the ones in "monolithicSparse" images):
+///   the same, with the grain directory and grain tables.
+///
+/// * Anything else is taken to be a raw disk image, whose holes (if it's a sparse
+///   file) are found with SEEK_DATA and SEEK_HOLE, where they're available.
+///
+/// ELF core files (--core) are read the same way, with the process's address
+/// space as the "disk": the PT_LOAD segments say where each mapping is in the
+/// core. Cores are mmap(2)ed, and the segments sorted by address, so that an
+/// address is found with a binary search. The gaps between mappings are holes,
+/// and so are the parts of mappings that weren't dumped into the core (which
+/// the kernel leaves out for things like read-only mappings of files).
+///
+/// Intel HEX and S-record images (--hex, see records.c) are decoded into memory,
+/// and read the same way as cores, with the bytes they load as the segments.
+///
+/// Files that were split into parts (--join) are read as one stream, with each
+/// part as a segment that starts where the one before it ends, so that -s finds
+/// its part with the same binary search. Only the part that's being read is kept
+/// open.
+///
+/// Only the last second-level table that was read is kept, since the disk is
+/// read from start to end.
+///
+/// disk_map() tells input.c where a run of the disk is in the image, or that it
+/// isn't stored at all, so that huxdemp() can skip over runs of unallocated (or
+/// zeroed) clusters without reading anything. Clusters that follow each other in
+/// the image too are merged into one run, which is read with a single pread(2).
+///
+/// Compressed clusters and encrypted images can't be read. Unallocated clusters of
+/// a qcow2 image with a backing file are in the backing file, which isn't looked
+/// at; they're shown as unallocated, like any other.
+///
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(SEEK_DATA) && defined(__linux__)
+#define SEEK_DATA 3  /* only declared with _GNU_SOURCE */
+#define SEEK_HOLE 4
+#endif
+
+enum DiskFormat {
+	DF_Raw, DF_Qcow2, DF_Vmdk, DF_Core, DF_Records, DF_Parts
+};
+
+/// What disk_open() should take a file to be.
+enum DiskOpen {
+	DO_Image, DO_Core, DO_Records
+};
+
+/// What a run of the disk is: data that's stored in the image, clusters that the
+/// image says are all zeros, clusters that aren't in the image at all, or (for
+/// cores) memory that was mapped but left out of the core.
+enum DiskRun {
+	DR_Error = -1, DR_Data, DR_Zeros, DR_Unallocated, DR_Absent
+};
+
+/// Entries of second-level tables, once they've been read, are the offset in the
+/// image of their cluster, or one of these (which are never valid offsets, since
+/// the image's header is there).
+#define DISK_UNALLOCATED 0
+#define DISK_ZEROS       1
+#define DISK_COMPRESSED  2
+
+#define QCOW2_OFFSET_MASK 0x00fffffffffffe00ULL
+#define QCOW2_COMPRESSED  (1ULL << 62)
+#define QCOW2_ZEROS       1ULL
+
+#define VMDK_COMPRESSED (1U << 16)
+#define VMDK_GD_AT_END  UINT64_MAX
+
+#define ELF_PT_LOAD  1
+#define ELF_PN_XNUM  0xffff
+
+/// A PT_LOAD segment of a core: `memsz' bytes at `vaddr' in the process, the
+/// first `filesz' of which are at `offset' in the core. (Or an extent of an Intel
+/// HEX image, at `offset' in the decoded data.)
+struct CoreSegment {
+	uint64_t vaddr, memsz, offset, filesz;
+};
+
+struct Disk {
+	enum DiskFormat format;
+	const char *path;
+	int fd;
+	uint64_t size;
+
+	/// Clusters are 1 << `cluster_bits' bytes, and each second-level table maps
+	/// `table_len' of them. It takes up `table_sz' bytes in the image.
+	unsigned cluster_bits;
+	uint64_t table_len;
+	size_t table_sz;
+
+	/// The top-level table (L1 table, grain directory), with the offsets in the
+	/// image of the second-level tables, and the one that was read last.
+	uint64_t *top, top_len;
+	uint64_t *table, table_idx;
+
+	/// For cores: the segments, sorted by address, and the core itself (unless
+	/// it couldn't be mmap(2)ed, in which case it's read with pread(2)). For
+	/// Intel HEX and S-records, `map' is the decoded data instead.
+	struct CoreSegment *segs;
+	size_t nsegs;
+	const byte_t *map;
+	size_t map_sz;
+
+	/// For --join: the path of each part (one for each segment), and which of
+	/// them `fd' is open on, if any.
+	char **parts;
+	size_t part;
+};
+
+static inline uint64_t
+_disk_be(const byte_t *p, size_t len)
+{
+	uint64_t n = 0;
+	for (size_t i = 0; i < len; ++i)
+		n = n << 8 | p[i];
+	return n;
+}
+
+/// The number of segments that start at or before `pos'; the one `pos' is in,
+/// if any, is the last of them.
+///
+static size_t
+_disk_seg_find(struct Disk *d, uint64_t pos)
+{
+	size_t lo = 0, hi = d->nsegs;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (d->segs[mid].vaddr <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/// Open the part of a --join stream that `*off' is in, and make `*off' relative
+/// to it. Reads never cross from one part into the next, since disk_map() ends
+/// data runs at the end of their segment.
+///
+static const char *
+_disk_part(struct Disk *d, uint64_t *off)
+{
+	size_t i = _disk_seg_find(d, *off) - 1;
+	*off -= d->segs[i].vaddr;
+
+	if (d->fd == -1 || d->part != i) {
+		if (d->fd != -1)
+			close(d->fd);
+		d->fd = open(d->parts[i], O_RDONLY);
+		d->part = i;
+		if (d->fd == -1)
+			warn("\"%s\"", d->parts[i]);
+	}
+	return d->parts[i];
+}
+
+static _Bool
+_disk_pread(struct Disk *d, uint64_t off, void *buf, size_t len)
+{
+	if (d->map && off <= d->map_sz && len <= d->map_sz - off) {
+		memcpy(buf, &d->map[off], len);
+		return true;
+	}
+
+	const char *path = d->path;
+	if (d->format == DF_Parts) {
+		path = _disk_part(d, &off);
+		if (d->fd == -1)
+			return false;
+	}
+
+	for (size_t got = 0; got < len;) {
+		ssize_t r = pread(d->fd, (byte_t *)buf + got, len - got, (off_t)(off + got));
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			if (r == -1)
+				warn("\"%s\"", path);
+			else
+				warnx("\"%s\": the image is cut short (at 0x%llx)", path,
+					(unsigned long long)(off + got));
+			return false;
+		}
+		got += (size_t)r;
+	}
+	return true;
+}
+
+/// Turn the entries of a table, as read from the image into `raw', into offsets
+/// (or DISK_*). Entries are converted from the last one, since they can be smaller
+/// than a uint64_t in the image.
+///
+static void
+_disk_convert(struct Disk *d, uint64_t *table, uint64_t len, _Bool top)
+{
+	const byte_t *raw = (const byte_t *)table;
+
+	for (uint64_t i = len; i-- > 0;) {
+		uint64_t e;
+
+		switch (d->format) {
+		break; case DF_Qcow2:
+			e = _disk_be(&raw[i * 8], 8);
+			if (top)
+				table[i] = e & QCOW2_OFFSET_MASK;
+			else if (e & QCOW2_COMPRESSED)
+				table[i] = DISK_COMPRESSED;
+			else if (e & QCOW2_ZEROS)
+				table[i] = DISK_ZEROS;
+			else
+				table[i] = e & QCOW2_OFFSET_MASK;
+		break; case DF_Vmdk:
+			/* Both levels hold sector numbers; a grain at sector 1 is a
+			 * zeroed grain. */
+			e = _archive_le(&raw[i * 4], 4);
+			table[i] = !top && e == 1 ? DISK_ZEROS : e * 512;
+		break; case DF_Raw: case DF_Core: case DF_Records: case DF_Parts:
+			break;
+		}
+	}
+}
+
+/// The second-level table at `idx' in the top-level table, or NULL if it can't be
+/// read.
+///
+static uint64_t *
+_disk_table(struct Disk *d, uint64_t idx)
+{
+	if (d->table_idx == idx)
+		return d->table;
+
+	d->table_idx = UINT64_MAX;
+	if (!_disk_pread(d, d->top[idx], d->table, d->table_sz))
+		return NULL;
+
+	_disk_convert(d, d->table, d->table_len, false);
+	d->table_idx = idx;
+	return d->table;
+}
+
+/// Allocate the tables, and read the top-level one (`raw_sz' bytes at `off').
+///
+static _Bool
+_disk_tables(struct Disk *d, uint64_t off, uint64_t raw_sz)
+{
+	d->top = arena_alloc(&arena_scratch, d->top_len * sizeof(d->top[0]));
+	d->table = arena_alloc(&arena_scratch, d->table_len * sizeof(d->table[0]));
+	d->table_idx = UINT64_MAX;
+
+	if (d->top == NULL || d->table == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", d->path);
+		return false;
+	}
+
+	if (!_disk_pread(d, off, d->top, raw_sz))
+		return false;
+	_disk_convert(d, d->top, d->top_len, true);
+	return true;
+}
+
+static _Bool
+_disk_qcow2(struct Disk *d, const byte_t *hdr)
+{
+	uint32_t version   = (uint32_t)_disk_be(&hdr[4], 4);
+	uint64_t backing   = _disk_be(&hdr[8], 8);
+	uint32_t backing_sz = (uint32_t)_disk_be(&hdr[16], 4);
+	uint32_t bits      = (uint32_t)_disk_be(&hdr[20], 4);
+	uint32_t crypt     = (uint32_t)_disk_be(&hdr[32], 4);
+	uint32_t l1_len    = (uint32_t)_disk_be(&hdr[36], 4);
+	uint64_t l1_off    = _disk_be(&hdr[40], 8);
+
+	/* Bit 0 is "dirty", which doesn't matter for reading, 1 is "corrupt", and 3
+	 * is the compression type, which only matters for compressed clusters. */
+	uint64_t incompat = version >= 3 ? _disk_be(&hdr[72], 8) : 0;
+
+	if (version < 2 || version > 3) {
+		warnx("\"%s\": qcow2 version %u isn't supported", d->path, version);
+		return false;
+	}
+	if (bits < 9 || bits > 21) {
+		warnx("\"%s\": clusters of 2^%u bytes are invalid", d->path, bits);
+		return false;
+	}
+	if (crypt != 0) {
+		warnx("\"%s\": encrypted images can't be read", d->path);
+		return false;
+	}
+	if (incompat & ~(uint64_t)0xb) {
+		warnx("\"%s\": the image uses an external data file or extended L2 "
+			"entries, which aren't supported", d->path);
+		return false;
+	}
+	if (incompat & 0x2)
+		warnx("\"%s\": the image is marked as corrupt", d->path);
+
+	if (backing != 0) {
+		char name[256] = "?";
+		size_t len = MIN(backing_sz, sizeof(name) - 1);
+		if (pread(d->fd, name, len, (off_t)backing) == (ssize_t)len)
+			name[len] = '\0';
+		warnx("\"%s\": unallocated clusters come from the backing file \"%s\", "
+			"which isn't read", d->path, name);
+	}
+
+	d->format = DF_Qcow2;
+	d->size = _disk_be(&hdr[24], 8);
+	d->cluster_bits = bits;
+	d->table_sz = (size_t)1 << bits;
+	d->table_len = d->table_sz / 8;
+	d->top_len = l1_len;
+
+	return _disk_tables(d, l1_off, d->top_len * 8);
+}
+
+static _Bool
+_disk_vmdk(struct Disk *d, const byte_t *hdr)
+{
+	uint32_t flags    = (uint32_t)_archive_le(&hdr[8], 4);
+	uint64_t capacity = _archive_le(&hdr[12], 8);
+	uint64_t grain    = _archive_le(&hdr[20], 8);
+	uint32_t gtes     = (uint32_t)_archive_le(&hdr[44], 4);
+	uint64_t gd_off   = _archive_le(&hdr[56], 8);
+	uint16_t compress = (uint16_t)_archive_le(&hdr[77], 2);
+
+	if ((flags & VMDK_COMPRESSED) || compress != 0 || gd_off == VMDK_GD_AT_END) {
+		warnx("\"%s\": compressed (streamOptimized) images can't be read", d->path);
+		return false;
+	}
+	if (grain == 0 || (grain & (grain - 1)) || grain > (1 << 16)
+			|| gtes == 0 || gtes > (1 << 20)) {
+		warnx("\"%s\": the image's header is invalid", d->path);
+		return false;
+	}
+
+	d->format = DF_Vmdk;
+	d->size = capacity * 512;
+	for (d->cluster_bits = 9; grain > 1; grain >>= 1)
+		++d->cluster_bits;
+	d->table_len = gtes;
+	d->table_sz = (size_t)gtes * 4;
+	d->top_len = ((capacity * 512 >> d->cluster_bits) + gtes - 1) / gtes;
+
+	return _disk_tables(d, gd_off * 512, d->top_len * 4);
+}
+
+static void
+disk_close(struct Disk *d)
+{
+	if (d->map && d->format == DF_Records)
+		mem_free((void *)d->map, d->map_sz);
+	else if (d->map)
+		munmap((void *)d->map, d->map_sz);
+	d->map = NULL;
+
+	if (d->format == DF_Parts && d->fd != -1)
+		close(d->fd);
+}
+
+static int
+_disk_seg_cmp(const void *a, const void *b)
+{
+	const struct CoreSegment *x = a, *y = b;
+	return x->vaddr < y->vaddr ? -1 : x->vaddr > y->vaddr;
+}
+
+static _Bool
+_disk_core(struct Disk *d, const byte_t *hdr, uint64_t core_sz)
+{
+	_Bool is64 = hdr[4] == 2, be = hdr[5] == 2;
+	uint64_t (*num)(const byte_t *, size_t) = be ? _disk_be : _archive_le;
+
+	if ((hdr[4] != 1 && hdr[4] != 2) || (hdr[5] != 1 && hdr[5] != 2)) {
+		warnx("\"%s\": not a valid ELF file", d->path);
+		return false;
+	}
+
+	uint64_t phoff  = is64 ? num(&hdr[32], 8) : num(&hdr[28], 4);
+	uint64_t shoff  = is64 ? num(&hdr[40], 8) : num(&hdr[32], 4);
+	size_t phentsz  = (size_t)num(&hdr[is64 ? 54 : 42], 2);
+	uint64_t phnum  = num(&hdr[is64 ? 56 : 44], 2);
+
+	/* With too many segments for e_phnum, the real number is in the first
+	 * section header's sh_info. */
+	if (phnum == ELF_PN_XNUM) {
+		byte_t sh[64];
+		if (!_disk_pread(d, shoff, sh, sizeof(sh)))
+			return false;
+		phnum = is64 ? num(&sh[44], 4) : num(&sh[28], 4);
+	}
+
+	if (phentsz < (is64 ? 56U : 32U) || phnum == 0) {
+		warnx("\"%s\": the ELF file has no program headers", d->path);
+		return false;
+	}
+
+	d->format = DF_Core;
+	d->segs = arena_alloc(&arena_scratch, phnum * sizeof(d->segs[0]));
+	byte_t *ph = arena_alloc(&arena_scratch, phnum * phentsz);
+	if (d->segs == NULL || ph == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", d->path);
+		return false;
+	}
+	if (!_disk_pread(d, phoff, ph, phnum * phentsz))
+		return false;
+
+	_Bool short_core = false;
+	for (uint64_t i = 0; i < phnum; ++i) {
+		const byte_t *p = &ph[i * phentsz];
+		if (num(p, 4) != ELF_PT_LOAD)
+			continue;
+
+		struct CoreSegment *seg = &d->segs[d->nsegs];
+		seg->offset = is64 ? num(&p[8], 8)  : num(&p[4], 4);
+		seg->vaddr  = is64 ? num(&p[16], 8) : num(&p[8], 4);
+		seg->filesz = is64 ? num(&p[32], 8) : num(&p[16], 4);
+		seg->memsz  = is64 ? num(&p[40], 8) : num(&p[20], 4);
+
+		if (seg->memsz == 0 || seg->vaddr + seg->memsz < seg->vaddr)
+			continue;
+		seg->filesz = MIN(seg->filesz, seg->memsz);
+		if (seg->offset > core_sz || seg->filesz > core_sz - seg->offset) {
+			seg->filesz = core_sz - MIN(seg->offset, core_sz);
+			short_core = true;
+		}
+		++d->nsegs;
+	}
+
+	if (d->nsegs == 0) {
+		warnx("\"%s\": the ELF file has no PT_LOAD segments", d->path);
+		return false;
+	}
+	if (short_core)
+		warnx("\"%s\": the core is cut short; what's missing is shown as "
+			"not in the core", d->path);
+
+	qsort(d->segs, d->nsegs, sizeof(d->segs[0]), _disk_seg_cmp);
+	d->size = 0;
+	for (size_t i = 0; i < d->nsegs; ++i)
+		d->size = MAX(d->size, d->segs[i].vaddr + d->segs[i].memsz);
+	return true;
+}
+
+/// Decode the Intel HEX or S-records in `fd' into memory. Unlike images and cores,
+/// they don't have to be in a file, since they're read whole.
+///
+static _Bool
+_disk_records(struct Disk *d, const struct stat *st)
+{
+	byte_t *text = NULL;
+	size_t len = 0, cap = 0;
+	_Bool mapped = false, ok = false;
+
+	if (S_ISREG(st->st_mode) && st->st_size > 0) {
+		void *map = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, d->fd, 0);
+		if (map != MAP_FAILED)
+			text = map, len = cap = (size_t)st->st_size, mapped = true;
+	}
+
+	while (!mapped) {
+		if (len == cap) {
+			size_t grown = cap ? cap * 2 : 64 * 1024;
+			byte_t *buf = mem_alloc(grown);
+			if (buf == NULL) {
+				warnx("\"%s\": not enough memory left in the budget", d->path);
+				goto done;
+			}
+			if (len)
+				memcpy(buf, text, len);
+			mem_free(text, cap);
+			text = buf, cap = grown;
+		}
+
+		ssize_t r = read(d->fd, &text[len], cap - len);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r == -1)
+			warn("\"%s\"", d->path);
+		if (r <= 0)
+			break;
+		len += (size_t)r;
+	}
+
+	struct Records rec = { .data_cap = len / 2 + 1 };
+	rec.data = mem_alloc(rec.data_cap);
+	if (rec.data == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", d->path);
+		goto done;
+	}
+
+	d->format = DF_Records;
+	d->map = rec.data, d->map_sz = rec.data_cap;
+	if (!records_parse(d->path, text, len, &rec))
+		goto done;
+
+	d->segs = arena_alloc(&arena_scratch, rec.ext_sz * sizeof(d->segs[0]));
+	if (d->segs == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", d->path);
+		goto done;
+	}
+
+	for (size_t i = 0; i < rec.ext_sz; ++i) {
+		struct Extent *e = &rec.ext[i];
+		d->segs[i] = (struct CoreSegment){ e->addr, e->len, e->off, e->len };
+	}
+	d->nsegs = rec.ext_sz;
+	d->size = rec.ext[rec.ext_sz - 1].addr + rec.ext[rec.ext_sz - 1].len;
+	ok = true;
+
+done:
+	if (mapped)
+		munmap(text, len);
+	else
+		mem_free(text, cap);
+	return ok;
+}
+
+/// Open the disk in the image `fd', the address space in the ELF core `fd', or
+/// the memory loaded by the Intel HEX or S-records in `fd', depending on `how'.
+/// On failure, a warning is printed and NULL returned.
+///
+static struct Disk *
+disk_open(int fd, const char *path, enum DiskOpen how)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		warn("\"%s\"", path);
+		return NULL;
+	}
+	if (how != DO_Records && !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+		warnx("\"%s\": %s only works on files and block devices", path,
+			how == DO_Core ? "--core" : "--disk");
+		return NULL;
+	}
+
+	struct Disk *d = arena_alloc(&arena_scratch, sizeof(*d));
+	if (d == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", path);
+		return NULL;
+	}
+
+	*d = (struct Disk){ .format = DF_Raw, .path = path, .fd = fd };
+	d->size = S_ISBLK(st.st_mode) ? (uint64_t)lseek(fd, 0, SEEK_END)
+		: (uint64_t)st.st_size;
+
+	byte_t hdr[512] = {0};
+	ssize_t r = how == DO_Records ? 0 : pread(fd, hdr, sizeof(hdr), 0);
+	_Bool ok = true;
+
+	if (how == DO_Records) {
+		ok = _disk_records(d, &st);
+	} else if (how == DO_Core) {
+		if (S_ISREG(st.st_mode) && st.st_size > 0) {
+			void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED)
+				d->map = map, d->map_sz = (size_t)st.st_size;
+		}
+
+		if (r >= 64 && !memcmp(hdr, "\x7f" "ELF", 4)) {
+			ok = _disk_core(d, hdr, (uint64_t)st.st_size);
+		} else {
+			warnx("\"%s\": not an ELF core file", path);
+			ok = false;
+		}
+	} else if (r >= 72 && !memcmp(hdr, "QFI\xfb", 4)) {
+		ok = _disk_qcow2(d, hdr);
+	} else if (r >= 80 && !memcmp(hdr, "KDMV", 4)) {
+		ok = _disk_vmdk(d, hdr);
+	} else if (r >= 21 && !memcmp(hdr, "# Disk DescriptorFile", 21)) {
+		warnx("\"%s\": this is a VMDK descriptor; give the path of its extent "
+			"instead", path);
+		ok = false;
+	}
+
+	if (!ok) {
+		disk_close(d);
+		return NULL;
+	}
+	return d;
+}
+
+/// Read the `n' files at `paths' as the parts of one stream (--join). Empty parts
+/// are left out, since they take up no room in it. On failure, a warning is
+/// printed and NULL returned.
+///
+static struct Disk *
+disk_join(char **paths, size_t n)
+{
+	struct Disk *d = arena_alloc(&arena_scratch, sizeof(*d));
+	struct CoreSegment *segs = arena_alloc(&arena_scratch, n * sizeof(segs[0]));
+	char **parts = arena_alloc(&arena_scratch, n * sizeof(parts[0]));
+	if (d == NULL || segs == NULL || parts == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", paths[0]);
+		return NULL;
+	}
+
+	*d = (struct Disk){ .format = DF_Parts, .path = paths[0], .fd = -1,
+		.segs = segs, .parts = parts };
+
+	for (size_t i = 0; i < n; ++i) {
+		struct stat st;
+		if (!strcmp(paths[i], "-")) {
+			warnx("--join can't read a part from stdin");
+			return NULL;
+		}
+		if (stat(paths[i], &st) == -1) {
+			warn("\"%s\"", paths[i]);
+			return NULL;
+		}
+		if (!S_ISREG(st.st_mode)) {
+			warnx("\"%s\": --join only works on files", paths[i]);
+			return NULL;
+		}
+		if (st.st_size == 0)
+			continue;
+
+		uint64_t sz = (uint64_t)st.st_size;
+		segs[d->nsegs] = (struct CoreSegment){ d->size, sz, d->size, sz };
+		parts[d->nsegs++] = paths[i];
+		d->size += sz;
+	}
+
+	return d;
+}
+
+static enum DiskRun
+_disk_core_at(struct Disk *d, uint64_t pos, uint64_t *host, uint64_t *len)
+{
+	size_t lo = _disk_seg_find(d, pos);
+
+	*host = 0;
+	if (lo == 0) {
+		*len = d->segs[0].vaddr - pos;
+		return DR_Unallocated;
+	}
+
+	struct CoreSegment *seg = &d->segs[lo - 1];
+	uint64_t in = pos - seg->vaddr;
+
+	if (in < seg->filesz) {
+		*host = seg->offset + in;
+		*len = seg->filesz - in;
+		return DR_Data;
+	} else if (in < seg->memsz) {
+		*len = seg->memsz - in;
+		return DR_Absent;
+	}
+
+	*len = (lo < d->nsegs ? d->segs[lo].vaddr : d->size) - pos;
+	return DR_Unallocated;
+}
+
+/// Like _disk_core_at(), but holes of the same kind in segments that follow each
+/// other are merged.
+///
+static enum DiskRun
+_disk_map_core(struct Disk *d, uint64_t pos, uint64_t *host, uint64_t *len)
+{
+	enum DiskRun kind = _disk_core_at(d, pos, host, len);
+
+	for (uint64_t at = pos + *len, h, more; kind != DR_Data && at < d->size; at += more) {
+		if (_disk_core_at(d, at, &h, &more) != kind)
+			break;
+		*len += more;
+	}
+
+	return kind;
+}
+
+static enum DiskRun
+_disk_map_raw(struct Disk *d, uint64_t pos, uint64_t *host, uint64_t *len)
+{
+	*host = pos;
+	*len = d->size - pos;
+
+#ifdef SEEK_DATA
+	off_t data = lseek(d->fd, (off_t)pos, SEEK_DATA);
+	if (data == -1 && errno == ENXIO)
+		return DR_Unallocated;
+	if (data > (off_t)pos) {
+		*len = MIN((uint64_t)data, d->size) - pos;
+		return DR_Unallocated;
+	}
+
+	off_t hole = data == -1 ? -1 : lseek(d->fd, (off_t)pos, SEEK_HOLE);
+	if (hole > (off_t)pos)
+		*len = MIN((uint64_t)hole, d->size) - pos;
+#endif
+
+	return DR_Data;
+}
+
+/// Find out what's at `pos' (which must be inside the disk), and how far that
+/// goes. For data, `*host' is set to where it is in the image, and the run is cut
+/// short at `max' bytes, since it's about to be read. Holes are followed to their
+/// end, however long they are.
+///
+/// Returns DR_Error (after printing a warning) if the run can't be read.
+///
+static enum DiskRun
+disk_map(struct Disk *d, uint64_t pos, uint64_t max, uint64_t *host, uint64_t *len)
+{
+	if (d->format == DF_Raw)
+		return _disk_map_raw(d, pos, host, len);
+	if (d->format == DF_Core || d->format == DF_Records || d->format == DF_Parts)
+		return _disk_map_core(d, pos, host, len);
+
+	enum DiskRun kind = DR_Error;
+	uint64_t run = 0, mask = ((uint64_t)1 << d->cluster_bits) - 1;
+	*host = 0;
+
+	for (uint64_t at = pos; at < d->size;) {
+		uint64_t cluster = at >> d->cluster_bits;
+		uint64_t idx = cluster / d->table_len, e, span;
+
+		if (idx >= d->top_len || d->top[idx] == 0) {
+			/* There's no table for these clusters at all. */
+			e = DISK_UNALLOCATED;
+			span = ((idx + 1) * d->table_len << d->cluster_bits) - at;
+		} else {
+			uint64_t *table = _disk_table(d, idx);
+			if (table == NULL)
+				break;
+			e = table[cluster % d->table_len];
+			span = ((cluster + 1) << d->cluster_bits) - at;
+		}
+
+		if (e == DISK_COMPRESSED) {
+			if (run == 0)
+				warnx("\"%s\": compressed clusters can't be read (at 0x%llx)",
+					d->path, (unsigned long long)at);
+			break;
+		}
+
+		enum DiskRun k = e == DISK_UNALLOCATED ? DR_Unallocated
+			: e == DISK_ZEROS ? DR_Zeros : DR_Data;
+		uint64_t h = k == DR_Data ? e + (at & mask) : 0;
+
+		if (run == 0)
+			kind = k, *host = h;
+		else if (k != kind || (k == DR_Data && h != *host + run))
+			break;
+
+		span = MIN(span, d->size - at);
+		run += span, at += span;
+		if (k == DR_Data && run >= max)
+			break;
+	}
+
+	*len = run;
+	return run > 0 ? kind : DR_Error;
+}
+
+/// What a run that isn't data is called, for the line that stands for it.
+///
+static const char *
+disk_run_name(struct Disk *d, enum DiskRun kind)
+{
+	switch (kind) {
+	break; case DR_Zeros:
+		return "zeros";
+	break; case DR_Unallocated:
+		return d->format == DF_Core ? "unmapped"
+			: d->format == DF_Records ? "nothing loaded" : "unallocated";
+	break; case DR_Absent:
+		return "not in the core";
+	break; case DR_Data: case DR_Error:
+		break;
+	}
+	return "?";
+}
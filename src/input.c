@@ -0,0 +1,339 @@
+/// The input layer, which decides how to read from the input depending on what
+/// kind of file it is.
+///
+/// * Regular files and block devices are read in big chunks, since all of the data
+///   is already there and we just want to get through it as fast as possible.
+///
+/// * Anything else (terminals, pipes, serial ports, sockets, /dev/input/mouse...)
+///   is "interactive": we poll(2) for data and return whatever is available
+///   right away, instead of blocking until a full line or chunk has arrived.
+///   If part of a line has been waiting for longer than the latency set with
+///   `-w', the read times out so that the caller can display the partial line.
+///
+/// * Members of archives (see archive.c) are read with pread(2), from wherever
+///   the member is in the archive, and inflated if they need to be.
+///
+/// * Disks in images (--disk, see disk.c) are read with pread(2) from wherever
+///   each run of clusters is in the image. Runs that aren't stored read as zeros,
+///   but input_hole() lets the caller skip them instead.
+///
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define CHUNK_SZ (64 * 1024)
+
+struct Input {
+	int fd;
+	_Bool interactive;
+	_Bool eof, timed_out;
+
+	/// When the partial line the caller is holding on to must be displayed, in
+	/// milliseconds (CLOCK_MONOTONIC). Zero if there's no partial line.
+	int64_t deadline;
+
+	/// The archive member being read, if any: where the next byte of it is in the
+	/// archive, and how many are left (before inflating).
+	struct Member *member;
+	uint64_t pos, left;
+
+	/// The disk being read with --disk, if any. `pos' and `left' are then the
+	/// position on the disk, and how much of the disk is left.
+	struct Disk *disk;
+#ifdef HAVE_ZLIB
+	z_stream z;
+	byte_t *zbuf;
+#endif
+};
+
+static int64_t
+_input_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+input_open(struct Input *in, int fd)
+{
+	struct stat st;
+
+	in->fd = fd;
+	in->eof = in->timed_out = false;
+	in->deadline = 0;
+	in->member = NULL;
+	in->disk = NULL;
+	in->interactive = fstat(fd, &st) == -1
+		|| !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode));
+}
+
+#ifdef HAVE_ZLIB
+/// zlib's state only lives as long as the member is read, so it's allocated from
+/// the scratch arena, which is reset after each input.
+static voidpf
+_input_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	(void)opaque;
+	return arena_alloc(&arena_scratch, (size_t)items * size);
+}
+
+static void
+_input_zfree(voidpf opaque, voidpf ptr)
+{
+	(void)opaque, (void)ptr;
+}
+#endif
+
+/// Read the archive member `m' instead of the whole file.
+///
+static void
+input_member(struct Input *in, struct Member *m)
+{
+	in->member = m;
+	in->interactive = false;
+	in->pos = m->start;
+	in->left = m->csize;
+
+#ifdef HAVE_ZLIB
+	if (m->method == MM_Deflated) {
+		in->z = (z_stream){ .zalloc = _input_zalloc, .zfree = _input_zfree };
+		in->zbuf = arena_alloc(&arena_scratch, CHUNK_SZ);
+		if (in->zbuf == NULL || inflateInit2(&in->z, -MAX_WBITS) != Z_OK) {
+			warnx("inflate: not enough memory left in the budget");
+			in->eof = true;
+		}
+	}
+#endif
+}
+
+/// Read the disk in the image `d' instead of the image itself.
+///
+static void
+input_disk(struct Input *in, struct Disk *d)
+{
+	in->disk = d;
+	in->interactive = false;
+	in->pos = 0;
+	in->left = d->size;
+	in->eof = d->size == 0;
+}
+
+static void
+input_close(struct Input *in)
+{
+#ifdef HAVE_ZLIB
+	if (in->member && in->member->method == MM_Deflated)
+		inflateEnd(&in->z);
+#endif
+	if (in->disk)
+		disk_close(in->disk);
+	in->member = NULL;
+	in->disk = NULL;
+}
+
+static size_t
+_input_read_member(struct Input *in, byte_t *buf, size_t want)
+{
+	size_t got = 0;
+
+	if (in->eof)
+		return 0;
+
+	if (in->member->method == MM_Stored) {
+		while (got < want && in->left > 0) {
+			ssize_t r = pread(in->fd, &buf[got], (size_t)MIN(want - got, in->left),
+				(off_t)in->pos);
+			if (r == -1 && errno == EINTR)
+				continue;
+			if (r == -1)
+				warn("read");
+			if (r <= 0)
+				break;
+			got += (size_t)r, in->pos += (uint64_t)r, in->left -= (uint64_t)r;
+		}
+		in->eof = got < want || in->left == 0;
+		return got;
+	}
+
+#ifdef HAVE_ZLIB
+	in->z.next_out = buf;
+	in->z.avail_out = (uInt)want;
+
+	while (in->z.avail_out > 0) {
+		if (in->z.avail_in == 0 && in->left > 0) {
+			ssize_t r = pread(in->fd, in->zbuf, (size_t)MIN(CHUNK_SZ, in->left),
+				(off_t)in->pos);
+			if (r == -1 && errno == EINTR)
+				continue;
+			if (r <= 0) {
+				if (r == -1) warn("read");
+				in->eof = true;
+				break;
+			}
+			in->pos += (uint64_t)r, in->left -= (uint64_t)r;
+			in->z.next_in = in->zbuf;
+			in->z.avail_in = (uInt)r;
+		}
+
+		int z = inflate(&in->z, Z_NO_FLUSH);
+		if (z == Z_STREAM_END) {
+			in->eof = true;
+			break;
+		}
+		if (z != Z_OK && !(z == Z_BUF_ERROR && in->left > 0)) {
+			warnx("inflate: %s", in->z.msg ? in->z.msg : "the member is cut short");
+			in->eof = true;
+			break;
+		}
+	}
+
+	got = want - in->z.avail_out;
+#endif
+	return got;
+}
+
+static size_t
+_input_read_disk(struct Input *in, byte_t *buf, size_t want)
+{
+	size_t got = 0;
+
+	while (got < want && in->left > 0 && !in->eof) {
+		uint64_t host, run;
+		enum DiskRun kind = disk_map(in->disk, in->pos, want - got, &host, &run);
+		if (kind == DR_Error) {
+			in->eof = true;
+			break;
+		}
+
+		/* Stop short of a hole, so that huxdemp() gets to skip it (see
+		 * input_hole()). Only a read that starts in one fills it in. */
+		if (kind != DR_Data && got > 0)
+			break;
+
+		size_t n = (size_t)MIN(run, want - got);
+		if (kind != DR_Data) {
+			memset(&buf[got], 0, n);
+		} else if (!_disk_pread(in->disk, host, &buf[got], n)) {
+			in->eof = true;
+			break;
+		}
+		got += n, in->pos += n, in->left -= n;
+	}
+
+	in->eof = in->eof || in->left == 0;
+	return got;
+}
+
+/// How many bytes of the disk from where it's being read aren't stored (`*kind'
+/// says why), without reading them. Zero when there's data there.
+///
+static uint64_t
+input_hole(struct Input *in, enum DiskRun *kind)
+{
+	uint64_t host, run;
+	if (in->eof || in->left == 0)
+		return 0;
+
+	*kind = disk_map(in->disk, in->pos, 1, &host, &run);
+	if (*kind == DR_Error)
+		in->eof = true;
+	return *kind == DR_Data || *kind == DR_Error ? 0 : MIN(run, in->left);
+}
+
+/// Skip `n' bytes of an archive member or disk, returning how many were skipped.
+/// Deflated members have to be inflated to do that, into `scratch'.
+///
+static uint64_t
+input_skip(struct Input *in, uint64_t n, byte_t *scratch, size_t scratch_sz)
+{
+	if (in->disk || in->member->method == MM_Stored) {
+		n = MIN(n, in->left);
+		in->pos += n, in->left -= n;
+		return n;
+	}
+
+	uint64_t skipped = 0;
+	while (skipped < n && !in->eof)
+		skipped += _input_read_member(in, scratch, (size_t)MIN(n - skipped, scratch_sz));
+	return skipped;
+}
+
+/// Read up to `want' bytes into `buf', returning the number of bytes read.
+///
+/// `pending' tells the input layer whether the caller is holding on to a partial
+/// line. For interactive inputs, the first read with `pending' set starts the
+/// latency timer; if it runs out before any more data arrives, zero is returned
+/// and `timed_out' is set.
+///
+/// Once the input is exhausted (or can't be read from) `eof' is set.
+///
+static size_t
+input_read(struct Input *in, byte_t *buf, size_t want, _Bool pending)
+{
+	size_t got = 0;
+	in->timed_out = false;
+
+	if (in->member)
+		return _input_read_member(in, buf, want);
+	if (in->disk)
+		return _input_read_disk(in, buf, want);
+
+	if (!in->interactive) {
+		while (got < want) {
+			ssize_t r = read(in->fd, &buf[got], want - got);
+			if (r == -1 && errno == EINTR)
+				continue;
+			if (r == -1)
+				warn("read");
+			if (r <= 0) {
+				in->eof = true;
+				break;
+			}
+			got += (size_t)r;
+		}
+		return got;
+	}
+
+	if (!pending) {
+		in->deadline = 0;
+	} else if (in->deadline == 0) {
+		in->deadline = _input_now_ms() + options.latency;
+	}
+
+	for (;;) {
+		int timeout = -1;
+		if (in->deadline != 0) {
+			timeout = (int)MAX(in->deadline - _input_now_ms(), 0);
+		}
+
+		struct pollfd pfd = { .fd = in->fd, .events = POLLIN };
+		int p = poll(&pfd, 1, timeout);
+		if (p == -1 && errno == EINTR)
+			continue;
+		if (p == 0) {
+			in->timed_out = true;
+			in->deadline = 0;
+			return 0;
+		}
+
+		ssize_t r = read(in->fd, buf, want);
+		if (r == -1 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (r == -1)
+			warn("read");
+		if (r <= 0) {
+			in->eof = true;
+			return 0;
+		}
+		return (size_t)r;
+	}
+}
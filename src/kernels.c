@@ -0,0 +1,313 @@
+/// The inner loops of the byte and ASCII columns, as kernels that work on a whole
+/// line at a time: one set in plain C, and one for each kind of vector unit that
+/// the CPU might have. kernels_init() picks the fastest set that the CPU supports
+/// when huxdemp starts (or the one named with --kernel, for testing each of them),
+/// and the columns call it through `kernels'.
+///
+/// * scalar: plain C, for any CPU.
+///
+/// * sse2, ssse3, avx2: x86, 16 or 32 bytes at a time. The byte column's "xx "
+///   triplets are put together with byte shuffles where there are any (SSSE3 on);
+///   with SSE2 only the digits are, and they're spaced out one by one.
+///
+/// * neon: AArch64, where it's always there; vst3q_u8() spaces out the digits.
+///
+/// The x86 kernels are built with the target attribute, so that they don't need
+/// any compiler flags and the rest of huxdemp still runs on any x86 CPU. Every set
+/// must write exactly what the scalar one does.
+///
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+struct Kernels {
+	const char *name;
+	_Bool (*supported)(void);
+
+	/// Put the two hex digits of each of the `n' bytes at `in', each followed by
+	/// a space, in `out' (3 * `n' bytes).
+	void (*hex)(const byte_t *in, size_t n, char *out);
+
+	/// Put the `n' bytes at `in' in `out', with the ones that aren't printable
+	/// ASCII replaced by a period, as the ASCII column shows them.
+	void (*printable)(const byte_t *in, size_t n, char *out);
+};
+
+static const char kernel_digits[16] = "0123456789abcdef";
+
+static _Bool
+_kernel_always(void)
+{
+	return true;
+}
+
+static void
+_kernel_hex_scalar(const byte_t *in, size_t n, char *out)
+{
+	for (size_t i = 0; i < n; ++i, out += 3) {
+		out[0] = kernel_digits[in[i] >> 4];
+		out[1] = kernel_digits[in[i] & 15];
+		out[2] = ' ';
+	}
+}
+
+static void
+_kernel_printable_scalar(const byte_t *in, size_t n, char *out)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = in[i] >= 0x20 && in[i] < 0x7f ? (char)in[i] : '.';
+}
+
+#ifdef KERNELS_X86
+
+static _Bool
+_kernel_sse2(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static _Bool
+_kernel_ssse3(void)
+{
+	return __builtin_cpu_supports("ssse3");
+}
+
+static _Bool
+_kernel_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("sse2"))) static void
+_kernel_hex_sse2(const byte_t *in, size_t n, char *out)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f), nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0'), letters = _mm_set1_epi8('a' - '0' - 10);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16, out += 48) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+		__m128i lo = _mm_and_si128(x, mask);
+
+		/* '0' + n, and another 39 for the letters. */
+		hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+			_mm_and_si128(_mm_cmpgt_epi8(hi, nine), letters));
+		lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+			_mm_and_si128(_mm_cmpgt_epi8(lo, nine), letters));
+
+		char pairs[32];
+		_mm_storeu_si128((__m128i *)&pairs[0], _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)&pairs[16], _mm_unpackhi_epi8(hi, lo));
+		for (size_t j = 0; j < 16; ++j) {
+			out[j * 3] = pairs[j * 2];
+			out[j * 3 + 1] = pairs[j * 2 + 1];
+			out[j * 3 + 2] = ' ';
+		}
+	}
+
+	_kernel_hex_scalar(&in[i], n - i, out);
+}
+
+__attribute__((target("sse2"))) static void
+_kernel_printable_sse2(const byte_t *in, size_t n, char *out)
+{
+	const __m128i lo = _mm_set1_epi8(0x1f), hi = _mm_set1_epi8(0x7f);
+	const __m128i dots = _mm_set1_epi8('.');
+	size_t i = 0;
+
+	/* Bytes from 0x80 on are negative, and so are below 0x1f too. */
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+		__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(x, lo), _mm_cmplt_epi8(x, hi));
+		x = _mm_or_si128(_mm_and_si128(ok, x), _mm_andnot_si128(ok, dots));
+		_mm_storeu_si128((__m128i *)&out[i], x);
+	}
+
+	_kernel_printable_scalar(&in[i], n - i, &out[i]);
+}
+
+/// The shuffles that space out the 32 digits of 16 bytes (`a' has the first 16,
+/// and `b' the rest) into 48 bytes of triplets; the spaces are or'd in after.
+/// -1 picks a zero.
+///
+#define KERNEL_TRIPLETS(SET, SHUF, OR, A, B, R0, R1, R2) do { \
+	R0 = OR(SHUF(A, SET(0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10)), \
+		SET(0, 0, 32, 0, 0, 32, 0, 0, 32, 0, 0, 32, 0, 0, 32, 0)); \
+	R1 = OR(OR(SHUF(A, SET(11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1)), \
+		SHUF(B, SET(-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, 2, 3, -1, 4, 5))), \
+		SET(0, 32, 0, 0, 32, 0, 0, 32, 0, 0, 32, 0, 0, 32, 0, 0)); \
+	R2 = OR(SHUF(B, SET(-1, 6, 7, -1, 8, 9, -1, 10, 11, -1, 12, 13, -1, 14, 15, -1)), \
+		SET(32, 0, 0, 32, 0, 0, 32, 0, 0, 32, 0, 0, 32, 0, 0, 32)); \
+} while (0)
+
+#define KERNEL_SETR256(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+
+__attribute__((target("ssse3"))) static void
+_kernel_hex_ssse3(const byte_t *in, size_t n, char *out)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i digits = _mm_loadu_si128((const __m128i *)kernel_digits);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16, out += 48) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+		__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+		__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, mask));
+		__m128i a = _mm_unpacklo_epi8(hi, lo), b = _mm_unpackhi_epi8(hi, lo);
+
+		__m128i r0, r1, r2;
+		KERNEL_TRIPLETS(_mm_setr_epi8, _mm_shuffle_epi8, _mm_or_si128, a, b, r0, r1, r2);
+		_mm_storeu_si128((__m128i *)&out[0], r0);
+		_mm_storeu_si128((__m128i *)&out[16], r1);
+		_mm_storeu_si128((__m128i *)&out[32], r2);
+	}
+
+	_kernel_hex_scalar(&in[i], n - i, out);
+}
+
+/// The same, 32 bytes at a time. Shuffles don't cross the two halves of a
+/// register, and neither do the unpacks, so each half does the triplets of 16
+/// bytes, and the halves are put in order after.
+///
+__attribute__((target("avx2"))) static void
+_kernel_hex_avx2(const byte_t *in, size_t n, char *out)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	const __m256i digits = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)kernel_digits));
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32, out += 96) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&in[i]);
+		__m256i hi = _mm256_shuffle_epi8(digits,
+			_mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+		__m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, mask));
+		__m256i a = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo);
+
+		__m256i r0, r1, r2;
+		KERNEL_TRIPLETS(KERNEL_SETR256, _mm256_shuffle_epi8, _mm256_or_si256,
+			a, b, r0, r1, r2);
+		_mm256_storeu_si256((__m256i *)&out[0], _mm256_permute2x128_si256(r0, r1, 0x20));
+		_mm256_storeu_si256((__m256i *)&out[32], _mm256_permute2x128_si256(r2, r0, 0x30));
+		_mm256_storeu_si256((__m256i *)&out[64], _mm256_permute2x128_si256(r1, r2, 0x31));
+	}
+
+	/* The rest is done by code that isn't VEX-encoded, which is slow to switch
+	 * to while the upper halves of the registers are in use. */
+	_mm256_zeroupper();
+	_kernel_hex_ssse3(&in[i], n - i, out);
+}
+
+__attribute__((target("avx2"))) static void
+_kernel_printable_avx2(const byte_t *in, size_t n, char *out)
+{
+	const __m256i lo = _mm256_set1_epi8(0x1f), hi = _mm256_set1_epi8(0x7f);
+	const __m256i dots = _mm256_set1_epi8('.');
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&in[i]);
+		__m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(x, lo), _mm256_cmpgt_epi8(hi, x));
+		_mm256_storeu_si256((__m256i *)&out[i], _mm256_blendv_epi8(dots, x, ok));
+	}
+
+	_mm256_zeroupper();
+	_kernel_printable_sse2(&in[i], n - i, &out[i]);
+}
+
+#endif
+
+#ifdef KERNELS_NEON
+
+static void
+_kernel_hex_neon(const byte_t *in, size_t n, char *out)
+{
+	const uint8x16_t digits = vld1q_u8((const uint8_t *)kernel_digits);
+	const uint8x16_t mask = vdupq_n_u8(0x0f), spaces = vdupq_n_u8(' ');
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16, out += 48) {
+		uint8x16_t x = vld1q_u8(&in[i]);
+		uint8x16x3_t t = { {
+			vqtbl1q_u8(digits, vshrq_n_u8(x, 4)),
+			vqtbl1q_u8(digits, vandq_u8(x, mask)),
+			spaces,
+		} };
+		vst3q_u8((uint8_t *)out, t);
+	}
+
+	_kernel_hex_scalar(&in[i], n - i, out);
+}
+
+static void
+_kernel_printable_neon(const byte_t *in, size_t n, char *out)
+{
+	const uint8x16_t lo = vdupq_n_u8(0x20), hi = vdupq_n_u8(0x7e);
+	const uint8x16_t dots = vdupq_n_u8('.');
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t x = vld1q_u8(&in[i]);
+		uint8x16_t ok = vandq_u8(vcgeq_u8(x, lo), vcleq_u8(x, hi));
+		vst1q_u8((uint8_t *)&out[i], vbslq_u8(ok, x, dots));
+	}
+
+	_kernel_printable_scalar(&in[i], n - i, &out[i]);
+}
+
+#endif
+
+/// The sets of kernels, from the slowest to the fastest.
+static const struct Kernels kernel_sets[] = {
+	{ "scalar", _kernel_always, _kernel_hex_scalar, _kernel_printable_scalar },
+#ifdef KERNELS_X86
+	{ "sse2",   _kernel_sse2,   _kernel_hex_sse2,   _kernel_printable_sse2   },
+	{ "ssse3",  _kernel_ssse3,  _kernel_hex_ssse3,  _kernel_printable_sse2   },
+	{ "avx2",   _kernel_avx2,   _kernel_hex_avx2,   _kernel_printable_avx2   },
+#endif
+#ifdef KERNELS_NEON
+	{ "neon",   _kernel_always, _kernel_hex_neon,   _kernel_printable_neon   },
+#endif
+};
+
+/// The kernels in use; the scalar ones until kernels_init() is called.
+static struct Kernels kernels = {
+	"scalar", _kernel_always, _kernel_hex_scalar, _kernel_printable_scalar
+};
+
+/// Use the set of kernels called `name', or the fastest one the CPU supports if
+/// it's NULL. Exits with the list of the sets this CPU can use if there's no set
+/// by that name, or the CPU can't use it.
+///
+static void
+kernels_init(const char *name)
+{
+	char avail[64] = "";
+
+	for (size_t i = 0; i < ARRAY_LEN(kernel_sets); ++i) {
+		const struct Kernels *k = &kernel_sets[i];
+		if (!k->supported())
+			continue;
+		if (name == NULL || !strcmp(name, k->name)) {
+			kernels = *k;
+			if (name != NULL)
+				return;
+		}
+		snprintf(&avail[strlen(avail)], sizeof(avail) - strlen(avail), "%s%s",
+			avail[0] ? ", " : "", k->name);
+	}
+
+	if (name != NULL)
+		errx(1, "--kernel %s: not one of the kernels this CPU can use (%s)",
+			name, avail);
+}
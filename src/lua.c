@@ -4,6 +4,7 @@
 #include <lua.h>
 #include <lualib.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -13,6 +14,57 @@
 
 static lua_State *L = NULL;
 
+/// The bytes around the current line that plugins are allowed to look at, set by
+/// huxdemp() before each line is displayed. `lo' is the first byte of lookbehind,
+/// and `hi' is one past the last byte of lookahead; both point into huxdemp()'s
+/// chunk buffer, and are at most WINDOW_SZ bytes away from the line.
+///
+#define WINDOW_SZ MAX_LINELEN
+
+/// `last' is set when the line is the last one of the input.
+///
+static struct {
+	const byte_t *lo, *hi;
+	_Bool last;
+} plugin_window;
+
+/// The view passed to plugins that set `M.view = true', instead of a table of the
+/// line's bytes. It points straight into the chunk buffer, so nothing is copied;
+/// the same userdata is reused for every call, and is only valid during that call.
+///
+/// Indexing works like the table would, except that indices before 1 and after
+/// #view reach into the previous and next lines, up to the edges of the window.
+/// Anything outside the window is nil.
+///
+struct View {
+	const byte_t *line;
+	size_t len;
+	ptrdiff_t first, last;
+};
+
+#define VIEW_MT  "huxdemp.view"
+#define VIEW_REG "huxdemp.view.instance"
+
+#define COLUMNS_REG "huxdemp.columns"
+
+/// The input passed to plugins that set `M.stream = true'. Their functions are run
+/// as coroutines that are started once per file, and pull bytes out of the input
+/// with input:next(). When the current line runs out, input:next() yields, and
+/// call_plugin() moves on to the next column; the coroutine is resumed with the
+/// next line's bytes when that comes up.
+///
+/// Whatever the coroutine writes to `out' ends up in the column of the line it's
+/// working on at that moment.
+///
+struct Stream {
+	const byte_t *line;
+	size_t len, pos;
+	uint64_t offset;
+	_Bool last;
+};
+
+#define STREAM_MT "huxdemp.stream"
+
 static void
 luau_sdump(lua_State *pL)
 {
@@ -50,19 +102,269 @@ luau_panic(lua_State *pL)
 	return 0;
 }
 
+static int
+view_index(lua_State *pL)
+{
+	struct View *v = (struct View *)lua_touserdata(pL, 1);
+
+	int isnum;
+	lua_Integer i = lua_tointegerx(pL, 2, &isnum);
+	if (!isnum) {
+		lua_pushvalue(pL, 2);
+		lua_rawget(pL, lua_upvalueindex(1));
+		return 1;
+	}
+
+	if (i < v->first || i > v->last) {
+		lua_pushnil(pL);
+	} else {
+		lua_pushinteger(pL, (lua_Integer)v->line[i - 1]);
+	}
+	return 1;
+}
+
+static int
+view_len(lua_State *pL)
+{
+	struct View *v = (struct View *)lua_touserdata(pL, 1);
+	lua_pushinteger(pL, (lua_Integer)v->len);
+	return 1;
+}
+
+/// view:bounds() -> first, last: the lowest and highest valid indices.
+static int
+view_bounds(lua_State *pL)
+{
+	struct View *v = (struct View *)luaL_checkudata(pL, 1, VIEW_MT);
+	lua_pushinteger(pL, (lua_Integer)v->first);
+	lua_pushinteger(pL, (lua_Integer)v->last);
+	return 2;
+}
+
+static const struct luaL_Reg view_methods[] = {
+	{ "bounds", view_bounds },
+	{ NULL, NULL },
+};
+
+static void
+view_init(lua_State *pL)
+{
+	luaL_newmetatable(pL, VIEW_MT);
+
+	luaL_newlib(pL, view_methods);
+	lua_pushcclosure(pL, view_index, 1);
+	lua_setfield(pL, -2, "__index");
+
+	lua_pushcfunction(pL, view_len);
+	lua_setfield(pL, -2, "__len");
+
+	lua_pop(pL, 1);
+
+	lua_newuserdata(pL, sizeof(struct View));
+	luaL_setmetatable(pL, VIEW_MT);
+	lua_setfield(pL, LUA_REGISTRYINDEX, VIEW_REG);
+}
+
+static int stream_next(lua_State *pL);
+
+static int
+stream_next_k(lua_State *pL, int status, lua_KContext ctx)
+{
+	(void)status, (void)ctx;
+	return stream_next(pL);
+}
+
+/// input:next() -> byte: the next byte, or nil once the input is exhausted.
+static int
+stream_next(lua_State *pL)
+{
+	struct Stream *st = (struct Stream *)luaL_checkudata(pL, 1, STREAM_MT);
+
+	if (st->pos < st->len) {
+		lua_pushinteger(pL, (lua_Integer)st->line[st->pos++]);
+		return 1;
+	}
+
+	if (st->last) {
+		lua_pushnil(pL);
+		return 1;
+	}
+
+	return lua_yieldk(pL, 0, 0, stream_next_k);
+}
+
+/// input:left() -> number: how many bytes of the current line haven't been read.
+static int
+stream_left(lua_State *pL)
+{
+	struct Stream *st = (struct Stream *)luaL_checkudata(pL, 1, STREAM_MT);
+	lua_pushinteger(pL, (lua_Integer)(st->len - st->pos));
+	return 1;
+}
+
+/// input:size() -> number: how long the current line is.
+static int
+stream_size(lua_State *pL)
+{
+	struct Stream *st = (struct Stream *)luaL_checkudata(pL, 1, STREAM_MT);
+	lua_pushinteger(pL, (lua_Integer)st->len);
+	return 1;
+}
+
+/// input:offset() -> number: the offset of the next byte.
+static int
+stream_offset(lua_State *pL)
+{
+	struct Stream *st = (struct Stream *)luaL_checkudata(pL, 1, STREAM_MT);
+	lua_pushinteger(pL, (lua_Integer)(st->offset + st->pos));
+	return 1;
+}
+
+static const struct luaL_Reg stream_methods[] = {
+	{ "next",   stream_next },
+	{ "left",   stream_left },
+	{ "size",   stream_size },
+	{ "offset", stream_offset },
+	{ NULL, NULL },
+};
+
+static void
+stream_init(lua_State *pL)
+{
+	luaL_newmetatable(pL, STREAM_MT);
+	luaL_newlib(pL, stream_methods);
+	lua_setfield(pL, -2, "__index");
+	lua_pop(pL, 1);
+}
+
+/// The standard libraries that are only opened once a plugin uses them, either by
+/// require()ing them or by using their global. (The base library, `package' and
+/// `string' are always opened, the latter because string methods need it.)
+///
+static const struct luaL_Reg luau_lazylibs[] = {
+        { LUA_COLIBNAME,   luaopen_coroutine },
+        { LUA_TABLIBNAME,  luaopen_table },
+        { LUA_IOLIBNAME,   luaopen_io },
+        { LUA_OSLIBNAME,   luaopen_os },
+        { LUA_UTF8LIBNAME, luaopen_utf8 },
+        { LUA_MATHLIBNAME, luaopen_math },
+        { LUA_DBLIBNAME,   luaopen_debug },
+        { NULL, NULL },
+};
+
+/// __index of the globals table: open a standard library the first time its
+/// global is looked up. luaL_requiref() sets the global, so this only happens once.
+///
+static int
+luau_lazyglobal(lua_State *pL)
+{
+        const char *name = lua_tostring(pL, 2);
+        if (name == NULL)
+                return 0;
+
+        for (const struct luaL_Reg *lib = luau_lazylibs; lib->name; ++lib) {
+                if (!strcmp(name, lib->name)) {
+                        luaL_requiref(pL, lib->name, lib->func, true);
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+/// Look up an embedded plugin in the perfect hash table generated by embedc,
+/// returning its index in `embedded_files', or -1.
+///
+static int
+luau_find_embedded(const char *name)
+{
+        uint32_t h = embedded_hash(name, EMBEDDED_HASH_SEED);
+        int i = embedded_table[h & (EMBEDDED_TABLE_SZ - 1)];
+
+        if (i == -1 || strcmp(embedded_files[i].name, name))
+                return -1;
+        return i;
+}
+
+/// Loader for the embedded plugin at index `upvalue 1' of `embedded_files'.
+///
+static int
+luau_load_embedded(lua_State *pL)
+{
+        size_t i = (size_t)lua_tointeger(pL, lua_upvalueindex(1));
+        const char *data = embedded_files[i].data;
+
+        if (luaL_loadbuffer(pL, data, strlen(data), embedded_files[i].path) != LUA_OK)
+                return lua_error(pL);
+        lua_call(pL, 0, 1);
+        return 1;
+}
+
+/// A package.searchers entry for embedded plugins, which comes right after the
+/// one for package.preload (so before $LUA_PATH is searched). Since require()
+/// keeps what it loaded in package.loaded, each plugin is run at most once.
+///
+static int
+luau_search_embedded(lua_State *pL)
+{
+        const char *name = luaL_checkstring(pL, 1);
+        int i = luau_find_embedded(name);
+
+        if (i == -1) {
+                lua_pushfstring(pL, "no embedded plugin '%s'", name);
+                return 1;
+        }
+
+        lua_pushinteger(pL, (lua_Integer)i);
+        lua_pushcclosure(pL, luau_load_embedded, 1);
+        lua_pushstring(pL, embedded_files[i].path);
+        return 2;
+}
+
 static void
 luau_init(lua_State **pL)
 {
-        *pL = luaL_newstate();
+        *pL = lua_newstate(mem_lua_alloc, NULL);
         assert(*pL);
 
-        luaL_openlibs(*pL);
-        luaopen_table(*pL);
-        luaopen_string(*pL);
-        luaopen_math(*pL);
-        luaopen_io(*pL);
+        luaL_requiref(*pL, LUA_GNAME, luaopen_base, true);
+        luaL_requiref(*pL, LUA_LOADLIBNAME, luaopen_package, true);
+        luaL_requiref(*pL, LUA_STRLIBNAME, luaopen_string, true);
+        lua_pop(*pL, 3);
+
+        /* Everything else goes into package.preload, and is opened on demand. */
+        lua_getfield(*pL, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+        for (const struct luaL_Reg *lib = luau_lazylibs; lib->name; ++lib) {
+                lua_pushcfunction(*pL, lib->func);
+                lua_setfield(*pL, -2, lib->name);
+        }
+        lua_pop(*pL, 1);
+
+        /* Insert luau_search_embedded() as package.searchers[2]. */
+        lua_getglobal(*pL, LUA_LOADLIBNAME);
+        lua_getfield(*pL, -1, "searchers");
+        for (lua_Integer i = (lua_Integer)lua_rawlen(*pL, -1); i >= 2; --i) {
+                lua_rawgeti(*pL, -1, i);
+                lua_rawseti(*pL, -2, i + 1);
+        }
+        lua_pushcfunction(*pL, luau_search_embedded);
+        lua_rawseti(*pL, -2, 2);
+        lua_pop(*pL, 2);
+
+        lua_pushglobaltable(*pL);
+        lua_newtable(*pL);
+        lua_pushcfunction(*pL, luau_lazyglobal);
+        lua_setfield(*pL, -2, "__index");
+        lua_setmetatable(*pL, -2);
+        lua_pop(*pL, 1);
 
         lua_atpanic(*pL, luau_panic);
+
+        view_init(*pL);
+        stream_init(*pL);
+
+        lua_newtable(*pL);
+        lua_setfield(*pL, LUA_REGISTRYINDEX, COLUMNS_REG);
 }
 
 static void
@@ -84,13 +386,15 @@ luau_call(lua_State *pL, const char *namespace, const char *fnname, size_t nargs
 	lua_insert(pL, -nargs - 1);
 
 	/* move error func before function and args. */
-	size_t errfn_pos = (size_t)lua_gettop(pL) - nargs - 1;
+	size_t errfn_pos = (size_t)lua_gettop(pL) - nargs;
 	lua_pushcfunction(pL, luau_panic);
 	lua_insert(pL, -nargs - 2);
 
-	if (lua_pcall(pL, nargs, nret, -nargs - 2) == LUA_OK) {
-		lua_remove(pL, errfn_pos);
-	}
+	/* Running out of memory doesn't call the error function, so that's caught
+	 * here instead. */
+	if (lua_pcall(pL, nargs, nret, -nargs - 2) != LUA_OK)
+		luau_panic(pL);
+	lua_remove(pL, (int)errfn_pos);
 }
 
 static int
@@ -100,69 +404,303 @@ fake_pclose(lua_State *pL)
 	return 0;
 }
 
+/// Load the plugin for the column `name' (ignoring anything after a dash) into a
+/// global of the same name. require() finds embedded plugins (see
+/// luau_search_embedded()) before looking in $LUA_PATH, and won't load the same
+/// plugin twice.
+///
 static void
-call_plugin(size_t func_index, byte_t *buf, size_t buf_sz, size_t offset, FILE *out)
+load_plugin(const char *name)
+{
+	char *plugin = arena_strdup(&arena_process, name);
+	if (plugin == NULL)
+		errx(1, "%s: not enough memory left in the budget", name);
+	char *dash = strchr(plugin, '-');
+	if (dash) *dash = '\0';
+
+	lua_pushstring(L, (const char *)plugin);
+	luau_call(L, NULL, "require", 1, 1);
+	lua_setglobal(L, plugin);
+}
+
+/// What call_plugin() needs to know about each plugin column, worked out the first
+/// time the column is displayed.
+///
+/// If the plugin defines a columns() function, it's called once per line for all
+/// of that plugin's columns, and returns a table with a string for each of them
+/// (keyed by the name of the function that would otherwise have been called, so
+/// "main" for `foo' and "bar" for `foo-bar'). The first of the plugin's columns
+/// in `options.dfuncs' is the one that calls it, and the table is kept in
+/// COLUMNS_REG[owner] until the next line.
+///
+/// Columns of streaming plugins (see struct Stream) each have their own coroutine,
+/// which is kept in the registry under `thread'. `done' is set once it returns.
+///
+/// The `out' file handle passed to plugins is made once per column, and kept in
+/// the registry under `out_ref'. Streams get a new one (and a new input stream)
+/// with each coroutine, which are kept there under `out_ref' and `input_ref'
+/// until plugin_reset(): the plugin is free to drop its own references to them,
+/// and call_plugin() still writes to both.
+///
+struct PluginColumn {
+	_Bool init;
+	_Bool view, multi, stream;
+	size_t owner;
+	uint64_t line;
+	char plugin[sizeof(options.dfunc_names[0])];
+	const char *func;
+
+	int thread;
+	_Bool done;
+	struct Stream *input;
+	int input_ref;
+	luaL_Stream *out;
+	int out_ref;
+};
+
+static struct PluginColumn plugin_columns[ARRAY_LEN(options.dfuncs)];
+
+/// Incremented by _display_line() for each line, so that call_plugin() can tell
+/// whether a columns() table is for the current line.
+static uint64_t plugin_line;
+
+static struct PluginColumn *
+_plugin_column(size_t func_index)
 {
-	char *func_name = strdup(options.dfunc_names[func_index]);
-	char *plugin_name = func_name;
-	char *plugin_func = "main";
+	struct PluginColumn *pc = &plugin_columns[func_index];
+	if (pc->init)
+		return pc;
+
+	/* The plugin was loaded by main() (see load_plugin()); the rest is only
+	 * set up once the column is actually displayed. */
+
+	/* `out' is an io file handle, so its metatable has to exist. */
+	luaL_requiref(L, LUA_IOLIBNAME, luaopen_io, true);
+	lua_pop(L, 1);
+
+	strcpy(pc->plugin, options.dfunc_names[func_index]);
+	pc->func = "main";
 
-	char *dash = strchr(func_name, '-');
+	char *dash = strchr(pc->plugin, '-');
 	if (dash) {
 		*dash = '\0';
-		plugin_func = dash + 1;
+		pc->func = dash + 1;
 	}
 
-	lua_newtable(L);
-	for (size_t i = 0; i < buf_sz; ++i) {
-		lua_pushinteger(L, (lua_Integer)(i + 1));
-		lua_pushinteger(L, (lua_Integer)buf[i]);
-		lua_settable(L, -3);
+	lua_getglobal(L, pc->plugin);
+	lua_getfield(L, -1, "view");
+	pc->view = lua_toboolean(L, -1);
+	lua_getfield(L, -2, "columns");
+	pc->multi = lua_isfunction(L, -1);
+	lua_getfield(L, -3, "stream");
+	pc->stream = lua_toboolean(L, -1);
+	lua_pop(L, 4);
+
+	pc->thread = LUA_NOREF;
+	pc->input_ref = LUA_NOREF;
+
+	pc->out_ref = LUA_NOREF;
+	if (!pc->stream && !pc->multi) {
+		pc->out = (luaL_Stream *)lua_newuserdata(L, sizeof(luaL_Stream));
+		pc->out->closef = &fake_pclose;
+		luaL_setmetatable(L, LUA_FILEHANDLE);
+		pc->out_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 	}
 
-	lua_pushinteger(L, (lua_Integer)offset);
+	pc->owner = func_index;
+	for (size_t i = 0; i < func_index; ++i) {
+		if (options.dfuncs[i] == CO_Plugin && plugin_columns[i].init
+				&& !strcmp(plugin_columns[i].plugin, pc->plugin)) {
+			pc->owner = plugin_columns[i].owner;
+			break;
+		}
+	}
 
-	luaL_Stream *p = (luaL_Stream *)lua_newuserdata(L, sizeof(luaL_Stream));
-	p->closef = &fake_pclose;
-	p->f = out;
-	luaL_setmetatable(L, LUA_FILEHANDLE);
+	pc->line = UINT64_MAX;
+	pc->init = true;
+	return pc;
+}
 
-	luau_call(L, plugin_name, plugin_func, 3, 0);
+/// Push the line's bytes, either as a view or as a table.
+static void
+_plugin_push_line(struct PluginColumn *pc, byte_t *buf, size_t buf_sz)
+{
+	if (pc->view) {
+		lua_getfield(L, LUA_REGISTRYINDEX, VIEW_REG);
+		struct View *v = (struct View *)lua_touserdata(L, -1);
+		v->line = buf;
+		v->len = buf_sz;
+		v->first = plugin_window.lo ? -(buf - plugin_window.lo) + 1 : 1;
+		v->last = plugin_window.hi ? plugin_window.hi - buf : (ptrdiff_t)buf_sz;
+	} else {
+		lua_createtable(L, (int)buf_sz, 0);
+		for (size_t i = 0; i < buf_sz; ++i) {
+			lua_pushinteger(L, (lua_Integer)buf[i]);
+			lua_rawseti(L, -2, (lua_Integer)(i + 1));
+		}
+	}
+}
 
-	free(func_name);
+/// Forget about the coroutines of streaming plugins, so that they start over on
+/// the next file.
+///
+static void
+plugin_reset(void)
+{
+	for (size_t i = 0; i < ARRAY_LEN(plugin_columns); ++i) {
+		struct PluginColumn *pc = &plugin_columns[i];
+		if (!pc->init)
+			continue;
+		if (pc->thread != LUA_NOREF)
+			luaL_unref(L, LUA_REGISTRYINDEX, pc->thread);
+		pc->thread = LUA_NOREF;
+		pc->done = false;
+
+		if (pc->stream) {
+			luaL_unref(L, LUA_REGISTRYINDEX, pc->input_ref);
+			luaL_unref(L, LUA_REGISTRYINDEX, pc->out_ref);
+			pc->input_ref = pc->out_ref = LUA_NOREF;
+		}
+	}
 }
 
-// ---
+static void
+_call_stream(struct PluginColumn *pc, byte_t *buf, size_t buf_sz,
+		size_t offset, FILE *out, int64_t start)
+{
+	int nargs = 0;
 
-struct ReaderState {
-	char *data;
-	size_t size;
-};
+	if (pc->done)
+		return;
+
+	if (pc->thread == LUA_NOREF) {
+		lua_State *co = lua_newthread(L);
+		pc->thread = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		lua_getglobal(co, pc->plugin);
+		lua_getfield(co, -1, pc->func);
+		lua_remove(co, -2);
+		if (!lua_isfunction(co, -1))
+			errx(1, "%s.%s() isn't a function.", pc->plugin, pc->func);
+
+		pc->input = (struct Stream *)lua_newuserdata(co, sizeof(struct Stream));
+		luaL_setmetatable(co, STREAM_MT);
+		lua_pushvalue(co, -1);
+		pc->input_ref = luaL_ref(co, LUA_REGISTRYINDEX);
+
+		pc->out = (luaL_Stream *)lua_newuserdata(co, sizeof(luaL_Stream));
+		pc->out->closef = &fake_pclose;
+		luaL_setmetatable(co, LUA_FILEHANDLE);
+		lua_pushvalue(co, -1);
+		pc->out_ref = luaL_ref(co, LUA_REGISTRYINDEX);
+
+		nargs = 2;
+	}
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, pc->thread);
+	lua_State *co = lua_tothread(L, -1);
+
+	*pc->input = (struct Stream){
+		.line = buf, .len = buf_sz, .pos = 0,
+		.offset = offset, .last = plugin_window.last,
+	};
+	pc->out->f = out;
+
+	if (profile.enabled)
+		profile_enter(start);
 
-static const char *
-luau_reader(lua_State *pL, void *ud, size_t *size)
+	int nres;
+	int status = lua_resume(co, L, nargs, &nres);
+
+	if (profile.enabled)
+		profile_leave();
+
+	if (status == LUA_YIELD) {
+		lua_pop(co, nres);
+	} else if (status == LUA_OK) {
+		pc->done = true;
+	} else {
+		luau_panic(co);
+	}
+
+	lua_pop(L, 1);
+}
+
+static void
+_call_plugin(size_t func_index, byte_t *buf, size_t buf_sz, size_t offset, FILE *out)
 {
-	(void)pL;
-	struct ReaderState *state = (struct ReaderState *)ud;
-	if (state->size == 0) return NULL;
-	*size = state->size;
-	state->size = 0;
-	return state->data;
+	int64_t start = profile.enabled ? profile_now() : 0;
+
+	struct PluginColumn *pc = _plugin_column(func_index);
+	struct PluginColumn *owner = &plugin_columns[pc->owner];
+
+	if (pc->stream) {
+		_call_stream(pc, buf, buf_sz, offset, out, start);
+		return;
+	}
+
+	if (!pc->multi) {
+		_plugin_push_line(pc, buf, buf_sz);
+		lua_pushinteger(L, (lua_Integer)offset);
+
+		/* The plugin might have closed it last time. */
+		lua_rawgeti(L, LUA_REGISTRYINDEX, pc->out_ref);
+		pc->out->closef = &fake_pclose;
+		pc->out->f = out;
+
+		if (profile.enabled)
+			profile_enter(start);
+
+		luau_call(L, pc->plugin, pc->func, 3, 0);
+
+		if (profile.enabled)
+			profile_leave();
+		return;
+	}
+
+	lua_getfield(L, LUA_REGISTRYINDEX, COLUMNS_REG);
+
+	if (owner->line != plugin_line) {
+		_plugin_push_line(pc, buf, buf_sz);
+		lua_pushinteger(L, (lua_Integer)offset);
+
+		if (profile.enabled)
+			profile_enter(start);
+
+		luau_call(L, pc->plugin, "columns", 2, 1);
+
+		if (profile.enabled)
+			profile_leave();
+
+		if (!lua_istable(L, -1))
+			errx(1, "%s.columns() must return a table.", pc->plugin);
+		lua_rawseti(L, -2, (lua_Integer)pc->owner);
+		owner->line = plugin_line;
+	}
+
+	lua_rawgeti(L, -1, (lua_Integer)pc->owner);
+	lua_getfield(L, -1, pc->func);
+
+	size_t len;
+	const char *text = lua_tolstring(L, -1, &len);
+	if (text)
+		fwrite(text, 1, len, out);
+
+	lua_pop(L, 3);
 }
 
 static void
-luau_evalstring(lua_State *pL, char *name, char *origin, char *stuff)
+call_plugin(size_t func_index, byte_t *buf, size_t buf_sz, size_t offset, FILE *out)
 {
-	struct ReaderState state = { stuff, strlen(stuff) };
-	int rload = lua_load(pL, luau_reader, (void *)&state, origin, NULL);
-	if (rload != LUA_OK) luau_panic(pL);
-	int reval = lua_pcall(L, 0, LUA_MULTRET, 0);
-	if (reval != LUA_OK) luau_panic(pL);
-        lua_setglobal(pL, name);
+	PROBE3(plugin_entry, func_index, offset, buf_sz);
+	_call_plugin(func_index, buf, buf_sz, offset, out);
+	PROBE3(plugin_return, func_index, offset, buf_sz);
 }
 
 // ---
 
+// ---
+
 static int
 api_option_linewidth(lua_State *pL)
 {
@@ -185,7 +723,7 @@ api_color_for(lua_State *pL)
 static int
 api_colors_enabled(lua_State *pL)
 {
-	lua_pushboolean(pL, options._color);
+	lua_pushboolean(pL, options._color && !options.html);
         return 1;
 }
 
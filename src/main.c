@@ -65,6 +65,12 @@ enum Column {
 	CO_Ascii,
 	CO_AsciiLeft,
 	CO_AsciiRight,
+	CO_Utf16LE,
+	CO_Utf16BE,
+	CO_Utf32LE,
+	CO_Utf32BE,
+	CO_X86_64,
+	CO_Aarch64,
 	CO_Plugin,
 };
 
@@ -75,6 +81,20 @@ enum ActionMode {
 	AM_Always, AM_Auto, AM_Never
 };
 
+/// How to draw the input with -b, if at all.
+///
+enum BitmapMode {
+	BM_None, BM_Blocks, BM_Sixel
+};
+
+/// The encoding of the text columns (see text.c), in the same order as their
+/// entries in `enum Column'. -u highlights the characters of the first one, or
+/// UTF-8 ones when there isn't any.
+///
+enum TextEncoding {
+	TE_Utf8, TE_Utf16LE, TE_Utf16BE, TE_Utf32LE, TE_Utf32BE
+};
+
 /// A single struct that holds all the options for this program.
 /// `table' is set by the `-t' flag, `cntrls' is set by the `-c' flag, etc.
 ///
@@ -86,15 +106,30 @@ enum ActionMode {
 struct {
 	char **table;
 	_Bool ctrls, utf8;
+	enum TextEncoding text_enc;
+	_Bool src_offsets;
+	_Bool html;
+	_Bool disk, hex;
+	char *core;
+	_Bool join;
+	char **parts;
+	size_t parts_sz;
 
 	enum ActionMode color;
 	enum ActionMode pager;
 
+	enum BitmapMode bitmap;
+	_Bool bitmap_gray;
+
 	_Bool _color;
 
 	size_t linelen;
 	uint64_t offset;
 	uint64_t length;
+	int latency;
+
+	char *bench_plugin;
+	char *kernel;
 
 	enum Column dfuncs[255];
 	char dfunc_names[255][255];
@@ -129,9 +164,14 @@ static ssize_t utf8_state[] = { -1, -1 };
 ///   to work with. However, it does things the strictly POSIX way and refuses to
 ///   parse flags after a non-flag argument was recieved.
 ///
+/// * memory.c: The memory budget set with --memory-limit, which big buffers and
+///   the Lua heap are allocated from.
+///
 /// * builtin.c: Some builtin plugins. Basically, embedded Lua code that's evaluated
 ///   at runtime.
 ///
+/// * profile.c: The plugin profiler enabled with --profile-plugins.
+///
 /// * lua.c: Lua utility functions. Also includes the lua headers (lauxlib.h,
 ///   lua.h, etc).
 ///
@@ -141,9 +181,43 @@ static ssize_t utf8_state[] = { -1, -1 };
 /// * range.c: Utility funcs for parsing ranges (e.g., "0-3", "1,2,3-4,5", etc).
 ///   Used for parsing $HUXD_COLORS in config().
 ///
+/// * kernels.c: The inner loops of the byte and ASCII columns, in plain C and for
+///   the vector instructions of the CPU, which is asked which it has at startup.
+///
 /// * utf8.c: An extremely simple UTF8 library proudly stolen from the termbox[1]
 ///   source code.
 ///
+/// * transform.c: The input transforms set with -x (xor, base64 decoding, etc).
+///
+/// * archive.c: Finds members of tar, cpio, and zip archives (for paths like
+///   `foo.tar//bar'), so that they can be dumped without extracting them.
+///
+/// * records.c: Decodes Intel HEX and S-record images (--hex).
+///
+/// * text.c: Decodes UTF-16 and UTF-32 for the text columns (-f utf16le, etc).
+///
+/// * disasm.c: Decodes x86-64 and AArch64 instructions for the disassembly
+///   columns (-f x86_64, aarch64).
+///
+/// * disk.c: Maps the disk inside qcow2 and VMDK images (--disk), the address
+///   space in an ELF core (--core), the memory loaded by --hex images, or the
+///   parts of a split file (--join) onto the files they're in, so that the parts
+///   of the disk that aren't there can be skipped.
+///
+/// * input.c: Reads the input in big chunks, or as data arrives for interactive
+///   inputs like pipes and terminals.
+///
+/// * theme.c: Compiles the colors set by $HUXD_COLORS into escape sequences for
+///   the terminal's color depth.
+///
+/// * bitmap.c: The -b view, which draws the input as pixels instead of dumping it.
+///
+/// * slices.c: --ranges, which dumps a list of slices of each file, with coalesced
+///   reads issued concurrently.
+///
+/// * probes.h: Static probes (USDT) in the read, render, and write path, which
+///   tracers like bpftrace can attach to.
+///
 /// The C files are directly included into main.c (instead of being compiled into
 /// their own object files) because I'm too lazy to add a few more lines to the
 /// Makefile.
@@ -151,22 +225,70 @@ static ssize_t utf8_state[] = { -1, -1 };
 /// [1]: https://github.com/nsf/termbox
 ///
 #include "arg.h"
+#include "probes.h"
+#include "memory.c"
 #include "builtin.c"
+#include "profile.c"
 #include "lua.c"
 #include "tables.c"
+#include "kernels.c"
 #include "utf8.c"
 #include "range.c"
+#include "transform.c"
+#include "archive.c"
+#include "records.c"
+#include "text.c"
+#include "disasm.c"
+#include "disk.c"
+#include "input.c"
+#include "theme.c"
+#include "bench.c"
+#ifndef HUXD_NO_MAIN
+#include "bitmap.c"
+#include "slices.c"
+#endif
 
 /// This function is run before each item of the byte column is printed to update
 /// `utf8_state'.  It only actually updates `utf8_state' if either the first field
 /// is -1, or we've passed the codepoint utf8_state keeps track of.
 ///
+/// With a UTF-16 or UTF-32 text column, it's the character that the code unit at
+/// `offset' is part of that's tracked instead, and only characters outside ASCII
+/// count as more than one byte (code units of ASCII characters, and invalid ones,
+/// are tracked one byte at a time).
+///
 static inline void
-_utf8state(ssize_t offset, byte_t _char)
+_utf8state(byte_t *buf, size_t buf_sz, size_t i, ssize_t offset)
 {
-	if (utf8_state[0] == -1 || utf8_state[0]+utf8_state[1] < offset) {
-		utf8_state[0] = offset;
-		utf8_state[1] = utf8_sequence_length(_char) - 1;
+	if (utf8_state[0] != -1 && utf8_state[0]+utf8_state[1] >= offset)
+		return;
+
+	utf8_state[0] = offset;
+	utf8_state[1] = 0;
+
+	if (options.text_enc == TE_Utf8) {
+		utf8_state[1] = utf8_sequence_length(buf[i]) - 1;
+		return;
+	}
+
+	const byte_t *lo, *hi;
+	text_window(buf, buf_sz, &lo, &hi);
+
+	size_t back = (size_t)offset % text_unit_sz(options.text_enc);
+	const byte_t *p = &buf[i] - back;
+	uint32_t cp;
+	size_t len;
+	if (p < lo)
+		return;
+
+	switch (text_unit(options.text_enc, p, lo, hi, &cp, &len)) {
+	break; case TU_Char:
+		if (cp >= 0x80)
+			utf8_state[0] -= (ssize_t)back, utf8_state[1] = (ssize_t)len - 1;
+	break; case TU_Low:
+		utf8_state[0] -= (ssize_t)back + 2, utf8_state[1] = 3;
+	break; case TU_Invalid: case TU_Short:
+		break;
 	}
 }
 
@@ -207,10 +329,7 @@ _format_char(byte_t b)
 /// ---
 ///
 /// Display the byte offset in hexadecimal, padding it with up to four spaces to
-/// the left.
-///
-/// * `\x1b[37m': Display the text in light grey.
-/// * `\x1b[m':   Reset the text's color.
+/// the left, in the `offset' color of the theme (light grey by default).
 ///
 ///   40    72 69 20 61 73 20 68 c3  ab 20 68 61 64 20 73 70    │ri as h·· had sp│
 ///   50    6f 6b 65 6e 20 62 65 66  6f 72 65 20 69 6e 20 54    │oken before in T│
@@ -221,7 +340,9 @@ static void
 display_offset(size_t offset, _Bool use_color, FILE *out)
 {
 	if (use_color) {
-		fprintf(out, "\x1b[37m%4zx\x1b[m", offset);
+		theme_set(theme.offset, out);
+		fprintf(out, "%4zx", offset);
+		theme_reset(out);
 	} else {
 		fprintf(out, "%08zx", offset);
 	}
@@ -234,14 +355,14 @@ display_offset(size_t offset, _Bool use_color, FILE *out)
 /// * If we're halfway through, print a space. This splits the byte column into two
 ///   columns.
 ///
-/// * Print an escape sequence to set the background of the hex digits depending on
-///   whether it belongs to an encoded utf8 codepoint.
+/// * Switch to the byte's color from the theme, or to the UTF-8 highlight if it
+///   belongs to an encoded utf8 codepoint (and -u was passed). Nothing is printed
+///   if the previous byte had the same color.
 ///
-/// * Print the byte's hex digits, using the styling specified in tables.c.
+/// * Print the byte's hex digits.
 ///
-/// * If we're "out" of the last utf8 codepoint sequence, reset the background
-///   color; otherwise, only reset the foreground color and remove the bold
-///   formatting (if any).
+/// * If this is the last byte of a highlighted utf8 codepoint sequence, reset the
+///   colors so that the highlight doesn't spill over into the next byte.
 ///
 ///   40    72 69 20 61 73 20 68 c3  ab 20 68 61 64 20 73 70    │ri as h·· had sp│
 ///   50    6f 6b 65 6e 20 62 65 66  6f 72 65 20 69 6e 20 54    │oken before in T│
@@ -265,38 +386,58 @@ display_offset(size_t offset, _Bool use_color, FILE *out)
 ///                  printed.
 ///
 static void
-_display_byte(byte_t byte, size_t off, _Bool use_color, FILE *out)
+_display_byte(byte_t *buf, size_t buf_sz, size_t i, size_t off, const char *hex,
+	_Bool use_color, FILE *out)
 {
-	if (use_color) {
-		_utf8state((ssize_t)off, byte);
+	byte_t byte = buf[i];
 
-		size_t bg = 0, fg = styles[byte];
-		if (options.utf8 && utf8_state[1] > 0)
-			bg = 100, fg = 97;
+	if (use_color) {
+		_utf8state(buf, buf_sz, i, (ssize_t)off);
 
-		fprintf(out, "\x1b[%zum\x1b[38;5;%zum%02hx", bg, fg, byte);
+		_Bool highlight = options.utf8 && utf8_state[1] > 0;
+		theme_set(highlight ? theme.utf8 : theme.fg[byte], out);
+		fwrite(&hex[i * 3], 1, 2, out);
 
-		if (utf8_state[0] + utf8_state[1] <= (ssize_t)off)
-			fprintf(out, "\x1b[m ");
-		else
-			fprintf(out, "\x1b[37m\x1b[22m ");
+		if (highlight && utf8_state[0] + utf8_state[1] <= (ssize_t)off)
+			theme_reset(out);
+		fputc(' ', out);
 	} else {
-		fprintf(out, "%02hx ", byte);
+		fwrite(&hex[i * 3], 1, 3, out);
 	}
 }
 
+/// Display the bytes from `from' to `to' of the line, whose hex digits were put in
+/// `hex' by the hex kernel (see kernels.c). Without colors they're written all at
+/// once.
+///
+static void
+_display_bytes(byte_t *buf, size_t buf_sz, size_t from, size_t to, size_t off,
+	const char *hex, _Bool use_color, FILE *out)
+{
+	if (!use_color) {
+		fwrite(&hex[from * 3], 1, (to - from) * 3, out);
+		return;
+	}
+
+	for (size_t i = from; i < to; ++i, ++off)
+		_display_byte(buf, buf_sz, i, off, hex, use_color, out);
+}
+
 static void
 display_bytes(byte_t *buf, size_t buf_sz, size_t offset, _Bool use_color, FILE *out)
 {
-	for (size_t off = offset, i = 0; i < buf_sz; ++i, ++off) {
-		if (i == (options.linelen / 2))
-			fprintf(out, " ");
+	char hex[MAX_LINELEN * 3];
+	size_t half = options.linelen / 2;
+	kernels.hex(buf, buf_sz, hex);
 
-		_display_byte(buf[i], off, use_color, out);
+	_display_bytes(buf, buf_sz, 0, MIN(buf_sz, half), offset, hex, use_color, out);
+	if (buf_sz > half) {
+		fprintf(out, " ");
+		_display_bytes(buf, buf_sz, half, buf_sz, offset + half, hex, use_color, out);
 	}
 
 	if (use_color) {
-		fprintf(out, "\x1b[m");
+		theme_reset(out);
 	}
 
 	fprintf(out, "%*s", (int)(options.linelen - buf_sz) * 3, "");
@@ -307,14 +448,14 @@ display_bytes(byte_t *buf, size_t buf_sz, size_t offset, _Bool use_color, FILE *
 static void
 display_bytes_left(byte_t *buf, size_t buf_sz, size_t offset, _Bool use_color, FILE *out)
 {
-	for (
-		size_t off = offset, i = 0;
-		i < buf_sz && i < (options.linelen / 2);
-		++i, ++off
-	) _display_byte(buf[i], off, use_color, out);
+	char hex[MAX_LINELEN * 3];
+	size_t n = MIN(buf_sz, options.linelen / 2);
+	kernels.hex(buf, n, hex);
+
+	_display_bytes(buf, buf_sz, 0, n, offset, hex, use_color, out);
 
 	if (use_color) {
-		fprintf(out, "\x1b[m");
+		theme_reset(out);
 	}
 
 	if ((options.linelen / 2) > buf_sz) {
@@ -325,19 +466,23 @@ display_bytes_left(byte_t *buf, size_t buf_sz, size_t offset, _Bool use_color, F
 static void
 display_bytes_right(byte_t *buf, size_t buf_sz, size_t offset, _Bool use_color, FILE *out)
 {
-	for (size_t off = offset, i = options.linelen / 2; i < buf_sz; ++i, ++off)
-		_display_byte(buf[i], off, use_color, out);
+	char hex[MAX_LINELEN * 3];
+	kernels.hex(buf, buf_sz, hex);
+
+	if (buf_sz > options.linelen / 2)
+		_display_bytes(buf, buf_sz, options.linelen / 2, buf_sz, offset, hex,
+			use_color, out);
 
 	if (use_color) {
-		fprintf(out, "\x1b[m");
+		theme_reset(out);
 	}
 
 	fprintf(out, "%*s", (int)(options.linelen - buf_sz) * 3, "");
 }
 
 /// Print the usual four spaces, a nice Unicode vertical line-drawing glyph, and
-/// each character for the ASCII column styled with the escape codes specified in
-/// tables.c. Finally, add space padding.
+/// each character for the ASCII column styled with the theme's escape codes.
+/// Finally, add space padding.
 ///
 ///   40    72 69 20 61 73 20 68 c3  ab 20 68 61 64 20 73 70    │ri as h·· had sp│
 ///   50    6f 6b 65 6e 20 62 65 66  6f 72 65 20 69 6e 20 54    │oken before in T│
@@ -348,18 +493,190 @@ static void
 display_ascii(byte_t *buf, size_t buf_sz, size_t linelen, _Bool use_color, FILE *out)
 {
 	fprintf(out, "%s", use_color ? "│" : "|");
-	for (size_t i = 0; i < buf_sz; ++i) {
-		if (use_color) {
-			fprintf(out, "\x1b[38;5;%hdm%s\x1b[m",
-				styles[buf[i]], _format_char(buf[i]));
-		} else {
-			fprintf(out, "%s", _format_char(buf[i]));
+	if (!use_color && !options.ctrls && !options.table) {
+		/* Then it's just ASCII, which the printable kernel does. */
+		char text[MAX_LINELEN];
+		kernels.printable(buf, buf_sz, text);
+		fwrite(text, 1, buf_sz, out);
+	} else {
+		for (size_t i = 0; i < buf_sz; ++i) {
+			if (use_color)
+				theme_set(theme.fg[buf[i]], out);
+			theme_text(_format_char(buf[i]), out);
 		}
 	}
+	if (use_color)
+		theme_reset(out);
 	fprintf(out, "%*s", (int)(linelen - buf_sz), "");
 	fprintf(out, "%s", use_color ? "│" : "|");
 }
 
+/// Display a text column (see text.c), between the same bars as the ASCII column:
+/// the character each code unit starts, in the ASCII column's colors for ASCII
+/// characters and the UTF-8 highlight for the others. ASCII characters are shown
+/// as in the ASCII column (so -c and -t apply to them), and units that aren't
+/// valid, or characters that can't be shown, as a period.
+///
+///   00    48 00 65 00 6c 00 6c 00  6f 00 2c 00 20 00 3d d8    │Hello, 😀│
+///   10    00 de 21 00 00 d8 20 00                             │ !. │
+///                                                             ^~~~~~~~~~
+///
+/// Each line has room for as many cells as a full line has code units. Wide
+/// characters take up two columns, so a line can come out that much wider, unless
+/// the character is a surrogate pair (whose second cell it takes up).
+///
+static void
+display_text(byte_t *buf, size_t buf_sz, size_t offset, enum TextEncoding enc,
+	_Bool use_color, FILE *out)
+{
+	size_t sz = text_unit_sz(enc);
+	size_t cells = (options.linelen + sz - 1) / sz, cols = 0;
+	_Bool plain = !options.ctrls && !options.table;
+
+	const byte_t *lo, *hi;
+	text_window(buf, buf_sz, &lo, &hi);
+
+	fprintf(out, "%s", use_color ? "│" : "|");
+	for (size_t i = (sz - offset % sz) % sz; i < buf_sz; i += sz) {
+		char glyph[8];
+		size_t n;
+
+		/* Runs of ASCII don't need to be decoded. */
+		if (plain && i + 8 <= buf_sz && (n = text_ascii8(enc, &buf[i], glyph)) > 0) {
+			for (size_t j = 0; j < n && use_color; ++j) {
+				theme_set(theme.fg[(byte_t)glyph[j]], out);
+				theme_text((char[]){ glyph[j], '\0' }, out);
+			}
+			if (!use_color)
+				fwrite(glyph, 1, n, out);
+			cols += n, i += 8 - sz;
+			continue;
+		}
+
+		uint32_t cp = 0;
+		size_t len;
+		const char *text = ".";
+		char *color = theme.fg[buf[i]];
+		int width = 1;
+
+		switch (text_unit(enc, &buf[i], lo, hi, &cp, &len)) {
+		break; case TU_Char:
+			if (cp < 0x80) {
+				text = _format_char((byte_t)cp), color = theme.fg[cp];
+			} else if ((width = text_width(cp)) > 0) {
+				glyph[utf8_encode(glyph, cp)] = '\0';
+				text = glyph, color = theme.utf8;
+			} else {
+				width = 1, color = theme.utf8;
+			}
+		break; case TU_Low:
+			/* The character was shown in the cell of the first half, unless
+			 * the line ended before this half had arrived. */
+			text_unit(enc, &buf[i] - 2, lo, hi, &cp, &len);
+			if (text_carry == offset + i) {
+				text_carry = SIZE_MAX;
+				if ((width = text_width(cp)) > 0) {
+					glyph[utf8_encode(glyph, cp)] = '\0';
+					text = glyph, color = theme.utf8;
+					break;
+				}
+			}
+			width = i >= 2 && text_width(cp) == 2 ? 0 : 1;
+			text = width ? " " : "";
+		break; case TU_Short:
+			if (sz == 2 && &buf[i] + 2 <= hi && !plugin_window.last) {
+				text_carry = offset + i + 2;
+				text = " ";
+			}
+		break; case TU_Invalid:
+			break;
+		}
+
+		if (use_color)
+			theme_set(color, out);
+		theme_text(text, out);
+		cols += (size_t)width;
+	}
+	if (use_color)
+		theme_reset(out);
+	fprintf(out, "%*s", (int)(cells > cols ? cells - cols : 0), "");
+	fprintf(out, "%s", use_color ? "│" : "|");
+}
+
+/// Display a disassembly column (see disasm.c): the instructions that start on the
+/// line, separated by semicolons. Lines hold different numbers of instructions, so
+/// the column is best put last.
+///
+///   00    f3 0f 1e fa 55 48 89 e5  48 83 ec 10 89 7d fc 8b    endbr64; push rbp; mov rbp,rsp; sub rsp,0x10; mov DWORD PTR [rbp-0x4],edi; mov eax,DWORD PTR [rbp-0x4]
+///   10    45 fc 0f af c0 c9 c3                                imul eax,eax; leave; ret
+///
+/// An instruction that was cut off by the end of the last line, before the rest of
+/// it had arrived, is listed first.
+///
+static void
+display_disasm(byte_t *buf, size_t buf_sz, size_t offset, enum Column arch,
+	_Bool use_color, FILE *out)
+{
+	const byte_t *lo, *hi;
+	text_window(buf, buf_sz, &lo, &hi);
+
+	/* Start where the last instruction ended, if that's on this line (or on
+	 * the last one, and can still be looked at), or list nothing if it ends
+	 * past this line; otherwise start afresh. */
+	const byte_t *p = buf;
+	if (disasm_next != SIZE_MAX && disasm_next >= offset + buf_sz)
+		return;
+	if (disasm_next == SIZE_MAX || offset - MIN(disasm_next, offset) > (size_t)(buf - lo)) {
+		if (arch == CO_Aarch64)
+			p = buf + MIN((4 - offset % 4) % 4, buf_sz);
+	} else if (disasm_next >= offset) {
+		p = buf + (disasm_next - offset);
+	} else {
+		p = buf - (offset - disasm_next);
+	}
+
+	_x86_tables();
+
+	struct DisText t;
+	for (_Bool first = true; p < buf + buf_sz; first = false) {
+		uint64_t addr = (uint64_t)offset + (uint64_t)(p - buf);
+		size_t len;
+		t.len = 0;
+
+		if (arch == CO_X86_64) {
+			struct X86 x;
+			if ((len = x86_parse(p, (size_t)(hi - p), &x)) == 0) {
+				if (!plugin_window.last)
+					break;
+				/* The input ends in the middle of an instruction. */
+				len = (size_t)(hi - p);
+				_dis_put(&t, "(bad)");
+			} else {
+				x86_format(&x, addr, &t);
+			}
+		} else {
+			if (hi - p < 4)
+				break;
+			a64_format((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16
+				| (uint32_t)p[1] << 8 | p[0], addr, &t);
+			len = 4;
+		}
+
+		if (!first && use_color) {
+			theme_set(theme.offset, out);
+			fputs("; ", out);
+			theme_reset(out);
+		} else if (!first) {
+			fputs("; ", out);
+		}
+		t.s[t.len] = '\0';
+		theme_text(t.s, out);
+		p += len;
+	}
+
+	disasm_next = offset + (size_t)(p - buf);
+}
+
 /// A utility func to start less, and make our stdout point to less's stdin. This allows
 /// output to be piped through less automatically (kinda like `git log`).
 ///
@@ -368,6 +685,7 @@ display_ascii(byte_t *buf, size_t buf_sz, size_t linelen, _Bool use_color, FILE
 ///
 /// * The FILE* value is returned so that it can be passed to pclose() later on.
 ///
+#ifndef HUXD_NO_MAIN
 static FILE *
 pager(enum ActionMode mode)
 {
@@ -393,6 +711,105 @@ pager(enum ActionMode mode)
 
 	return pager;
 }
+#endif
+
+/// Display a plugin column. With -H, what the plugin writes is collected first, so
+/// that it can be escaped like the rest of the page.
+///
+static void
+_display_plugin(size_t i, byte_t *buf, size_t r, size_t offset, FILE *out)
+{
+	static FILE *html;
+	static char *html_buf;
+	static size_t html_sz;
+
+	if (!options.html) {
+		call_plugin(i, buf, r, offset, out);
+		return;
+	}
+
+	if (html == NULL && (html = open_memstream(&html_buf, &html_sz)) == NULL)
+		err(1, "open_memstream");
+
+	call_plugin(i, buf, r, offset, html);
+	fflush(html);
+	theme_write(html_buf, html_sz, out);
+	rewind(html);
+}
+
+/// Display a single line of input, calling each of the display functions in the
+/// order the user specified with -f.
+///
+static void
+_display_line(byte_t *buf, size_t r, size_t offset, FILE *out)
+{
+	++plugin_line;
+
+	for (size_t i = 0; i < options.dfuncs_sz; ++i) {
+		PROBE4(column_start, i, options.dfuncs[i], offset, r);
+
+		switch (options.dfuncs[i]) {
+		break; case CO_Offset:
+			display_offset(offset, options._color, out);
+		break; case CO_Bytes:
+			display_bytes(buf, r, offset, options._color, out);
+		break; case CO_BytesLeft:
+			display_bytes_left(buf, r, offset, options._color, out);
+		break; case CO_BytesRight:
+			display_bytes_right(buf, r, offset, options._color, out);
+		break; case CO_Ascii:
+			display_ascii(buf, r, options.linelen,
+				options._color, out);
+		break; case CO_AsciiLeft:
+			display_ascii(buf, MIN(r, options.linelen / 2),
+				options.linelen / 2, options._color, out);
+		break; case CO_AsciiRight:
+			;
+			size_t linelenhalf = options.linelen / 2;
+			if (r > linelenhalf) {
+				display_ascii(&buf[linelenhalf], r - linelenhalf,
+					linelenhalf, options._color, out);
+			}
+		break; case CO_Utf16LE: case CO_Utf16BE: case CO_Utf32LE: case CO_Utf32BE:
+			display_text(buf, r, offset,
+				TE_Utf16LE + (options.dfuncs[i] - CO_Utf16LE),
+				options._color, out);
+		break; case CO_X86_64: case CO_Aarch64:
+			display_disasm(buf, r, offset, options.dfuncs[i],
+				options._color, out);
+		break; case CO_Plugin:
+			_display_plugin(i, buf, r, offset, out);
+		}
+
+		PROBE4(column_end, i, options.dfuncs[i], offset, r);
+		fprintf(out, "    ");
+	}
+	fprintf(out, "\n");
+}
+
+/// Display the line that stands for the lines from `offset' to `end' that were
+/// skipped because they're in a hole of a disk image or core (see disk.c).
+///
+///   fff0    9b 42 a0 ec 4f 2d 90 4a  1c c5 32 4a e1 62 d4 b8    │×B××O-×J·×2J×b××│
+///  10000    * zeros until 20000 (65536 bytes)
+///  20000    * unallocated until 50000 (196608 bytes)
+///  50000    1a fd 33 db fb a5 1b ae  6a 93 84 bc 3b 8d 25 02    │·×3×××·×j×××;×%·│
+///
+static void
+_display_skipped(size_t offset, size_t end, const char *what, FILE *out)
+{
+	char text[128];
+	snprintf(text, sizeof(text), "* %s until %zx (%zu bytes)", what, end, end - offset);
+
+	display_offset(offset, options._color, out);
+	fprintf(out, "    ");
+	if (options._color)
+		theme_set(theme.offset, out);
+	theme_text(text, out);
+	if (options._color)
+		theme_reset(out);
+	fprintf(out, "\n");
+}
 
 /// The "main main" function that's called from main() after arguments are parsed.
 /// We just take a path, open it (if it's not stdin), and call `display*()' after
@@ -401,25 +818,103 @@ pager(enum ActionMode mode)
 static void
 huxdemp(char *path, FILE *out)
 {
-	/* Reset UTF8 state for each file. */
+	/* Reset UTF8 state and streaming plugins for each file. */
 	utf8_state[0] = utf8_state[1] = -1;
+	text_carry = SIZE_MAX;
+	disasm_next = SIZE_MAX;
+	plugin_reset();
+
+	/// Paths like `foo.tar//bar' are for a member of an archive (see archive.c).
+	struct Member member;
+	char *member_name = archive_member(path);
+	struct Input in = { .member = NULL };
+
+	size_t chunk_sz = CHUNK_SZ, buf_cap = 0;
+	byte_t *buf = NULL;
+	uint64_t *srcmap = NULL;
 
-	FILE *fp = !strcmp(path, "-") ? stdin : fopen(path, "r");
+	FILE *fp = member_name ? archive_open(path, member_name, &member)
+		: !strcmp(path, "-") ? stdin : fopen(path, "r");
 
 	if (fp == NULL) {
-		warn("\"%s\"", path);
+		if (!member_name)
+			warn("\"%s\"", path);
 		goto cleanup;
 	}
 
-	byte_t buf[MAX_LINELEN];
+	/// `buf' holds the bytes that are waiting to be displayed: a chunk read from
+	/// the input (see input.c), plus whatever partial line was left over from the
+	/// previous chunk. The first `behind' bytes have already been displayed, and
+	/// are only kept around so that plugins can look back at them.
+	///
+	/// When reading from a file, a line isn't displayed until the WINDOW_SZ bytes
+	/// after it have been read as well (or the input runs out), so that plugins
+	/// can always look ahead that far. Interactive inputs don't wait for those.
+	///
+	/// `srcmap' holds the offset in the source of each byte in `buf', and is only
+	/// allocated when the user asked for offsets in source space (-X).
+	///
+	/// Both come out of the memory budget. They don't take more than half of what's
+	/// left of it, so that there's room for plugins; if a whole chunk doesn't fit,
+	/// smaller chunks are read instead.
+	///
+	size_t per_byte = options.src_offsets ? 1 + sizeof(uint64_t) : 1;
+
+	while (chunk_sz > MAX_LINELEN
+			&& (WINDOW_SZ + chunk_sz + MAX_LINELEN + WINDOW_SZ) * per_byte > mem_left() / 2)
+		chunk_sz /= 2;
+
+	for (;; chunk_sz /= 2) {
+		buf_cap = WINDOW_SZ + chunk_sz + MAX_LINELEN + WINDOW_SZ;
+		buf = mem_alloc(buf_cap);
+		if (buf && options.src_offsets) {
+			srcmap = mem_alloc(buf_cap * sizeof(srcmap[0]));
+			if (srcmap == NULL) {
+				mem_free(buf, buf_cap);
+				buf = NULL;
+			}
+		}
+		if (buf || chunk_sz <= MAX_LINELEN) break;
+	}
+
+	if (buf == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", path);
+		goto cleanup;
+	}
+	if (chunk_sz < CHUNK_SZ)
+		++memory.shrunk;
+
+	size_t buf_sz = 0, behind = 0;
 	size_t offset = 0;
 
+	input_open(&in, fileno(fp));
+	if (member_name)
+		input_member(&in, &member);
+
+	if (options.disk) {
+		struct Disk *d = NULL;
+		if (member_name)
+			warnx("\"%s\": %s can't be used on archive members", path,
+				options.join ? "--join" : options.core ? "--core"
+				: options.hex ? "--hex" : "--disk");
+		else if (options.join)
+			d = disk_join(options.parts, options.parts_sz);
+		else
+			d = disk_open(fileno(fp), path, options.core ? DO_Core
+				: options.hex ? DO_Records : DO_Image);
+		if (d == NULL)
+			goto cleanup;
+		input_disk(&in, d);
+	}
+
 	/// Determine the offset to start at. By default it's zero, but if the -s option is
 	/// passed we try to seek forward in the stream to that offset.
 	///
 	/// TODO: check that the provided offset isn't negative, etc
 	///
-	if (options.offset != 0) {
+	if (options.offset != 0 && (member_name || in.disk)) {
+		offset = input_skip(&in, options.offset, buf, buf_cap);
+	} else if (options.offset != 0) {
 		int r = fseek(fp, (long)options.offset, SEEK_SET);
 		if (r == -1) {
 			warn("\"%s\": Couldn't seek to offset %ld",
@@ -433,61 +928,135 @@ huxdemp(char *path, FILE *out)
 		}
 	}
 	/// start_offset is used to determine when to stop reading from the file when the -n
-	/// option is passed.
+	/// option is passed. src_offset is the position in the input, which is the same as
+	/// `offset' unless a decoding transform is in use.
 	size_t start_offset = offset;
+	size_t src_offset = offset;
+
+	transform_reset(offset);
 
-	/// Main loop. Erase buffer, read as much bytes as we can (and stop if we can't or
-	/// shouldn't read any more), and close the stream afterwards.
-	for (size_t r = 0; ;) {
-		memset(buf, 0x0, sizeof(buf));
+	/* Decoded bytes are counted from where decoding starts, not from where
+	 * they were read (see -X). */
+	if (transform_decodes())
+		offset = 0;
 
-		size_t max_read = options.linelen;
+	/// Main loop. Read as much bytes as we can, run them through the transforms (if
+	/// any), and display each full line. Once we can't or shouldn't read any more,
+	/// display whatever is left and close the stream afterwards.
+	///
+	/// If the read timed out, a partial line has been waiting for too long, so it's
+	/// displayed as-is.
+	for (_Bool eof = false; !eof;) {
+		size_t max_read = chunk_sz;
+		uint64_t bytes_left = UINT64_MAX;
 		if (options.length > 0) {
-			size_t bytes_left = options.length - (offset - start_offset);
-			max_read = MIN(options.linelen, bytes_left);
+			bytes_left = options.length - (src_offset - start_offset);
+			max_read = MIN(max_read, bytes_left);
 		}
 
-		if (!(r = fread(buf, 1, max_read, fp)))
-			break;
+		/// With --disk, --core, or --hex, the lines that are entirely inside a hole
+		/// in the disk or address space (see disk.c) aren't read, but replaced
+		/// with a single line that says what was skipped. The line that the hole
+		/// starts in is finished with zeros, and displayed along with everything
+		/// before it first. Holes that are only a line or so long are read like
+		/// the rest.
+		size_t skip_to = 0;
+		enum DiskRun hole_kind = DR_Unallocated;
+		uint64_t hole = in.disk && max_read > 0
+			? MIN(input_hole(&in, &hole_kind), bytes_left) : 0;
+
+		if (hole > 0) {
+			size_t len = options.linelen, end = src_offset + hole;
+			size_t skip_from = start_offset
+				+ (src_offset - start_offset + len - 1) / len * len;
+
+			skip_to = hole == bytes_left || hole == in.left ? end
+				: start_offset + (end - start_offset) / len * len;
+			if (skip_to < skip_from + 2 * len)
+				skip_to = 0;
+			else
+				max_read = skip_from - src_offset;
+		}
 
-		for (size_t i = 0; i < options.dfuncs_sz; ++i) {
-			switch (options.dfuncs[i]) {
-			break; case CO_Offset:
-				display_offset(offset, options._color, out);
-			break; case CO_Bytes:
-				display_bytes(buf, r, offset, options._color, out);
-			break; case CO_BytesLeft:
-				display_bytes_left(buf, r, offset, options._color, out);
-			break; case CO_BytesRight:
-				display_bytes_right(buf, r, offset, options._color, out);
-			break; case CO_Ascii:
-				display_ascii(buf, r, options.linelen,
-					options._color, out);
-			break; case CO_AsciiLeft:
-				display_ascii(buf, MIN(r, options.linelen / 2),
-					options.linelen / 2, options._color, out);
-			break; case CO_AsciiRight:
-				;
-				size_t linelenhalf = options.linelen / 2;
-				if (r > linelenhalf) {
-					display_ascii(&buf[linelenhalf], r - linelenhalf,
-						linelenhalf, options._color, out);
-				}
-			break; case CO_Plugin:
-				call_plugin(i, buf, r, offset, out);
-			}
+		size_t r = 0;
+		if (max_read > 0) {
+			PROBE2(read_start, src_offset, max_read);
+			r = input_read(&in, &buf[buf_sz], max_read, buf_sz > behind);
+			PROBE2(read_end, src_offset, r);
+		}
+		eof = (max_read == 0 && skip_to == 0) || in.eof;
+
+		if (options.src_offsets) {
+			for (size_t i = 0; i < r; ++i)
+				srcmap[buf_sz + i] = src_offset + i;
+		}
+		src_offset += r;
 
-			fprintf(out, "    ");
+		if (transforms_sz > 0) {
+			r = transform_apply(&buf[buf_sz], r,
+				options.src_offsets ? &srcmap[buf_sz] : NULL);
 		}
-		fprintf(out, "\n");
+		buf_sz += r;
+
+		_Bool flush = eof || in.timed_out || skip_to > 0;
+		size_t ahead = in.interactive ? 0 : WINDOW_SZ;
+
+		size_t line = behind;
+		while (buf_sz - line >= options.linelen + ahead || (flush && line < buf_sz)) {
+			size_t n = MIN(options.linelen, buf_sz - line);
+			size_t line_offset = options.src_offsets ? srcmap[line] : offset;
+
+			plugin_window.lo = &buf[line - MIN(line, WINDOW_SZ)];
+			plugin_window.hi = &buf[MIN(buf_sz, line + n + WINDOW_SZ)];
+			plugin_window.last = eof && line + n == buf_sz;
+			_display_line(&buf[line], n, line_offset, out);
 
-		offset += r;
+			offset += n;
+			line += n;
+		}
+
+		if (line > behind) {
+			size_t keep = MIN(line, WINDOW_SZ);
+			buf_sz -= line - keep;
+			memmove(buf, &buf[line - keep], buf_sz);
+			if (srcmap)
+				memmove(srcmap, &srcmap[line - keep], buf_sz * sizeof(srcmap[0]));
+			behind = keep;
+
+			/* Whatever's left is a new partial line, so restart its timer. */
+			in.deadline = 0;
+
+			if (in.interactive) {
+				PROBE1(flush_start, offset);
+				fflush(out);
+				PROBE1(flush_end, offset);
+			}
+		}
+
+		if (skip_to > 0) {
+			_display_skipped(offset, skip_to, disk_run_name(in.disk, hole_kind), out);
+			input_skip(&in, skip_to - src_offset, buf, buf_cap);
+			offset = src_offset = skip_to;
+			buf_sz = behind = 0;
+
+			/* Whatever was going on before the hole is over. */
+			utf8_state[0] = utf8_state[1] = -1;
+			text_carry = SIZE_MAX;
+			disasm_next = SIZE_MAX;
+			plugin_reset();
+		}
 	}
 
 cleanup:
+	input_close(&in);
 	if (fp != NULL && fp != stdin)
 		fclose(fp);
 
+	mem_free(buf, buf_cap);
+	arena_reset(&arena_scratch);
+	if (srcmap)
+		mem_free(srcmap, buf_cap * sizeof(srcmap[0]));
+
 	fprintf(out, "\n");
 }
 
@@ -500,6 +1069,7 @@ cleanup:
 /// * If $TERM is NULL or is set to "dumb", then no colors.
 /// * Otherwise, enable colors.
 ///
+#ifndef HUXD_NO_MAIN
 static _Bool
 _decide_color(void)
 {
@@ -522,20 +1092,21 @@ _decide_color(void)
 
 	return true;
 }
+#endif
 
-/// Parse a config string and apply to the `styles` table in tables.c.
+/// Parse a config string and apply to the `styles` table (and the theme, for the
+/// colors that don't fit in it).
 ///
 static void
 config(const char *config_str)
 {
 	// Copy the (constant) argument to our own buffer, since we're going to modify it
 	// with strsep when splitting it.
-	char *conf_buf = malloc(strlen(config_str) + 1);
+	char *conf_buf = arena_strdup(&arena_process, config_str);
 	if (conf_buf == NULL) {
-		warn("Please hit Alt+F4 a few times");
+		warnx("Please hit Alt+F4 a few times");
 		return;
 	}
-	strcpy(conf_buf, config_str);
 
 	// Now the actual parsing.
 	//
@@ -554,6 +1125,43 @@ config(const char *config_str)
 		char *lhand = statement;
 		char *rhand = eql + 1;
 
+		// Parse the right-hand side of the config statement. We do our own base detection
+		// because we don't want "0300" to be parsed as an octal (the only true way to do
+		// it is "0o300").
+		//
+		// "#rrggbb" sets a truecolor instead of a palette entry. The closest palette
+		// entry is still stored in `styles' for terminals (and plugins) that can't use
+		// it (see theme.c).
+		//
+		// FIXME: we don't reject invalid numbers here (but trailing whitespace should be
+		// OK).
+		uint32_t color;
+		if (*rhand == '#') {
+			char *end;
+			color = THEME_RGB | (uint32_t)strtoul(rhand + 1, &end, 16);
+			if (end - rhand != 7) {
+				warnx("Couldn't parse config: '%s' is not a #rrggbb color", rhand);
+				return;
+			}
+		} else {
+			size_t base = 10;
+			if (!strncmp(rhand, "0o", 2)) base = 8,  rhand += 2;
+			if (!strncmp(rhand, "0x", 2)) base = 16, rhand += 2;
+			if (!strncmp(rhand, "0b", 2)) base = 2,  rhand += 2;
+			size_t rhand_num = strtol(rhand, NULL, base);
+
+			if (rhand_num > 255) {
+				warnx("Couldn't parse config: '%ld' is out of range (only 255 colors!)", rhand_num);
+				return;
+			}
+			color = (uint32_t)rhand_num;
+		}
+
+		// A few statements set the colors of things other than bytes.
+		if (!strcmp(lhand, "offset"))  { theme_colors[TS_Offset] = color; continue; }
+		if (!strcmp(lhand, "utf8-fg")) { theme_colors[TS_Utf8Fg] = color; continue; }
+		if (!strcmp(lhand, "utf8-bg")) { theme_colors[TS_Utf8Bg] = color; continue; }
+
 		// Pre-defined strings are expanded to pre-defined ranges to make configuring this
 		// lame program slightly less painful.
 		char *range = lhand;
@@ -578,52 +1186,43 @@ config(const char *config_str)
 			return;
 		}
 
-		// Parse the right-hand side of the config statement. We do our own base detection
-		// because we don't want "0300" to be parsed as an octal (the only true way to do
-		// it is "0o300").
-		//
-		// FIXME: we don't reject invalid numbers here (but trailing whitespace should be
-		// OK).
-		size_t base = 10;
-		if (!strncmp(rhand, "0o", 2)) base = 8,  rhand += 2;
-		if (!strncmp(rhand, "0x", 2)) base = 16, rhand += 2;
-		if (!strncmp(rhand, "0b", 2)) base = 2,  rhand += 2;
-		size_t rhand_num = strtol(rhand, NULL, base);
-
-		if (rhand_num > 255) {
-			warnx("Couldn't parse config: '%ld' is out of range (only 255 colors!)", rhand_num);
-			return;
-		}
-
 		// Finally, apply the config statement.
 		for (size_t i = 0; i < (size_t)range_len; ++i) {
-			styles[range_out[i]] = (uint8_t)rhand_num;
+			styles[range_out[i]] = theme_nearest(color, 0, 256);
+			theme_colors[range_out[i]] = (color & THEME_RGB) ? color : 0;
 		}
 	}
 }
 
 /// Print a usage string and exit.
 ///
+#ifndef HUXD_NO_MAIN
 static _Noreturn void
 _usage(char *argv0)
 {
 	printf("Usage: %s [-hV]\n", argv0);
-	printf("       %s [-cu] [-n length] [-s offset] [-l bytes] [-t table]\n", argv0);
-	printf("       %*s [-f format] [-C color?] [-P pager?] [FILE]...\n",
+	printf("       %s [-cuHX] [-n length] [-s offset] [-l bytes] [-t table]\n", argv0);
+	printf("       %*s [-f format] [-x transforms] [-w latency] [-C color?]\n",
 		(int)strlen(argv0), "");
+	printf("       %*s [-b bitmap] [-P pager?] [FILE]...\n", (int)strlen(argv0), "");
 	printf("\n");
 	printf("Flags:\n");
 	printf("    -c  Use Unicode glyphs to display the lower control\n");
 	printf("        chars (0 to 31). E.g. ␀ for NUL, ␖ for SYN (0x16), &c\n");
 	printf("    -u  Highlight sets of bytes that 'belong' to the same UTF-8\n");
 	printf("        encoded Unicode character.\n");
+	printf("    -H  Output an HTML document instead of terminal escape sequences.\n");
+	printf("    -X  Display offsets in the input instead of offsets in the\n");
+	printf("        transformed bytes (see -x).\n");
 	printf("    -h  Print this help message and exit.\n");
 	printf("    -V  Print huxd's version and exit.\n");
 	printf("\n");
 	printf("Options:\n");
 	printf("    -f  Change info columns to display. (default: \"offset,bytes,ascii\")\n");
 	printf("        Possible values: `offset', `bytes', `bytes-left', `bytes-right',\n");
-	printf("                         `ascii', `ascii-left', `ascii-right'.\n");
+	printf("                         `ascii', `ascii-left', `ascii-right',\n");
+	printf("                         `utf16le', `utf16be', `utf32le', `utf32be',\n");
+	printf("                         `x86_64', `aarch64'.\n");
 	printf("        Using a value not in the above list will make huxd look for a\n");
 	printf("        plugin by that name (with a trailing dash and text trimmed off).\n");
 	printf("        Example: 'foo' will load plugin foo.lua, as will 'foo-bar'.\n");
@@ -632,11 +1231,51 @@ _usage(char *argv0)
 	printf("    -s  Number of bytes to skip from the start of the input. (default: 0)\n");
 	printf("    -t  What 'table' or style to use.\n");
 	printf("        Possible values: `default', `cp437', or `classic'.\n");
+	printf("    -x  Transform the input before displaying it. Comma-separated list\n");
+	printf("        of `xor:KEY', `add:N', `sub:N', `rol:N', `ror:N', `base64', `hex'.\n");
+	printf("        Example: 'base64,xor:5a' decodes base64, then xors with 0x5a.\n");
+	printf("    -w  Milliseconds to wait for the rest of a line from a pipe or\n");
+	printf("        terminal before displaying what's arrived. (default: 100)\n");
+	printf("    -b  Draw the input as an image, one pixel per block of bytes.\n");
+	printf("        Possible values: `blocks', `sixel', `blocks:gray', `sixel:gray'.\n");
 	printf("    -C  When to use fancy terminal formatting.\n");
 	printf("        Possible values: `auto', `always', `never'.\n");
 	printf("    -P  When to run the output through a less(1).\n");
 	printf("        Possible values: `auto', `always', `never'.\n");
 	printf("\n");
+	printf("Long options:\n");
+	printf("    --profile-plugins[=N]\n");
+	printf("        Sample plugins every N Lua instructions (default: 1000), and\n");
+	printf("        print a profile to stderr on exit.\n");
+	printf("    --memory-limit SIZE\n");
+	printf("        Keep buffers and the Lua heap within SIZE bytes (e.g. 512k,\n");
+	printf("        16M; 0 for no limit), using smaller buffers if need be, and\n");
+	printf("        print the peak usage to stderr on exit.\n");
+	printf("    --ranges LIST\n");
+	printf("        Dump only the given slices of each file, each with a header.\n");
+	printf("        LIST is separated by commas, with each slice given as\n");
+	printf("        `START+LENGTH' or `START-END' (inclusive); `@FILE' reads\n");
+	printf("        the list from FILE. Example: '0x100+64,0x4000-0x40ff'.\n");
+	printf("    --disk\n");
+	printf("        Dump the disk inside qcow2 and VMDK images instead of the\n");
+	printf("        image, skipping over the parts of it that aren't stored.\n");
+	printf("    --core FILE\n");
+	printf("        Dump the memory in the ELF core FILE by virtual address:\n");
+	printf("        -s and -n take addresses, and unmapped memory is skipped.\n");
+	printf("    --hex\n");
+	printf("        Read each FILE as Intel HEX or S-records, and dump the bytes\n");
+	printf("        they load by address, skipping the gaps between them.\n");
+	printf("    --join\n");
+	printf("        Dump the FILEs as the parts of one file, in the order given\n");
+	printf("        (e.g. `--join dump.*'); -s and -n go straight to their part.\n");
+	printf("    --kernel NAME\n");
+	printf("        Use the NAME kernels (`scalar', `sse2', `ssse3', `avx2', or\n");
+	printf("        `neon') instead of the fastest ones the CPU supports.\n");
+	printf("    --bench-plugin NAME\n");
+	printf("        Run the plugin column NAME over generated inputs (of -n bytes\n");
+	printf("        each, default: 1 MiB), report its speed and garbage, and check\n");
+	printf("        that every line it writes is as wide as it claims.\n");
+	printf("\n");
 	printf("Arguments are processed in the same way that cat(1) does: any\n");
 	printf("arguments are treated as files and read, a lone \"-\" causes huxd\n");
 	printf("to read from standard input, &c.\n");
@@ -644,10 +1283,30 @@ _usage(char *argv0)
 	printf("See the manpage huxd(1) for more documentation.\n");
 	exit(0);
 }
+#endif
+
+/// arg.h hands long options (--foo, --foo=bar, --foo bar) to us as a "-" flag,
+/// with LNGARG() pointing at "-foo". LONGARGF() gets the argument of a long
+/// option, like EARGF() does for short ones.
+///
+#define LONGARGF(LONGARG, X) \
+	((LONGARG) ? (LONGARG) : argv[1] ? (argc--, argv++, argv[0]) : ((X), abort(), (char *)0))
 
 ///
 /// main main main
 ///
+/// A color config that's evaluated by config() (before $HUXD_COLORS) to set the
+/// default colors.
+///
+static const char *default_colors =
+	"printable=15;blackspace=1;nul=8;whitespace=8;128-255=3;1-8=6;11-31=6";
+
+/// microbench.c includes this file with HUXD_NO_MAIN defined, to get everything
+/// but main(). What only main() uses (the pager, -b, --ranges, option parsing,
+/// and the reports printed on exit) is left out along with it, here and in the
+/// other files, under the same #ifndef.
+///
+#ifndef HUXD_NO_MAIN
 int
 main(int argc, char *argv[])
 {
@@ -658,20 +1317,17 @@ main(int argc, char *argv[])
 	//
 	options.table = (char **)&t_default;
 	options.ctrls = options.utf8 = false;
+	options.src_offsets = false;
 	options.color = options.pager = AM_Auto;
 	options.linelen = 16;
 	options.offset = 0;
 	options.length = 0;
+	options.latency = 100;
 	options.dfuncs[0] = CO_Offset;
 	options.dfuncs[1] = CO_Bytes;
 	options.dfuncs[2] = CO_Ascii;
 	options.dfuncs_sz = 3;
 
-	// A color config that's evaluated by config() (before $HUXD_COLORS) to set the
-	// default colors.
-	char *default_colors =
-		"printable=15;blackspace=1;nul=8;whitespace=8;128-255=3;1-8=6;11-31=6";
-
 	// Initialize Lua. (We're doing this now, instead of later, because we'll be
 	// loading lua files during arg parsing.)
 	luau_init(&L);
@@ -684,10 +1340,10 @@ main(int argc, char *argv[])
 	break; case 'f':
 		/* clear old dfuncs */
 		memset(options.dfuncs, 0x0, options.dfuncs_sz * sizeof(options.dfuncs[0]));
+		options.text_enc = TE_Utf8;
 		options.dfuncs_sz = 0;
 
 		optarg = EARGF(_usage(argv0));
-		char *orig_optarg = strdup(optarg);
 		char *ptr = optarg;
 
 		for (size_t i = 0; ptr;) {
@@ -716,36 +1372,29 @@ main(int argc, char *argv[])
 				options.dfuncs[i] = CO_AsciiLeft;
 			else if (!strcmp(column, "ascii-right"))
 				options.dfuncs[i] = CO_AsciiRight;
+			else if (!strcmp(column, "utf16le"))
+				options.dfuncs[i] = CO_Utf16LE;
+			else if (!strcmp(column, "utf16be"))
+				options.dfuncs[i] = CO_Utf16BE;
+			else if (!strcmp(column, "utf32le"))
+				options.dfuncs[i] = CO_Utf32LE;
+			else if (!strcmp(column, "utf32be"))
+				options.dfuncs[i] = CO_Utf32BE;
+			else if (!strcmp(column, "x86_64"))
+				options.dfuncs[i] = CO_X86_64;
+			else if (!strcmp(column, "aarch64"))
+				options.dfuncs[i] = CO_Aarch64;
 			else {
-				char *dash = strchr(column, '-');
-				if (dash) *dash = '\0';
-
-				_Bool found_embedded = false;
-				for (size_t i = 0; i < ARRAY_LEN(embedded_files); ++i) {
-					if (!strcmp(column, embedded_files[i].name)) {
-						luau_evalstring(L,
-							embedded_files[i].name,
-							embedded_files[i].path,
-							embedded_files[i].data
-						);
-						found_embedded = true;
-					}
-				}
-
-				if (!found_embedded) {
-					lua_pushstring(L, (const char *)column);
-					luau_call(L, NULL, "require", 1, 1);
-					lua_setglobal(L, column);
-				}
-
 				options.dfuncs[i] = CO_Plugin;
 			}
 
+			if (options.dfuncs[i] >= CO_Utf16LE && options.dfuncs[i] <= CO_Utf32BE
+					&& options.text_enc == TE_Utf8)
+				options.text_enc = TE_Utf16LE + (options.dfuncs[i] - CO_Utf16LE);
+
 			++i;
 			options.dfuncs_sz = i;
 		}
-
-		free(orig_optarg);
 	break; case 'l':
 		optarg = EARGF(_usage(argv0));
 		options.linelen = strtol(optarg, NULL, 0);
@@ -756,14 +1405,37 @@ main(int argc, char *argv[])
 		}
 	break; case 's':
 		optarg = EARGF(_usage(argv0));
-		options.offset = strtol(optarg, NULL, 0);
+		options.offset = strtoull(optarg, NULL, 0);
 	break; case 'n':
 		optarg = EARGF(_usage(argv0));
 		options.length = strtol(optarg, NULL, 0);
+	break; case 'w':
+		optarg = EARGF(_usage(argv0));
+		options.latency = MAX(strtol(optarg, NULL, 0), 0);
+	break; case 'b':
+		optarg = EARGF(_usage(argv0));
+		options.bitmap_gray = strstr(optarg, ":gr") != NULL;
+		if (!strncmp(optarg, "bl", 2))
+			options.bitmap = BM_Blocks;
+		else if (!strncmp(optarg, "si", 2))
+			options.bitmap = BM_Sixel;
+		else
+			_usage(argv0);
 	break; case 'c':
 		options.ctrls = !options.ctrls;
 	break; case 'u':
 		options.utf8  = !options.utf8;
+	break; case 'x':
+		optarg = EARGF(_usage(argv0));
+		for (char *ptr = optarg; ptr;) {
+			char *stage = strsep(&ptr, ",");
+			if (*stage == '\0') continue;
+			transform_add(stage);
+		}
+	break; case 'X':
+		options.src_offsets = !options.src_offsets;
+	break; case 'H':
+		options.html = !options.html;
 	break; case 't':
 		optarg = EARGF(_usage(argv0));
 		if (!strncmp(optarg, "cp", 2))
@@ -794,6 +1466,36 @@ main(int argc, char *argv[])
 			options.color = AM_Never;
 		else
 			_usage(argv0);
+	break; case '-':
+		brk_ = 1;
+		char *longopt = LNGARG() + 1;
+		char *longarg = strchr(longopt, '=');
+		if (longarg) *longarg++ = '\0';
+
+		if (!strcmp(longopt, "profile-plugins")) {
+			profile.period = longarg ? (int)strtol(longarg, NULL, 0) : 0;
+			profile.enabled = true;
+		} else if (!strcmp(longopt, "bench-plugin")) {
+			options.bench_plugin = LONGARGF(longarg, _usage(argv0));
+		} else if (!strcmp(longopt, "kernel")) {
+			options.kernel = LONGARGF(longarg, _usage(argv0));
+		} else if (!strcmp(longopt, "memory-limit")) {
+			memory.limit = mem_parse_size(LONGARGF(longarg, _usage(argv0)));
+			memory.report = true;
+		} else if (!strcmp(longopt, "ranges")) {
+			slices_add(LONGARGF(longarg, _usage(argv0)));
+		} else if (!strcmp(longopt, "disk")) {
+			options.disk = true;
+		} else if (!strcmp(longopt, "join")) {
+			options.join = true;
+		} else if (!strcmp(longopt, "hex")) {
+			options.hex = options.disk = true;
+		} else if (!strcmp(longopt, "core")) {
+			options.core = LONGARGF(longarg, _usage(argv0));
+			options.disk = true;
+		} else {
+			_usage(argv0);
+		}
 	break; case 'v': case 'V':
 		printf("huxd v"VERSION"\n");
 		return 0;
@@ -801,29 +1503,129 @@ main(int argc, char *argv[])
 		_usage(argv0);
 	} ARGEND
 
+	// The -b view is drawn with escape sequences or sixels, which have no place in
+	// a web page.
+	if (options.html && options.bitmap != BM_None)
+		errx(1, "-H can't be used with -b.");
+
 	// Now check whether we can use colors, depending on the user's input
 	// (if any). If so, set default colors and parse environment variables.
-	options._color = _decide_color();
+	//
+	// The -b view is nothing but colors, so it always needs them. HTML output always
+	// uses them too, since they're just CSS classes there.
+	options._color = options.html || _decide_color();
 
-	if (options._color) {
+	if (options._color || options.bitmap != BM_None) {
 		config(default_colors);
 		config(getenv("HUXD_COLORS") ?: "");
+		theme_compile(options.html ? CD_Html : theme_depth());
+	}
+
+	// Blocks are drawn with nothing but their colors, which a monochrome terminal
+	// doesn't have.
+	if (options.bitmap == BM_Blocks && theme.depth == CD_Mono)
+		errx(1, "-b blocks needs a terminal with colors (see $TERM).");
+
+	// Slices are offsets into the file itself, so they don't mix with the options
+	// that change which bytes are read or how they're displayed.
+	if (slices_sz > 0) {
+		if (options.offset || options.length)
+			errx(1, "--ranges can't be used with -s or -n.");
+		if (transforms_sz > 0)
+			errx(1, "--ranges can't be used with -x.");
+		if (options.bitmap != BM_None)
+			errx(1, "--ranges can't be used with -b.");
+		slices_finish();
+	}
+
+	// --join reads its parts through disk.c, as a disk without holes.
+	if (options.join) {
+		if (options.disk)
+			errx(1, "--join can't be used with --disk, --core, or --hex.");
+		if (argc == 0)
+			errx(1, "--join needs the FILEs to join.");
+		options.disk = true;
+		options.parts = argv, options.parts_sz = (size_t)argc;
+	}
+
+	// Offsets are on the disk with --disk (and addresses with --core and --hex),
+	// and holes in it are skipped over, which transforms and the other views can't
+	// follow.
+	if (options.disk) {
+		const char *opt = options.join ? "--join" : options.core ? "--core"
+			: options.hex ? "--hex" : "--disk";
+		if (options.core && options.hex)
+			errx(1, "--core can't be used with --hex.");
+		if (transforms_sz > 0 && !options.join)
+			errx(1, "%s can't be used with -x.", opt);
+		if (options.bitmap != BM_None || slices_sz > 0)
+			errx(1, "%s can't be used with -b or --ranges.", opt);
+		if (options.core && argc > 0)
+			errx(1, "--core dumps its own FILE; other files can't be given.");
+	}
+
+	kernels_init(options.kernel);
+
+	if (profile.enabled)
+		profile_start(L, profile.period);
+
+	if (options.bench_plugin) {
+		int r = bench_plugin(options.bench_plugin);
+		profile_report(stderr);
+		mem_report(stderr);
+		return r;
+	}
+
+	// Load the plugins of the plugin columns now, so that one that can't be found
+	// is reported before anything's been written (or a pager started).
+	for (size_t i = 0; i < options.dfuncs_sz; ++i) {
+		if (options.dfuncs[i] == CO_Plugin)
+			load_plugin(options.dfunc_names[i]);
 	}
 
 	// Setup a pager. pager_fp will be passed to pclose() later on.
 	FILE *pager_fp = pager(options.pager);
 
+	// Buffer output in big blocks, even when writing to a terminal. huxdemp()
+	// flushes after each batch of lines itself when reading from interactive
+	// inputs.
+	//
+	// It doesn't get more than a quarter of what's left of the memory budget, since
+	// the input buffers and plugins need it more.
+	size_t out_buf_sz = MIN(CHUNK_SZ, mem_left() / 4 / 1024 * 1024);
+	char *out_buf = out_buf_sz ? mem_alloc_shrink(&out_buf_sz, 1024, 1024) : NULL;
+	if (out_buf)
+		setvbuf(pager_fp, out_buf, _IOFBF, out_buf_sz);
+	else
+		setvbuf(pager_fp, NULL, _IONBF, 0);
+
 	// Now process 'free' arguments the same way every sane POSIX application does: if
 	// it's a lone dash, or there are no arguments, read from stdin; otherwise, treat
 	// the argument as a file.
-	if (!argc) {
-		huxdemp("-", pager_fp);
+	void (*dump)(char *, FILE *) = slices_sz > 0 ? slices_dump
+		: options.bitmap != BM_None ? bitmap : huxdemp;
+
+	if (options.html)
+		theme_html_begin(pager_fp);
+
+	if (options.core) {
+		dump(options.core, pager_fp);
+	} else if (options.join) {
+		dump(argv[0], pager_fp);
+	} else if (!argc) {
+		dump("-", pager_fp);
 	} else {
 		for (; *argv; --argc, ++argv)
-			huxdemp(*argv, pager_fp);
+			dump(*argv, pager_fp);
 	}
 
-	// Close pager_fp, waiting for the pager to exit.
+	if (options.html)
+		theme_html_end(pager_fp);
+
+	// Write out what's left, and close pager_fp, waiting for the pager to exit.
+	PROBE1(flush_start, (size_t)0);
+	fflush(pager_fp);
+	PROBE1(flush_end, (size_t)0);
 	if (pager_fp != stdout) {
 		int r = pclose(pager_fp);
 		if (r != 0) {
@@ -832,5 +1634,9 @@ main(int argc, char *argv[])
 		}
 	}
 
+	profile_report(stderr);
+	mem_report(stderr);
+
 	return 0;
 }
+#endif
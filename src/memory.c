@@ -0,0 +1,329 @@
+/// The memory budget (--memory-limit).
+///
+/// Every big buffer (input chunks, the output buffer, --ranges rounds, the -b
+/// view's pixels) and the Lua heap are allocated through here, and counted
+/// against the budget. When a buffer doesn't fit, its owner asks for a smaller
+/// one with mem_alloc_shrink() and makes do with it (smaller chunks, fewer bytes
+/// per read), so that huxdemp runs slower instead of running out of memory. The
+/// Lua heap just fails to grow, after Lua has tried a full collection to make
+/// room; the plugin that asked for the memory then fails with an error.
+///
+/// Without a limit, the same bookkeeping is done (it's cheap), so that the peak
+/// usage can always be reported.
+///
+/// Smaller things are allocated from arenas, which get their memory from the
+/// budget in blocks, and are freed all at once:
+///
+/// * arena_process: things that live until huxdemp exits, like copies of the
+///   configuration and plugin names.
+///
+/// * arena_scratch: buffers that are only needed while an input is displayed,
+///   reset with arena_reset() once it's done.
+///
+/// * arena_lua: the Lua heap's small objects (see mem_lua_alloc()).
+///
+/// `mallocs' counts the calls made to malloc(3) and friends, so that benchmarks
+/// can check that displaying a line doesn't make any.
+///
+/// Only the main thread allocates; the worker threads in bitmap.c and slices.c
+/// only fill in buffers they've been handed.
+///
+#include <err.h>
+#include <lua.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+static struct {
+	/// Zero when there's no limit. `report' is set by --memory-limit, even when
+	/// it's zero, to print the peak usage on exit.
+	size_t limit;
+	_Bool report;
+
+	size_t used, peak;
+	size_t lua_used, lua_peak;
+
+	/// How many allocations were refused for not fitting, and how many buffers
+	/// were made smaller so that they'd fit.
+	uint64_t refused, shrunk;
+
+	uint64_t mallocs;
+} memory;
+
+#define ARENA_ALIGN 16
+#define ARENA_HDR   ((sizeof(struct ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t used, cap;
+};
+
+struct Arena {
+	struct ArenaBlock *head;
+	size_t block_sz;
+};
+
+static struct Arena arena_process = { .block_sz = 4 * 1024 };
+static struct Arena arena_scratch = { .block_sz = 16 * 1024 };
+static struct Arena arena_lua     = { .block_sz = 16 * 1024 };
+
+/// Free lists for the Lua heap's small objects, one for each multiple of
+/// ARENA_ALIGN up to MEM_SMALL_MAX.
+#define MEM_SMALL_MAX 4096
+static void *mem_small[MEM_SMALL_MAX / ARENA_ALIGN + 1];
+
+static inline _Bool
+_mem_fits(size_t sz)
+{
+	return memory.limit == 0 || (sz <= memory.limit && memory.used <= memory.limit - sz);
+}
+
+static inline void
+_mem_count(size_t sz)
+{
+	memory.used += sz;
+	memory.peak = MAX(memory.peak, memory.used);
+}
+
+/// How much of the budget is left (SIZE_MAX if there's no limit).
+///
+static inline size_t
+mem_left(void)
+{
+	return memory.limit == 0 ? SIZE_MAX
+		: memory.limit - MIN(memory.used, memory.limit);
+}
+
+/// Allocate `sz' bytes from the budget, returning NULL if they don't fit (or
+/// malloc(3) fails). Memory from here must be given back with mem_free(), with
+/// the same size.
+///
+static void *
+mem_alloc(size_t sz)
+{
+	if (!_mem_fits(sz)) {
+		++memory.refused;
+		return NULL;
+	}
+
+	void *ptr = malloc(sz);
+	++memory.mallocs;
+	if (ptr != NULL)
+		_mem_count(sz);
+	return ptr;
+}
+
+/// Allocate up to `*sz' bytes, halving the size (in multiples of `unit') until it
+/// fits, but never going under `min'. The size that was actually allocated is
+/// stored in `*sz'.
+///
+static void *
+mem_alloc_shrink(size_t *sz, size_t min, size_t unit)
+{
+	void *ptr = mem_alloc(*sz);
+
+	for (size_t want = *sz; ptr == NULL && want > min;) {
+		want = MAX(want / 2 / unit * unit, min);
+		if ((ptr = mem_alloc(want)) != NULL) {
+			*sz = want;
+			++memory.shrunk;
+		}
+	}
+
+	return ptr;
+}
+
+static void
+mem_free(void *ptr, size_t sz)
+{
+	if (ptr == NULL)
+		return;
+	free(ptr);
+	++memory.mallocs;
+	memory.used -= sz;
+}
+
+/// Allocate `sz' bytes from `a', aligned for anything. Things that take up a good
+/// part of a block get a block of their own, so that the rest of the current one
+/// isn't wasted. Returns NULL if a new block doesn't fit in the budget.
+///
+static void *
+arena_alloc(struct Arena *a, size_t sz)
+{
+	sz = (sz + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	struct ArenaBlock *b = a->head;
+	if (b == NULL || b->cap - b->used < sz) {
+		size_t cap = MAX(a->block_sz, sz) + ARENA_HDR;
+		if (cap > a->block_sz + ARENA_HDR)
+			b = mem_alloc(cap);
+		else
+			b = mem_alloc_shrink(&cap, sz + ARENA_HDR, ARENA_ALIGN);
+		if (b == NULL)
+			return NULL;
+
+		b->used = 0;
+		b->cap = cap - ARENA_HDR;
+
+		if (a->head && sz > a->block_sz / 4) {
+			b->next = a->head->next;
+			a->head->next = b;
+		} else {
+			b->next = a->head;
+			a->head = b;
+		}
+	}
+
+	void *ptr = (byte_t *)b + ARENA_HDR + b->used;
+	b->used += sz;
+	return ptr;
+}
+
+static char *
+arena_strdup(struct Arena *a, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ret = arena_alloc(a, len);
+	return ret ? memcpy(ret, str, len) : NULL;
+}
+
+/// Free everything allocated from `a'. Its first block is kept, so that an arena
+/// that's reset for each input doesn't go back to malloc(3) every time.
+///
+static void
+arena_reset(struct Arena *a)
+{
+	if (a->head == NULL)
+		return;
+
+	for (struct ArenaBlock *b = a->head->next, *next; b; b = next) {
+		next = b->next;
+		mem_free(b, b->cap + ARENA_HDR);
+	}
+
+	a->head->next = NULL;
+	a->head->used = 0;
+}
+
+/// The Lua heap's allocator. Objects of up to MEM_SMALL_MAX bytes (which is
+/// nearly all of them: strings, tables, closures...) are carved out of arena_lua,
+/// and kept on a free list for their size when Lua frees them, to be handed out
+/// again. Once huxdemp has been running for a few lines, the garbage collector
+/// frees about as much as each line allocates, so lines are displayed without
+/// calling malloc(3) at all. The memory on the free lists is never given back,
+/// but it's reused for objects of the same size.
+///
+/// Bigger objects come from realloc(3), counted against the budget like any
+/// other buffer.
+///
+static void *
+mem_lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	(void)ud;
+
+	/* When `ptr' is NULL, `osize' is the type of the object instead. */
+	size_t old = ptr ? osize : 0;
+	size_t oclass = (old + ARENA_ALIGN - 1) / ARENA_ALIGN;
+	size_t nclass = (nsize + ARENA_ALIGN - 1) / ARENA_ALIGN;
+	_Bool osmall = old <= MEM_SMALL_MAX, nsmall = nsize <= MEM_SMALL_MAX;
+	void *res = NULL;
+
+	if (nsize == 0) {
+		/* Just freeing. */
+	} else if (ptr && osmall && nsmall && oclass == nclass) {
+		res = ptr;
+	} else if (nsmall) {
+		/* If the budget's used up, make do with a bigger block that's free (its
+		 * tail is lost once it's freed as a smaller object). */
+		size_t c = nclass;
+		if (mem_small[c] == NULL && (res = arena_alloc(&arena_lua, nsize)) == NULL)
+			while (++c < ARRAY_LEN(mem_small) && mem_small[c] == NULL);
+		if (res == NULL && c < ARRAY_LEN(mem_small)) {
+			res = mem_small[c];
+			mem_small[c] = *(void **)res;
+		} else if (res == NULL) {
+			/* A block that's being shrunk can just be kept (its tail is lost
+			 * once it's freed as a smaller object), so that Lua never runs out
+			 * of memory while freeing some. */
+			if (ptr == NULL || (osmall && nclass > oclass))
+				return NULL;
+			res = ptr;
+		}
+	} else {
+		size_t grow = osmall ? nsize : nsize - MIN(nsize, old);
+		if (!_mem_fits(grow)) {
+			++memory.refused;
+			return NULL;
+		}
+
+		++memory.mallocs;
+		if ((res = realloc(osmall ? NULL : ptr, nsize)) == NULL)
+			return NULL;
+
+		memory.used = memory.used - (osmall ? 0 : old) + nsize;
+		memory.peak = MAX(memory.peak, memory.used);
+		if (!osmall)
+			ptr = NULL;  /* realloc() took care of it. */
+	}
+
+	if (ptr && res != ptr) {
+		if (res) memcpy(res, ptr, MIN(old, nsize));
+
+		if (osmall) {
+			*(void **)ptr = mem_small[oclass];
+			mem_small[oclass] = ptr;
+		} else {
+			++memory.mallocs;
+			free(ptr);
+			memory.used -= old;
+		}
+	}
+
+	memory.lua_used = memory.lua_used - old + nsize;
+	memory.lua_peak = MAX(memory.lua_peak, memory.lua_used);
+	return res;
+}
+
+/// Parse a size like "512k", "16M", or "1G" (or a plain number of bytes).
+///
+static size_t
+mem_parse_size(const char *str)
+{
+	char *end;
+	unsigned long long sz = strtoull(str, &end, 0);
+
+	switch (*end) {
+	break; case 'g': case 'G': sz <<= 30, ++end;
+	break; case 'm': case 'M': sz <<= 20, ++end;
+	break; case 'k': case 'K': sz <<= 10, ++end;
+	}
+
+	if (end == str || (*end != '\0' && strcmp(end, "iB") && strcmp(end, "B")))
+		errx(1, "--memory-limit: \"%s\" isn't a size", str);
+
+	return (size_t)sz;
+}
+
+#ifndef HUXD_NO_MAIN
+static void
+mem_report(FILE *out)
+{
+	if (!memory.report)
+		return;
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(out, "\nmemory: peak %.1f KiB (%.1f KiB of it in Lua)",
+		memory.peak / 1024.0, memory.lua_peak / 1024.0);
+	if (memory.limit > 0)
+		fprintf(out, " of a %.1f KiB budget", memory.limit / 1024.0);
+	fprintf(out, ", max RSS %ld KiB\n", ru.ru_maxrss);
+
+	if (memory.refused > 0)
+		fprintf(out, "  %lu allocations were refused, %lu buffers were made smaller\n",
+			(unsigned long)memory.refused, (unsigned long)memory.shrunk);
+}
+#endif
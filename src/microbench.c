@@ -0,0 +1,369 @@
+/// The microbenchmark (huxdemp-microbench), which times each of the building
+/// blocks of a dump on its own, so that a regression shows up in the block that
+/// caused it instead of being lost in the time of the whole dump:
+///
+/// * hex, ascii: the byte and ASCII column kernels (see kernels.c), once for
+///   each set that the CPU supports.
+/// * escapes: the ASCII column in colors, which switches escape sequences for
+///   most bytes (see theme_set()).
+/// * offset: the offset column.
+/// * utf8: the byte column's tracking of UTF-8 sequences (_utf8state()), over
+///   text with some UTF-8 in it.
+/// * expand_range: parsing the byte ranges of a color config (see range.c).
+/// * dump: all of it, as huxdemp() dumps the input from a file with the default
+///   columns, to compare the blocks with.
+/// * plugin, plugin-view: calling a plugin column that does nothing, given the
+///   line as a table or as a view (see call_plugin()).
+/// * startup, startup-plugins: setting up Lua the way main() does (luau_init())
+///   and closing it again, on its own and with the embedded uxn and chip8
+///   plugins loaded too.
+///
+/// Each block runs over an input of -n bytes (1 MiB by default), in lines of -l
+/// bytes (16 by default), once to warm up and then -i times (20 by default). The
+/// fastest, median, and mean run, and the standard deviation, are shown in
+/// cycles per byte of input (or per startup, for the startup blocks, which run
+/// MB_STARTUPS times each), along with the median in nanoseconds. Cycles are
+/// counted with the time stamp counter, which ticks at a fixed rate rather than
+/// with the core's clock, so they're only there on x86.
+///
+/// Output goes to /dev/null through a big buffer, like it goes to a pipe in a
+/// real dump. Naming blocks on the command line runs only those.
+///
+/// This is built from the same sources as huxdemp: main.c is included with
+/// HUXD_NO_MAIN defined, which leaves out its main() and what only main() uses.
+///
+#define HUXD_NO_MAIN
+#include "main.c"
+
+#include <math.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define MB_RUNS_MAX 1000
+#define MB_STARTUPS 100
+
+static struct {
+	size_t sz, runs;
+	byte_t *corpus, *text;
+	FILE *sink;
+	char path[64];
+} mb;
+
+static uint64_t
+_mb_cycles(void)
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void
+_mb_hex(void)
+{
+	char out[MAX_LINELEN * 3];
+	for (size_t line = 0; line < mb.sz; line += options.linelen) {
+		kernels.hex(&mb.corpus[line], MIN(options.linelen, mb.sz - line), out);
+		__asm__ volatile("" : : "r"(out) : "memory");
+	}
+}
+
+static void
+_mb_ascii(void)
+{
+	char out[MAX_LINELEN];
+	for (size_t line = 0; line < mb.sz; line += options.linelen) {
+		kernels.printable(&mb.corpus[line], MIN(options.linelen, mb.sz - line), out);
+		__asm__ volatile("" : : "r"(out) : "memory");
+	}
+}
+
+static void
+_mb_escapes(void)
+{
+	for (size_t line = 0; line < mb.sz; line += options.linelen) {
+		size_t n = MIN(options.linelen, mb.sz - line);
+		display_ascii(&mb.corpus[line], n, options.linelen, true, mb.sink);
+	}
+}
+
+static void
+_mb_offset(void)
+{
+	for (size_t line = 0; line < mb.sz; line += options.linelen)
+		display_offset(line, false, mb.sink);
+}
+
+static void
+_mb_utf8(void)
+{
+	utf8_state[0] = utf8_state[1] = -1;
+	for (size_t line = 0; line < mb.sz; line += options.linelen) {
+		size_t n = MIN(options.linelen, mb.sz - line);
+		for (size_t i = 0; i < n; ++i)
+			_utf8state(&mb.text[line], n, i, (ssize_t)(line + i));
+	}
+}
+
+static const char mb_ranges[] = "0-8, 11-31, 0x7f, 0x80-0xff, 0b1010, 0o40-0o176, 10";
+
+static void
+_mb_expand_range(void)
+{
+	uint8_t out[4096];
+	char s[sizeof(mb_ranges)];
+	for (size_t done = 0; done < mb.sz; done += sizeof(mb_ranges) - 1) {
+		memcpy(s, mb_ranges, sizeof(s));
+		if (expand_range(s, out) < 0)
+			errx(1, "expand_range: \"%s\" didn't parse", mb_ranges);
+	}
+}
+
+static void
+_mb_dump(void)
+{
+	huxdemp(mb.path, mb.sink);
+}
+
+/// The plugin that does nothing, in the column of `options.dfuncs' it's in.
+static size_t mb_plugin;
+
+static void
+_mb_plugin(void)
+{
+	for (size_t line = 0; line < mb.sz; line += options.linelen) {
+		size_t n = MIN(options.linelen, mb.sz - line);
+		++plugin_line;
+		plugin_window.lo = &mb.corpus[line - MIN(line, WINDOW_SZ)];
+		plugin_window.hi = &mb.corpus[MIN(mb.sz, line + n + WINDOW_SZ)];
+		plugin_window.last = line + n == mb.sz;
+		call_plugin(mb_plugin, &mb.corpus[line], n, line, mb.sink);
+	}
+}
+
+static void
+_mb_startups(_Bool plugins)
+{
+	lua_State *main_L = L;
+	for (size_t i = 0; i < MB_STARTUPS; ++i) {
+		luau_init(&L);
+		luaL_requiref(L, "huxdemp", luau_openlib, false);
+		lua_pop(L, 1);
+		if (plugins) {
+			lua_pushstring(L, "uxn");
+			luau_call(L, NULL, "require", 1, 0);
+			lua_pushstring(L, "chip8");
+			luau_call(L, NULL, "require", 1, 0);
+		}
+		lua_close(L);
+	}
+	L = main_L;
+}
+
+static void _mb_startup(void)         { _mb_startups(false); }
+static void _mb_startup_plugins(void) { _mb_startups(true); }
+
+static const struct {
+	const char *name;
+	void (*run)(void);
+	_Bool kernels;
+	const char *plugin;
+	_Bool startups;
+} mb_blocks[] = {
+	{ "hex",             _mb_hex,             true,  NULL,     false },
+	{ "ascii",           _mb_ascii,           true,  NULL,     false },
+	{ "escapes",         _mb_escapes,         false, NULL,     false },
+	{ "offset",          _mb_offset,          false, NULL,     false },
+	{ "utf8",            _mb_utf8,            false, NULL,     false },
+	{ "expand_range",    _mb_expand_range,    false, NULL,     false },
+	{ "dump",            _mb_dump,            true,  NULL,     false },
+	{ "plugin",          _mb_plugin,          false, "mbnop",  false },
+	{ "plugin-view",     _mb_plugin,          false, "mbview", false },
+	{ "startup",         _mb_startup,         false, NULL,     true },
+	{ "startup-plugins", _mb_startup_plugins, false, NULL,     true },
+};
+
+static int
+_mb_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/// Run `run' once to warm up, and then `mb.runs' times, and print how long it took
+/// for each of the `per' things (bytes or startups) that it does.
+///
+static void
+_mb_time(const char *name, const char *kernel, void (*run)(void), size_t per,
+		const char *unit)
+{
+	static double cycles[MB_RUNS_MAX], ns[MB_RUNS_MAX];
+
+	run();
+	for (size_t r = 0; r < mb.runs; ++r) {
+		int64_t t0 = profile_now();
+		uint64_t c0 = _mb_cycles();
+		run();
+		uint64_t c1 = _mb_cycles();
+		int64_t t1 = profile_now();
+		cycles[r] = (double)(c1 - c0) / (double)per;
+		ns[r] = (double)(t1 - t0) / (double)per;
+	}
+	fflush(mb.sink);
+
+	double sum = 0, sq = 0;
+	for (size_t r = 0; r < mb.runs; ++r)
+		sum += cycles[r];
+	double mean = sum / (double)mb.runs;
+	for (size_t r = 0; r < mb.runs; ++r)
+		sq += (cycles[r] - mean) * (cycles[r] - mean);
+	double stddev = mb.runs > 1 ? sqrt(sq / (double)(mb.runs - 1)) : 0;
+
+	qsort(cycles, mb.runs, sizeof(cycles[0]), _mb_cmp);
+	qsort(ns, mb.runs, sizeof(ns[0]), _mb_cmp);
+
+	if (_mb_cycles() == 0)
+		printf("%-15s %-7s %11s %11s %11s %11s %11.3f %s\n", name, kernel,
+			"-", "-", "-", "-", ns[mb.runs / 2], unit);
+	else
+		printf("%-15s %-7s %11.3f %11.3f %11.3f %11.3f %11.3f %s\n", name, kernel,
+			cycles[0], cycles[mb.runs / 2], mean, stddev, ns[mb.runs / 2], unit);
+}
+
+static void
+_mb_usage(void)
+{
+	printf("Usage: %s [-l bytes] [-n bytes] [-i runs] [block...]\n", argv0);
+	printf("Blocks:");
+	for (size_t i = 0; i < ARRAY_LEN(mb_blocks); ++i)
+		printf(" %s", mb_blocks[i].name);
+	printf("\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	options.table = (char **)&t_default;
+	options.linelen = 16;
+	options.dfuncs[0] = CO_Offset;
+	options.dfuncs[1] = CO_Bytes;
+	options.dfuncs[2] = CO_Ascii;
+	options.dfuncs_sz = 3;
+	mb.sz = 1024 * 1024;
+	mb.runs = 20;
+
+	ARGBEGIN {
+	break; case 'l':
+		options.linelen = strtoul(EARGF(_mb_usage()), NULL, 0);
+		if (options.linelen == 0 || options.linelen > MAX_LINELEN)
+			errx(1, "-l must be from 1 to %d", MAX_LINELEN);
+	break; case 'n':
+		mb.sz = (size_t)mem_parse_size(EARGF(_mb_usage()));
+	break; case 'i':
+		mb.runs = strtoul(EARGF(_mb_usage()), NULL, 0);
+		if (mb.runs == 0 || mb.runs > MB_RUNS_MAX)
+			errx(1, "-i must be from 1 to %d", MB_RUNS_MAX);
+	break; default:
+		_mb_usage();
+	} ARGEND
+
+	for (int i = 0; i < argc; ++i) {
+		size_t b = 0;
+		while (b < ARRAY_LEN(mb_blocks) && strcmp(argv[i], mb_blocks[b].name))
+			++b;
+		if (b == ARRAY_LEN(mb_blocks))
+			_mb_usage();
+	}
+	if (mb.sz == 0)
+		errx(1, "-n must be more than 0 bytes");
+
+	/* The same corpora as --bench-plugin: random bytes, and text, which
+	 * here has some UTF-8 in it. */
+	static const char text[] = "Grüße aus Köln, 東京 und Zürich! \xf0\x9f\x98\x80\n";
+	mb.corpus = malloc(mb.sz);
+	mb.text = malloc(mb.sz);
+	if (mb.corpus == NULL || mb.text == NULL)
+		err(1, "malloc");
+	_bench_fill(BC_Random, mb.corpus, mb.sz);
+	for (size_t i = 0; i < mb.sz; ++i)
+		mb.text[i] = (byte_t)text[i % (sizeof(text) - 1)];
+
+	/* dump reads the corpus back from a file, like huxdemp would. */
+	const char *tmpdir = getenv("TMPDIR");
+	snprintf(mb.path, sizeof(mb.path), "%s/huxdemp-microbench.XXXXXX",
+		tmpdir && strlen(tmpdir) < sizeof(mb.path) - 32 ? tmpdir : "/tmp");
+	int fd = mkstemp(mb.path);
+	if (fd == -1)
+		err(1, "%s", mb.path);
+	if (write(fd, mb.corpus, mb.sz) != (ssize_t)mb.sz)
+		err(1, "%s", mb.path);
+	close(fd);
+
+	static char sink_buf[1024 * 1024];
+	if ((mb.sink = fopen("/dev/null", "w")) == NULL)
+		err(1, "/dev/null");
+	setvbuf(mb.sink, sink_buf, _IOFBF, sizeof(sink_buf));
+
+	config(default_colors);
+	theme_compile(CD_256);
+
+	luau_init(&L);
+	luaL_requiref(L, "huxdemp", luau_openlib, false);
+	lua_pop(L, 1);
+	if (luaL_dostring(L,
+			"package.preload.mbnop = function()\n"
+			"  return { main = function(buf, off, out) end }\n"
+			"end\n"
+			"package.preload.mbview = function()\n"
+			"  return { view = true, main = function(buf, off, out) end }\n"
+			"end\n") != LUA_OK)
+		luau_panic(L);
+
+	printf("%zu bytes per run, %zu bytes per line, %zu runs\n\n",
+		mb.sz, options.linelen, mb.runs);
+	printf("%-15s %-7s %11s %11s %11s %11s %11s %s\n", "block", "kernel",
+		"min cycles", "med cycles", "mean cycles", "sd cycles", "med ns", "per");
+
+	for (size_t b = 0; b < ARRAY_LEN(mb_blocks); ++b) {
+		_Bool wanted = argc == 0;
+		for (int i = 0; i < argc; ++i)
+			wanted |= !strcmp(argv[i], mb_blocks[b].name);
+		if (!wanted)
+			continue;
+
+		if (mb_blocks[b].plugin) {
+			mb_plugin = options.dfuncs_sz++;
+			options.dfuncs[mb_plugin] = CO_Plugin;
+			strcpy(options.dfunc_names[mb_plugin], mb_blocks[b].plugin);
+			load_plugin(mb_blocks[b].plugin);
+		}
+
+		if (mb_blocks[b].startups) {
+			_mb_time(mb_blocks[b].name, "-", mb_blocks[b].run,
+				MB_STARTUPS, "startup");
+			continue;
+		}
+		if (!mb_blocks[b].kernels) {
+			kernels_init(NULL);
+			_mb_time(mb_blocks[b].name, "-", mb_blocks[b].run, mb.sz, "B");
+			continue;
+		}
+		for (size_t k = 0; k < ARRAY_LEN(kernel_sets); ++k) {
+			if (!kernel_sets[k].supported())
+				continue;
+			kernels = kernel_sets[k];
+			_mb_time(mb_blocks[b].name, kernels.name, mb_blocks[b].run,
+				mb.sz, "B");
+		}
+	}
+
+	fclose(mb.sink);
+	unlink(mb.path);
+	free(mb.corpus);
+	free(mb.text);
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Static probes (USDT) in the read, render, and write path, for tracing a dump
+ * with bpftrace, perf, or SystemTap without rebuilding it:
+ *
+ *	bpftrace -e 'usdt:./huxdemp:huxdemp:read_end { @bytes = hist(arg1); }'
+ *
+ * With <sys/sdt.h> (HAVE_SDT), each probe is a nop with a note in the ELF file
+ * that tells the tracer where it is and where its arguments are, so that it
+ * costs nothing until something attaches to it. Without it, the probes go
+ * away, and so do their arguments.
+ *
+ * The probes, under the provider "huxdemp":
+ *
+ *	read_start(offset, max)          before reading up to `max' bytes
+ *	read_end(offset, bytes)          after reading `bytes' of them
+ *	column_start(index, kind, offset, bytes)
+ *	column_end(index, kind, offset, bytes)
+ *	                                 around each column (-f) of each line;
+ *	                                 `kind' is its enum Column
+ *	plugin_entry(index, offset, bytes)
+ *	plugin_return(index, offset, bytes)
+ *	                                 around each call of a plugin column
+ *	flush_start(offset)
+ *	flush_end(offset)                around each flush of the output, with
+ *	                                 the offset it's flushed up to, or 0 for
+ *	                                 the last flush before exiting
+ *
+ * Offsets are those of the input, as in the offset column.
+ */
+
+#ifndef PROBES_H__
+#define PROBES_H__
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define PROBE1(N, A)          STAP_PROBE1(huxdemp, N, A)
+#define PROBE2(N, A, B)       STAP_PROBE2(huxdemp, N, A, B)
+#define PROBE3(N, A, B, C)    STAP_PROBE3(huxdemp, N, A, B, C)
+#define PROBE4(N, A, B, C, D) STAP_PROBE4(huxdemp, N, A, B, C, D)
+#else
+#define PROBE1(N, A)          ((void)0)
+#define PROBE2(N, A, B)       ((void)0)
+#define PROBE3(N, A, B, C)    ((void)0)
+#define PROBE4(N, A, B, C, D) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,192 @@
+/// A sampling profiler for plugins (--profile-plugins).
+///
+/// A count hook is installed on the Lua state, which fires every N VM
+/// instructions. Each time it does, the time spent in Lua since the previous
+/// sample is charged to whichever function and line are running at that moment.
+/// The clock is paused between plugin calls (see profile_enter/profile_leave), so
+/// that time spent outside of Lua isn't charged to the plugins.
+///
+/// call_plugin() also keeps track of how long it spends building the arguments for
+/// each call, as opposed to running the plugin itself.
+///
+/// A flat profile is printed to stderr when huxdemp exits.
+///
+#include <lauxlib.h>
+#include <lua.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROFILE_ENTRIES 1024
+#define PROFILE_TOP     20
+
+struct ProfileEntry {
+	const char *source;
+	int line;
+	char where[LUA_IDSIZE];
+	char name[48];
+	uint64_t samples;
+	uint64_t ns;
+};
+
+static struct {
+	_Bool enabled;
+	int period;
+
+	/// When the current stretch of time in Lua started being counted (zero
+	/// outside of plugin calls), and when the last plugin call started.
+	int64_t last, paused;
+
+	uint64_t calls, samples;
+	uint64_t marshal_ns, lua_ns;
+
+	/// The part of `lua_ns' that was charged to a function and line by a sample.
+	/// What ran after the last sample of a call isn't, so the tables are shown as
+	/// a share of this instead.
+	uint64_t sampled_ns;
+
+	struct ProfileEntry funcs[PROFILE_ENTRIES];
+	struct ProfileEntry lines[PROFILE_ENTRIES];
+} profile;
+
+static int64_t
+profile_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifndef HUXD_NO_MAIN
+/// Find the entry for `source':`line' in an open-addressed table, creating it if it
+/// doesn't exist yet. Source strings are interned by Lua and live as long as the
+/// plugin does, so comparing pointers is enough. If the table is full, everything
+/// else gets lumped together in the last slot.
+///
+static struct ProfileEntry *
+_profile_entry(struct ProfileEntry *table, const char *source, int line)
+{
+	size_t h = ((uintptr_t)source >> 4) * 31 + (size_t)line;
+	for (size_t i = 0; i < PROFILE_ENTRIES; ++i) {
+		struct ProfileEntry *e = &table[(h + i) % PROFILE_ENTRIES];
+		if (e->source == source && e->line == line)
+			return e;
+		if (e->source == NULL) {
+			e->source = source;
+			e->line = line;
+			return e;
+		}
+	}
+	return &table[PROFILE_ENTRIES - 1];
+}
+
+static void
+_profile_hook(lua_State *pL, lua_Debug *ar)
+{
+	/* Loading the plugins isn't part of any call. */
+	if (profile.last == 0)
+		return;
+
+	int64_t now = profile_now();
+	uint64_t dt = (uint64_t)(now - profile.last);
+	profile.last = now;
+
+	if (!lua_getinfo(pL, "Sln", ar))
+		return;
+
+	struct ProfileEntry *f = _profile_entry(profile.funcs, ar->source, ar->linedefined);
+	struct ProfileEntry *l = _profile_entry(profile.lines, ar->source, ar->currentline);
+
+	if (f->where[0] == '\0') {
+		memcpy(f->where, ar->short_src, sizeof(f->where));
+		snprintf(f->name, sizeof(f->name), "%s", ar->name ? ar->name : "?");
+	}
+	if (l->where[0] == '\0')
+		memcpy(l->where, ar->short_src, sizeof(l->where));
+
+	++f->samples, ++l->samples;
+	f->ns += dt, l->ns += dt;
+	profile.sampled_ns += dt;
+	++profile.samples;
+}
+
+static void
+profile_start(lua_State *pL, int period)
+{
+	profile.enabled = true;
+	profile.period = period > 0 ? period : 1000;
+	lua_sethook(pL, _profile_hook, LUA_MASKCOUNT, profile.period);
+}
+#endif
+
+/// Called by call_plugin() right before calling into Lua. `start' is when
+/// call_plugin() started marshaling the arguments.
+///
+static void
+profile_enter(int64_t start)
+{
+	int64_t now = profile_now();
+	profile.marshal_ns += (uint64_t)(now - start);
+	profile.last = now;
+	profile.paused = now;
+	++profile.calls;
+}
+
+static void
+profile_leave(void)
+{
+	profile.lua_ns += (uint64_t)(profile_now() - profile.paused);
+	profile.last = 0;
+}
+
+#ifndef HUXD_NO_MAIN
+static int
+_profile_cmp(const void *a, const void *b)
+{
+	const struct ProfileEntry *x = a, *y = b;
+	return (x->ns < y->ns) - (x->ns > y->ns);
+}
+
+static void
+_profile_table(struct ProfileEntry *table, _Bool funcs, FILE *out)
+{
+	qsort(table, PROFILE_ENTRIES, sizeof(table[0]), _profile_cmp);
+
+	fprintf(out, "\n  time(ms)       %%  samples  %s\n", funcs ? "function" : "line");
+	for (size_t i = 0; i < PROFILE_TOP && table[i].samples; ++i) {
+		struct ProfileEntry *e = &table[i];
+		double pct = profile.sampled_ns ? 100.0 * e->ns / profile.sampled_ns : 0;
+
+		fprintf(out, "%10.3f  %5.1f%%  %7lu  ", e->ns / 1e6, pct,
+			(unsigned long)e->samples);
+		if (funcs)
+			fprintf(out, "%s (%s:%d)\n", e->name, e->where, e->line);
+		else
+			fprintf(out, "%s:%d\n", e->where, e->line);
+	}
+}
+
+static void
+profile_report(FILE *out)
+{
+	if (!profile.enabled)
+		return;
+
+	uint64_t total = profile.marshal_ns + profile.lua_ns;
+	fprintf(out, "\nplugin profile: %lu calls, %lu samples (every %d instructions)\n",
+		(unsigned long)profile.calls, (unsigned long)profile.samples,
+		profile.period);
+	fprintf(out, "  marshaling in call_plugin(): %10.3f ms (%.1f%%)\n",
+		profile.marshal_ns / 1e6, total ? 100.0 * profile.marshal_ns / total : 0);
+	fprintf(out, "  inside Lua:                  %10.3f ms (%.1f%%)\n",
+		profile.lua_ns / 1e6, total ? 100.0 * profile.lua_ns / total : 0);
+	fprintf(out, "  of which sampled:            %10.3f ms (%.1f%%; the %% below are of this)\n",
+		profile.sampled_ns / 1e6,
+		profile.lua_ns ? 100.0 * profile.sampled_ns / profile.lua_ns : 0);
+
+	_profile_table(profile.funcs, true, out);
+	_profile_table(profile.lines, false, out);
+}
+#endif
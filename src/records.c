@@ -0,0 +1,300 @@
+/// Intel HEX and Motorola S-record images (--hex), the text files that embedded
+/// toolchains write firmware as. Each record loads a few bytes at an address;
+/// the whole file is decoded at once into a buffer, along with a list of extents
+/// (runs of bytes loaded at consecutive addresses), which disk.c then reads from
+/// by address, like the segments of a core.
+///
+/// * Intel HEX: ":LLAAAATT<data>CC". Data records (type 00) are loaded at their
+///   address plus the base set by the last extended segment (02) or extended
+///   linear (04) address record. An end of file record (01) ends the image; start
+///   addresses (03, 05) are ignored.
+///
+/// * S-records: "STLL<address><data>CC". S1, S2, and S3 records load data at a
+///   16, 24, or 32-bit address. S0 (header), S5 and S6 (counts) are ignored, and
+///   a start address (S7, S8, S9) ends the image.
+///
+/// Every record's checksum is checked. A malformed record stops the image there,
+/// with a warning saying which line it's on.
+///
+/// Decoding the hex digits is where the time goes, so they're decoded eight at a
+/// time with a handful of 64-bit operations (see _records_hex8()), and only the
+/// odd digits at the end of a record are looked up one by one.
+///
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REC_ONES  0x0101010101010101ULL
+#define REC_HIGHS 0x8080808080808080ULL
+
+/// `len' bytes loaded at `addr', which are at `off' in the decoded data.
+struct Extent {
+	uint64_t addr, len, off;
+};
+
+struct Records {
+	byte_t *data;
+	size_t data_sz, data_cap;
+
+	struct Extent *ext;
+	size_t ext_sz, ext_cap;
+};
+
+/// Set the top bit of each byte of `x' that's between `lo' and `hi' (exclusive),
+/// and clear everything else. `hi' can't be over 128.
+///
+static inline uint64_t
+_records_between(uint64_t x, byte_t lo, byte_t hi)
+{
+	uint64_t low7 = x & (REC_ONES * 0x7f);
+	return (REC_ONES * (127 + hi) - low7) & ~x & (low7 + REC_ONES * (127 - lo))
+		& REC_HIGHS;
+}
+
+/// Decode the eight hex digits at `s' into four bytes, or return false if they
+/// aren't all hex digits. Each digit is a byte of a 64-bit word; its value is its
+/// low nibble, plus 9 for letters (which have bit 6 set). Then each pair of
+/// nibbles is put together, and the four bytes are packed.
+///
+static inline _Bool
+_records_hex8(const byte_t *s, byte_t *out)
+{
+	uint64_t x = 0;
+	for (size_t i = 8; i > 0; --i)
+		x = x << 8 | s[i - 1];
+
+	uint64_t digits = _records_between(x, '0' - 1, '9' + 1)
+		| _records_between(x | (REC_ONES * 0x20), 'a' - 1, 'f' + 1);
+	if (digits != REC_HIGHS)
+		return false;
+
+	uint64_t v = (x & (REC_ONES * 0x0f)) + ((x >> 6) & REC_ONES) * 9;
+	v = ((v & 0x000f000f000f000fULL) << 4) | ((v >> 8) & 0x000f000f000f000fULL);
+	v = (v | v >> 8) & 0x0000ffff0000ffffULL;
+	v = (v | v >> 16);
+
+	for (size_t i = 0; i < 4; ++i)
+		out[i] = (byte_t)(v >> (i * 8));
+	return true;
+}
+
+/// Decode `n' bytes from the 2 * `n' hex digits at `s'.
+///
+static _Bool
+_records_decode(const byte_t *s, size_t n, byte_t *out)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		if (!_records_hex8(&s[i * 2], &out[i]))
+			return false;
+
+	for (; i < n; ++i) {
+		byte_t hi = t_hexdigit[s[i * 2]], lo = t_hexdigit[s[i * 2 + 1]];
+		if ((hi | lo) & 0xF0)
+			return false;
+		out[i] = (byte_t)(hi << 4 | lo);
+	}
+
+	return true;
+}
+
+static _Bool
+_records_load(struct Records *r, uint64_t addr, const byte_t *bytes, size_t n)
+{
+	if (n == 0)
+		return true;
+
+	struct Extent *last = r->ext_sz > 0 ? &r->ext[r->ext_sz - 1] : NULL;
+	if (last && last->addr + last->len == addr && last->off + last->len == r->data_sz) {
+		last->len += n;
+	} else {
+		if (r->ext_sz == r->ext_cap) {
+			/* The old list is left in the scratch arena; it's at most as
+			 * big as the new one. */
+			size_t cap = r->ext_cap ? r->ext_cap * 2 : 64;
+			struct Extent *ext = arena_alloc(&arena_scratch, cap * sizeof(ext[0]));
+			if (ext == NULL)
+				return false;
+			if (r->ext_sz)
+				memcpy(ext, r->ext, r->ext_sz * sizeof(ext[0]));
+			r->ext = ext, r->ext_cap = cap;
+		}
+		r->ext[r->ext_sz++] = (struct Extent){ addr, n, r->data_sz };
+	}
+
+	memcpy(&r->data[r->data_sz], bytes, n);
+	r->data_sz += n;
+	return true;
+}
+
+static int
+_records_cmp(const void *a, const void *b)
+{
+	const struct Extent *x = a, *y = b;
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	return x->off < y->off ? -1 : x->off > y->off;
+}
+
+/// Sort the extents by address, and merge the ones that follow each other. Where
+/// records overlap, the bytes of the extent that starts first are kept.
+///
+static void
+_records_sort(const char *path, struct Records *r)
+{
+	qsort(r->ext, r->ext_sz, sizeof(r->ext[0]), _records_cmp);
+
+	size_t m = 0;
+	_Bool warned = false;
+
+	for (size_t i = 0; i < r->ext_sz; ++i) {
+		struct Extent e = r->ext[i];
+
+		if (m > 0) {
+			struct Extent *prev = &r->ext[m - 1];
+			uint64_t end = prev->addr + prev->len;
+
+			if (e.addr < end) {
+				if (!warned)
+					warnx("\"%s\": records overlap at 0x%llx; only one of "
+						"them is shown", path, (unsigned long long)e.addr);
+				warned = true;
+
+				uint64_t cut = MIN(end - e.addr, e.len);
+				e.addr += cut, e.off += cut, e.len -= cut;
+				if (e.len == 0)
+					continue;
+			}
+			if (e.addr == end && e.off == prev->off + prev->len) {
+				prev->len += e.len;
+				continue;
+			}
+		}
+
+		r->ext[m++] = e;
+	}
+
+	r->ext_sz = m;
+}
+
+/// Parse the `len' bytes of Intel HEX or S-records at `text' (which format it is
+/// is decided by the first record). `r->data' must have room for `len' / 2 bytes.
+/// Returns false (after a warning) if nothing could be loaded; a malformed record
+/// after some data has been loaded only cuts the image short.
+///
+static _Bool
+records_parse(const char *path, const byte_t *text, size_t len, struct Records *r)
+{
+	_transform_tables();
+
+	byte_t rec[5 + 255];
+	uint64_t base = 0;
+	size_t line = 0;
+	int ihex = -1;
+	_Bool done = false;
+	const char *bad = NULL;
+
+	for (const byte_t *p = text, *end = text + len; p < end && !done && !bad;) {
+		const byte_t *nl = memchr(p, '\n', (size_t)(end - p));
+		const byte_t *eol = nl ? nl : end;
+		const byte_t *s = p;
+		p = nl ? nl + 1 : end;
+		++line;
+
+		while (eol > s && (eol[-1] == '\r' || eol[-1] == ' ' || eol[-1] == '\t'))
+			--eol;
+		size_t n = (size_t)(eol - s);
+		if (n == 0)
+			continue;
+
+		if (ihex == -1 && s[0] != ':' && s[0] != 'S') {
+			bad = "isn't an Intel HEX record or an S-record";
+			break;
+		}
+		if (ihex == -1)
+			ihex = s[0] == ':';
+
+		if (ihex) {
+			size_t sz = (n - 1) / 2;
+			if (s[0] != ':' || n < 11 || (n - 1) % 2 || sz > sizeof(rec)
+					|| !_records_decode(&s[1], sz, rec) || rec[0] + 5U != sz) {
+				bad = "isn't an Intel HEX record";
+				break;
+			}
+
+			byte_t sum = 0;
+			for (size_t i = 0; i < sz; ++i)
+				sum += rec[i];
+			if (sum != 0) {
+				bad = "has a bad checksum";
+				break;
+			}
+
+			uint64_t addr = (uint64_t)rec[1] << 8 | rec[2];
+			switch (rec[3]) {
+			break; case 0x00:
+				if (!_records_load(r, base + addr, &rec[4], rec[0]))
+					bad = "doesn't fit in the memory budget";
+			break; case 0x01:
+				done = true;
+			break; case 0x02: case 0x04:
+				if (rec[0] != 2)
+					bad = "isn't a valid address record";
+				base = ((uint64_t)rec[4] << 8 | rec[5]) << (rec[3] == 0x02 ? 4 : 16);
+			break; case 0x03: case 0x05:
+				/* Start addresses don't load anything. */
+			break; default:
+				bad = "is of an unknown type";
+			}
+		} else {
+			size_t sz = (n - 2) / 2;
+			if (s[0] != 'S' || s[1] < '0' || s[1] > '9' || n < 4 || (n - 2) % 2
+					|| sz > sizeof(rec) || !_records_decode(&s[2], sz, rec)
+					|| rec[0] + 1U != sz) {
+				bad = "isn't an S-record";
+				break;
+			}
+
+			byte_t sum = 0;
+			for (size_t i = 0; i < sz; ++i)
+				sum += rec[i];
+			if (sum != 0xFF) {
+				bad = "has a bad checksum";
+				break;
+			}
+
+			static const byte_t addr_len[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+			int type = s[1] - '0';
+			size_t alen = addr_len[type];
+			if (alen == 0 || rec[0] < alen + 1) {
+				bad = "is of an unknown type";
+				break;
+			}
+
+			uint64_t addr = 0;
+			for (size_t i = 0; i < alen; ++i)
+				addr = addr << 8 | rec[1 + i];
+
+			if (type >= 1 && type <= 3) {
+				if (!_records_load(r, addr, &rec[1 + alen], rec[0] - alen - 1))
+					bad = "doesn't fit in the memory budget";
+			} else if (type >= 7) {
+				done = true;
+			}
+		}
+	}
+
+	if (bad)
+		warnx("\"%s\": line %zu %s%s", path, line, bad,
+			r->data_sz > 0 ? "; the image is cut short there" : "");
+	if (r->ext_sz == 0) {
+		if (!bad)
+			warnx("\"%s\": no data records", path);
+		return false;
+	}
+
+	_records_sort(path, r);
+	return true;
+}
@@ -0,0 +1,394 @@
+/// Dumping several slices of a file in one go (--ranges), instead of running
+/// huxdemp once for each -s/-n pair.
+///
+/// The slices are sorted and merged when they overlap or touch, and then read in
+/// rounds of up to SLICES_ROUND_SZ bytes. Each slice is cut into pieces of about
+/// SLICES_PIECE_SZ bytes (a whole number of lines), and the pieces of a round
+/// are grouped into reads: pieces that are at most SLICES_GAP bytes apart in the
+/// file are fetched with a single preadv(2), with the bytes in between read into
+/// a scratch buffer and thrown away. The reads of a round are issued concurrently
+/// from several threads, and the round is displayed once they're all done.
+///
+/// Each slice gets a header before its first line, like head(1) does for each
+/// file.
+///
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SLICES_PIECE_SZ    (64 * 1024)
+#define SLICES_ROUND_SZ    (1024 * 1024)
+#define SLICES_GAP         4096
+#define SLICES_MAX_PIECES  64
+#define SLICES_MAX_THREADS 16
+
+#ifndef IOV_MAX
+#define IOV_MAX 16  /* _XOPEN_IOV_MAX, the least POSIX allows */
+#endif
+
+struct Slice {
+	uint64_t start, end;
+};
+
+struct SlicePiece {
+	uint64_t start;
+	size_t len, got;
+	byte_t *buf;
+	_Bool first, last;
+};
+
+struct SliceRead {
+	int fd;
+	uint64_t base;
+	struct SlicePiece *pieces;
+	size_t npieces;
+};
+
+/// Where the bytes between the pieces of a read go. They're never looked at, so
+/// all the reads can share it.
+static byte_t slices_gap[SLICES_GAP];
+
+static struct Slice *slices = NULL;
+static size_t slices_sz = 0, slices_cap = 0;
+
+static void _display_line(byte_t *buf, size_t r, size_t offset, FILE *out);
+
+static void
+_slices_add_one(char *spec)
+{
+	char *end;
+	uint64_t start = strtoull(spec, &end, 0);
+	uint64_t stop;
+
+	if (end == spec)
+		errx(1, "--ranges: \"%s\" doesn't start with an offset", spec);
+
+	if (*end == '+') {
+		char *len = end + 1;
+		stop = start + strtoull(len, &end, 0);
+		if (end == len) errx(1, "--ranges: \"%s\" has no length", spec);
+	} else if (*end == '-') {
+		char *last = end + 1;
+		stop = strtoull(last, &end, 0) + 1;
+		if (end == last) errx(1, "--ranges: \"%s\" has no end", spec);
+		if (stop <= start) errx(1, "--ranges: \"%s\" ends before it starts", spec);
+	} else {
+		errx(1, "--ranges: \"%s\" should be START+LENGTH or START-END", spec);
+	}
+
+	if (*end != '\0')
+		errx(1, "--ranges: junk after \"%s\"", spec);
+
+	if (stop == start)
+		return;
+
+	if (slices_sz == slices_cap) {
+		slices_cap = slices_cap ? slices_cap * 2 : 16;
+		slices = realloc(slices, slices_cap * sizeof(slices[0]));
+		if (slices == NULL)
+			err(1, "--ranges");
+	}
+	slices[slices_sz++] = (struct Slice){ start, stop };
+}
+
+/// Add the slices in `list', which is separated by commas or whitespace. If it
+/// starts with `@', the rest is the path of a file to read the list from.
+///
+static void
+slices_add(char *list)
+{
+	char *text = list;
+
+	if (*list == '@') {
+		FILE *fp = fopen(list + 1, "r");
+		if (fp == NULL)
+			err(1, "--ranges: \"%s\"", list + 1);
+
+		size_t sz = 0;
+		text = NULL;
+		if (getdelim(&text, &sz, '\0', fp) == -1 && ferror(fp))
+			err(1, "--ranges: \"%s\"", list + 1);
+		fclose(fp);
+		if (text == NULL)
+			return;
+	}
+
+	for (char *ptr = text; ptr;) {
+		char *spec = strsep(&ptr, ", \t\r\n");
+		if (*spec != '\0')
+			_slices_add_one(spec);
+	}
+
+	if (text != list)
+		free(text);
+}
+
+static int
+_slices_cmp(const void *a, const void *b)
+{
+	const struct Slice *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+/// Sort the slices, merging those that overlap or touch.
+///
+static void
+slices_finish(void)
+{
+	if (slices_sz == 0)
+		return;
+
+	qsort(slices, slices_sz, sizeof(slices[0]), _slices_cmp);
+
+	size_t out = 0;
+	for (size_t i = 1; i < slices_sz; ++i) {
+		if (slices[i].start <= slices[out].end)
+			slices[out].end = MAX(slices[out].end, slices[i].end);
+		else
+			slices[++out] = slices[i];
+	}
+	slices_sz = out + 1;
+}
+
+/// Read all the pieces of a read with one preadv(2) (or a few, if it comes up
+/// short), then work out how much of each piece was actually read.
+///
+static void *
+_slices_read(void *arg)
+{
+	struct SliceRead *rd = (struct SliceRead *)arg;
+	struct iovec iov[SLICES_MAX_PIECES * 2];
+	size_t niov = 0;
+
+	for (size_t i = 0; i < rd->npieces; ++i) {
+		struct SlicePiece *p = &rd->pieces[i];
+		if (i > 0) {
+			uint64_t gap = p->start - (p[-1].start + p[-1].len);
+			if (gap > 0)
+				iov[niov++] = (struct iovec){ slices_gap, (size_t)gap };
+		}
+		iov[niov++] = (struct iovec){ p->buf, p->len };
+	}
+
+	uint64_t off = rd->pieces[0].start, total = 0;
+	for (size_t i = 0; i < niov;) {
+		ssize_t r = preadv(rd->fd, &iov[i], (int)MIN(niov - i, IOV_MAX),
+			(off_t)(rd->base + off + total));
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+
+		total += (uint64_t)r;
+		for (size_t left = (size_t)r; left > 0 && i < niov;) {
+			size_t n = MIN(left, iov[i].iov_len);
+			iov[i].iov_base = (byte_t *)iov[i].iov_base + n;
+			iov[i].iov_len -= n;
+			left -= n;
+			if (iov[i].iov_len == 0) ++i;
+		}
+	}
+
+	for (size_t i = 0; i < rd->npieces; ++i) {
+		struct SlicePiece *p = &rd->pieces[i];
+		uint64_t rel = p->start - off;
+		p->got = total > rel ? (size_t)MIN(total - rel, p->len) : 0;
+	}
+
+	return NULL;
+}
+
+static void
+_slices_header(char *path, _Bool show_path, struct Slice *s, uint64_t size, FILE *out)
+{
+	uint64_t end = MAX(MIN(s->end, size), s->start);
+	char header[PATH_MAX + 128];
+	snprintf(header, sizeof(header), "==> %s%s0x%08llx-0x%08llx (%llu bytes) <==",
+		show_path ? path : "", show_path ? ": " : "",
+		(unsigned long long)s->start, (unsigned long long)(MAX(end, s->start + 1) - 1),
+		(unsigned long long)(end - s->start));
+
+	if (options._color)
+		theme_set(theme.offset, out);
+	theme_text(header, out);
+	if (options._color)
+		theme_reset(out);
+	fputc('\n', out);
+}
+
+/// Display the pieces of a round. Pieces of the same slice sit next to each other
+/// in the round's buffer, so plugins can look across them.
+///
+static void
+_slices_display(struct SlicePiece *pieces, size_t npieces, char *path,
+		_Bool show_path, uint64_t size, size_t *slice, FILE *out)
+{
+	byte_t *run_lo = NULL;
+
+	for (size_t i = 0; i < npieces; ++i) {
+		struct SlicePiece *p = &pieces[i];
+
+		if (p->first) {
+			if (*slice > 0) fputc('\n', out);
+			_slices_header(path, show_path, &slices[*slice], size, out);
+			utf8_state[0] = utf8_state[1] = -1;
+			text_carry = SIZE_MAX;
+			disasm_next = SIZE_MAX;
+			plugin_reset();
+			run_lo = p->buf;
+		} else if (run_lo == NULL) {
+			run_lo = p->buf;
+		}
+
+		/* Find where this slice's bytes in the round end. */
+		byte_t *run_hi = p->buf + p->got;
+		for (size_t j = i + 1; j < npieces && !pieces[j].first
+				&& pieces[j - 1].got == pieces[j - 1].len; ++j)
+			run_hi = pieces[j].buf + pieces[j].got;
+
+		for (size_t off = 0; off < p->got; off += options.linelen) {
+			size_t n = MIN(options.linelen, p->got - off);
+			byte_t *line = &p->buf[off];
+
+			plugin_window.lo = line - MIN((size_t)(line - run_lo), WINDOW_SZ);
+			plugin_window.hi = line + MIN((size_t)(run_hi - line), n + WINDOW_SZ);
+			plugin_window.last = (p->last || p->got < p->len) && off + n == p->got;
+			_display_line(line, n, (size_t)(p->start + off), out);
+		}
+
+		if (p->got < p->len)
+			warnx("\"%s\": couldn't read 0x%llx-0x%llx", path,
+				(unsigned long long)(p->start + p->got),
+				(unsigned long long)(p->start + p->len - 1));
+
+		if (p->last) {
+			++*slice;
+			run_lo = NULL;
+		}
+	}
+}
+
+static void
+_slices_round(int fd, uint64_t base, struct SlicePiece *pieces, size_t npieces)
+{
+	static struct SliceRead reads[SLICES_MAX_PIECES];
+	pthread_t threads[SLICES_MAX_PIECES];
+	_Bool started[SLICES_MAX_PIECES] = {0};
+	size_t nreads = 0;
+
+	for (size_t i = 0; i < npieces; ++i) {
+		struct SliceRead *prev = nreads ? &reads[nreads - 1] : NULL;
+		if (prev) {
+			struct SlicePiece *last = &prev->pieces[prev->npieces - 1];
+			if (pieces[i].start - (last->start + last->len) <= SLICES_GAP) {
+				++prev->npieces;
+				continue;
+			}
+		}
+		reads[nreads++] = (struct SliceRead){ .fd = fd, .base = base, .pieces = &pieces[i], .npieces = 1 };
+	}
+
+	/* If a thread can't be started (or there are too many), do its read here. */
+	for (size_t i = 1; i < nreads; ++i) {
+		if (i < SLICES_MAX_THREADS)
+			started[i] = !pthread_create(&threads[i], NULL, _slices_read, &reads[i]);
+		if (!started[i]) _slices_read(&reads[i]);
+	}
+
+	_slices_read(&reads[0]);
+
+	for (size_t i = 1; i < nreads; ++i)
+		if (started[i]) pthread_join(threads[i], NULL);
+}
+
+static void
+slices_dump(char *path, FILE *out)
+{
+	static struct SlicePiece pieces[SLICES_MAX_PIECES];
+	size_t round_sz = SLICES_ROUND_SZ;
+	byte_t *buf = NULL;
+
+	/* Offsets in archive members (see archive.c) are from the member's start. */
+	struct Member member = { .start = 0 };
+	char *member_name = archive_member(path);
+	FILE *fp = member_name ? archive_open(path, member_name, &member) : NULL;
+
+	int fd = member_name ? (fp ? fileno(fp) : -1)
+		: !strcmp(path, "-") ? STDIN_FILENO : open(path, O_RDONLY);
+	if (fd == -1) {
+		if (!member_name)
+			warn("\"%s\"", path);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || lseek(fd, 0, SEEK_CUR) == -1) {
+		warnx("\"%s\": --ranges needs a file that can be seeked in", path);
+		goto cleanup;
+	}
+	if (member_name && member.method != MM_Stored) {
+		warnx("\"%s\": --ranges can't be used on compressed members", path);
+		goto cleanup;
+	}
+
+	/* Block devices report a size of zero, so don't clamp to that. */
+	uint64_t size = member_name ? member.size
+		: S_ISREG(st.st_mode) ? (uint64_t)st.st_size : UINT64_MAX;
+	/* With a tight memory budget, make do with smaller rounds and pieces. */
+	buf = mem_alloc_shrink(&round_sz, options.linelen, options.linelen);
+	if (buf == NULL) {
+		warnx("\"%s\": not enough memory left in the budget", path);
+		goto cleanup;
+	}
+
+	size_t piece_sz = MAX(MIN(SLICES_PIECE_SZ, round_sz) / options.linelen, 1)
+		* options.linelen;
+	_Bool show_path = strcmp(path, "-") != 0;
+
+	size_t npieces = 0, used = 0, shown = 0;
+
+	for (size_t s = 0; s < slices_sz; ++s) {
+		uint64_t start = slices[s].start, end = MIN(slices[s].end, size);
+		if (start >= end)
+			warnx("\"%s\": 0x%llx is past the end of the file", path,
+				(unsigned long long)start);
+
+		for (uint64_t off = start; off < end || off == start; off += piece_sz) {
+			size_t len = (size_t)MIN(piece_sz, end > off ? end - off : 0);
+
+			if (npieces == SLICES_MAX_PIECES || used + len > round_sz) {
+				_slices_round(fd, member.start, pieces, npieces);
+				_slices_display(pieces, npieces, path, show_path, size, &shown, out);
+				npieces = used = 0;
+			}
+
+			pieces[npieces++] = (struct SlicePiece){
+				.start = off, .len = len, .buf = &buf[used],
+				.first = off == start, .last = off + len >= end,
+			};
+			used += len;
+
+			if (len == 0) break;
+		}
+	}
+
+	if (npieces > 0) {
+		_slices_round(fd, member.start, pieces, npieces);
+		_slices_display(pieces, npieces, path, show_path, size, &shown, out);
+	}
+
+cleanup:
+	mem_free(buf, round_sz);
+	if (fp)
+		fclose(fp);
+	else if (fd != STDIN_FILENO)
+		close(fd);
+}
@@ -12,6 +12,7 @@ static char *t_cntrls[256] = {
 	[32 ] = " ", [127] = "␡"
 };
 
+#ifndef HUXD_NO_MAIN
 static char *t_cp437[] = {
 	[0  ] = "␀", [1  ] = "☺", [2  ] = "☻", [3  ] = "♥", [4  ] = "♦",
 	[5  ] = "♣", [6  ] = "♠", [7  ] = "•", [8  ] = "◛", [9  ] = "○",
@@ -66,6 +67,7 @@ static char *t_cp437[] = {
 	[250] = "·", [251] = "√", [252] = "ⁿ", [253] = "²", [254] = "■",
 	[255] = "□"
 };
+#endif
 
 static char *t_default[] = {
 	[0  ] = "0", [1  ] = "·", [2  ] = "·", [3  ] = "·", [4  ] = "·",
@@ -0,0 +1,175 @@
+/// UTF-16 and UTF-32 for the text columns (-f utf16le, utf16be, utf32le, utf32be),
+/// which show the characters that a line's code units make up, in one cell per
+/// code unit, like the ascii column does with bytes.
+///
+/// Code units start at offsets that are a multiple of their size, so that lines
+/// that don't hold a whole number of them (-l 7) still line up with the input. A
+/// unit is shown on the line it starts on, and the rest of it, if that's on the
+/// next line, is looked up in the plugin window. So is the second half of a
+/// surrogate pair: the character is shown in the cell of the first half, and the
+/// cell of the second half is left blank (or taken up by the character, if it's
+/// wide).
+///
+/// Interactive inputs have no window past the end of the line, so a surrogate
+/// pair can be cut in two by the end of a line whose rest hasn't arrived yet.
+/// Then `text_carry' remembers where the second half is, and the character is
+/// shown in its cell instead, on the next line.
+///
+/// Lines of plain ASCII text are the common case, so they're recognised eight
+/// bytes at a time (see text_ascii8()), and only the other characters are
+/// decoded one by one.
+///
+#include <stdint.h>
+#include <stdio.h>
+
+/// What a code unit is: (the first unit of) a character, the second half of a
+/// surrogate pair, a unit that isn't valid, or one (or a pair) that goes on past
+/// the end of what can be looked at.
+enum TextUnit {
+	TU_Char, TU_Low, TU_Invalid, TU_Short,
+};
+
+/// Where the second half of a surrogate pair that was cut in two by the end of a
+/// line is, if it's the one that shows the character (SIZE_MAX if not).
+static size_t text_carry = SIZE_MAX;
+
+static inline size_t
+text_unit_sz(enum TextEncoding enc)
+{
+	return enc >= TE_Utf32LE ? 4 : enc >= TE_Utf16LE ? 2 : 1;
+}
+
+static inline uint32_t
+_text_load(enum TextEncoding enc, const byte_t *p)
+{
+	switch (enc) {
+	break; case TE_Utf16LE:
+		return (uint32_t)p[1] << 8 | p[0];
+	break; case TE_Utf16BE:
+		return (uint32_t)p[0] << 8 | p[1];
+	break; case TE_Utf32LE:
+		return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+	break; case TE_Utf32BE:
+		return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+	break; case TE_Utf8:
+		break;
+	}
+	return p[0];
+}
+
+/// What the code unit at `p' is, looking at nothing before `lo' or from `hi' on.
+/// For TU_Char, `*cp' is set to the character, and `*len' to how many bytes it
+/// takes up (both halves, for a surrogate pair).
+///
+static enum TextUnit
+text_unit(enum TextEncoding enc, const byte_t *p, const byte_t *lo, const byte_t *hi,
+	uint32_t *cp, size_t *len)
+{
+	size_t sz = text_unit_sz(enc);
+	*len = sz;
+	if (hi < p + sz)
+		return TU_Short;
+
+	uint32_t u = _text_load(enc, p);
+	*cp = u;
+
+	if (sz == 4)
+		return u > UNICODE_MAX || (u >= 0xD800 && u <= 0xDFFF) ? TU_Invalid : TU_Char;
+
+	if ((u & 0xFC00) == 0xDC00) {
+		_Bool paired = p - lo >= 2 && (_text_load(enc, p - 2) & 0xFC00) == 0xD800;
+		return paired ? TU_Low : TU_Invalid;
+	}
+	if ((u & 0xFC00) == 0xD800) {
+		if (hi < p + 4)
+			return TU_Short;
+		uint32_t low = _text_load(enc, p + 2);
+		if ((low & 0xFC00) != 0xDC00)
+			return TU_Invalid;
+		*cp = 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+		*len = 4;
+	}
+	return TU_Char;
+}
+
+/// Characters that take up no columns on a terminal, or two.
+static const uint32_t text_zero_width[][2] = {
+	{ 0x0000, 0x001F }, { 0x007F, 0x009F }, { 0x0300, 0x036F }, { 0x0483, 0x0489 },
+	{ 0x0591, 0x05BD }, { 0x0610, 0x061A }, { 0x064B, 0x065F }, { 0x200B, 0x200F },
+	{ 0x2028, 0x202E }, { 0x2060, 0x206F }, { 0x20D0, 0x20FF }, { 0xD800, 0xDFFF },
+	{ 0xFDD0, 0xFDEF }, { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F }, { 0xFEFF, 0xFEFF },
+	{ 0xFFF0, 0xFFFB }, { 0xE0000, 0xE0FFF },
+};
+
+static const uint32_t text_wide[][2] = {
+	{ 0x1100, 0x115F }, { 0x2E80, 0x303E }, { 0x3041, 0x33FF }, { 0x3400, 0x4DBF },
+	{ 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF },
+	{ 0xFE30, 0xFE4F }, { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x1F300, 0x1F64F },
+	{ 0x1F900, 0x1F9FF }, { 0x20000, 0x2FFFD }, { 0x30000, 0x3FFFD },
+};
+
+static _Bool
+_text_in(const uint32_t ranges[][2], size_t n, uint32_t cp)
+{
+	size_t lo = 0, hi = n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ranges[mid][1] < cp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < n && ranges[lo][0] <= cp;
+}
+
+/// How many columns `cp' takes up on a terminal. Characters that can't be shown
+/// on their own (controls, combining marks, noncharacters, and the like) take up
+/// none, and are shown as a period instead.
+///
+static int
+text_width(uint32_t cp)
+{
+	if ((cp & 0xFFFE) == 0xFFFE
+			|| _text_in(text_zero_width, ARRAY_LEN(text_zero_width), cp))
+		return 0;
+	return _text_in(text_wide, ARRAY_LEN(text_wide), cp) ? 2 : 1;
+}
+
+/// Where the bytes around the line at `buf' can be looked at, for the rest of the
+/// code units that it cuts in two.
+///
+static inline void
+text_window(const byte_t *buf, size_t buf_sz, const byte_t **lo, const byte_t **hi)
+{
+	*lo = plugin_window.lo && plugin_window.lo <= buf ? plugin_window.lo : buf;
+	*hi = plugin_window.hi && plugin_window.hi >= buf + buf_sz
+		? plugin_window.hi : buf + buf_sz;
+}
+
+/// If the eight bytes at `p' (which start a code unit) are all code units of
+/// printable ASCII characters, put the characters in `out' and return how many
+/// there are. Otherwise return zero. The bytes that must be zero and the ones
+/// that must be printable are each checked all at once (see _records_between()).
+///
+static inline size_t
+text_ascii8(enum TextEncoding enc, const byte_t *p, char *out)
+{
+	static const uint64_t low[] = {
+		[TE_Utf16LE] = 0x00FF00FF00FF00FFULL, [TE_Utf16BE] = 0xFF00FF00FF00FF00ULL,
+		[TE_Utf32LE] = 0x000000FF000000FFULL, [TE_Utf32BE] = 0xFF000000FF000000ULL,
+	};
+	uint64_t mask = low[enc], x = 0;
+
+	for (size_t i = 8; i > 0; --i)
+		x = x << 8 | p[i - 1];
+	if (x & ~mask)
+		return 0;
+	if ((_records_between(x, 0x1F, 0x7F) ^ mask) & mask & REC_HIGHS)
+		return 0;
+
+	size_t n = 0;
+	for (size_t i = 0; i < 8; ++i)
+		if (mask >> (i * 8) & 0xFF)
+			out[n++] = (char)p[i];
+	return n;
+}
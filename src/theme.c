@@ -0,0 +1,371 @@
+/// The theme: which escape sequence to print before each byte, compiled once at
+/// startup from the colors set with config() for whatever the terminal supports.
+///
+/// Colors are stored as 256-color palette indices (like `styles'), or as RGB
+/// values when $HUXD_COLORS uses "#rrggbb". They are then turned into SGR
+/// sequences depending on the color depth of the terminal:
+///
+/// * CD_True: "#rrggbb" colors are printed as-is; palette colors still use the
+///   (shorter) palette sequence.
+/// * CD_256:  RGB colors are mapped to the closest palette entry.
+/// * CD_16:   everything is mapped to the closest of the 16 system colors.
+/// * CD_Mono: dark colors are dimmed; highlighted bytes use reverse video.
+///
+/// Palette entries 0-15 are always printed with the short 30-37/90-97 forms.
+///
+/// There's also CD_Html, for -H: each color becomes a CSS class, and each
+/// "escape sequence" a <span> of that class.
+///
+/// Identical sequences are only stored once, so the display functions can tell
+/// whether the color actually changes by comparing pointers; consecutive bytes of
+/// the same class then only get a single escape sequence between them.
+///
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum ColorDepth {
+	CD_Mono, CD_16, CD_256, CD_True, CD_Html,
+};
+
+/// Slots in `theme_colors' past the 256 byte values.
+enum ThemeSlot {
+	TS_Offset = 256, TS_Utf8Fg, TS_Utf8Bg, TS_Max,
+};
+
+#define THEME_RGB 0x1000000
+
+/// Colors that aren't set for each byte in `styles'. The UTF-8 highlight colors
+/// are what huxdemp has always used (SGR 100 is palette entry 8).
+static uint32_t theme_colors[TS_Max] = {
+	[TS_Offset] = 7, [TS_Utf8Fg] = 97, [TS_Utf8Bg] = 8,
+};
+
+static struct {
+	enum ColorDepth depth;
+	char *fg[256];
+	char *offset;
+	char *utf8;
+	char *reset;
+
+	/// Printed before switching from one fragment to another. Escape sequences
+	/// simply override each other, but spans have to be closed.
+	char *close;
+
+	/// The fragment last printed, so that it isn't printed again. NULL after a
+	/// reset.
+	char *last;
+
+	char pool[TS_Max * 48];
+	size_t pool_sz;
+} theme;
+
+/// Convert an entry in the 256-color palette to RGB.
+///
+static void
+theme_rgb(byte_t c, byte_t rgb[3])
+{
+	static const byte_t system[16][3] = {
+		{  0,   0,   0}, {205,   0,   0}, {  0, 205,   0}, {205, 205,   0},
+		{  0,   0, 238}, {205,   0, 205}, {  0, 205, 205}, {229, 229, 229},
+		{127, 127, 127}, {255,   0,   0}, {  0, 255,   0}, {255, 255,   0},
+		{ 92,  92, 255}, {255,   0, 255}, {  0, 255, 255}, {255, 255, 255},
+	};
+	static const byte_t cube[6] = { 0, 95, 135, 175, 215, 255 };
+
+	if (c < 16) {
+		memcpy(rgb, system[c], 3);
+	} else if (c < 232) {
+		rgb[0] = cube[(c - 16) / 36];
+		rgb[1] = cube[(c - 16) / 6 % 6];
+		rgb[2] = cube[(c - 16) % 6];
+	} else {
+		rgb[0] = rgb[1] = rgb[2] = 8 + (c - 232) * 10;
+	}
+}
+
+static void
+_theme_unpack(uint32_t color, byte_t rgb[3])
+{
+	if (color & THEME_RGB) {
+		rgb[0] = (color >> 16) & 0xFF;
+		rgb[1] = (color >> 8) & 0xFF;
+		rgb[2] = color & 0xFF;
+	} else {
+		theme_rgb((byte_t)color, rgb);
+	}
+}
+
+static uint32_t
+_theme_distance(const byte_t a[3], const byte_t b[3])
+{
+	int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+	return (uint32_t)(dr * dr + dg * dg + db * db);
+}
+
+/// Find the palette entry in [first, last) closest to `color'.
+///
+static byte_t
+theme_nearest(uint32_t color, size_t first, size_t last)
+{
+	if (!(color & THEME_RGB) && color >= first && color < last)
+		return (byte_t)color;
+
+	byte_t want[3], have[3];
+	_theme_unpack(color, want);
+
+	size_t best = first;
+	uint32_t best_dist = UINT32_MAX;
+	for (size_t i = first; i < last; ++i) {
+		theme_rgb((byte_t)i, have);
+		uint32_t dist = _theme_distance(want, have);
+		if (dist < best_dist) best = i, best_dist = dist;
+	}
+	return (byte_t)best;
+}
+
+/// Write the SGR parameters for `color' (as a foreground, or background if `bg')
+/// into `buf'.
+///
+static void
+_theme_params(uint32_t color, _Bool bg, char *buf, size_t sz)
+{
+	if (theme.depth == CD_Mono) {
+		byte_t rgb[3];
+		_theme_unpack(color, rgb);
+		int luma = (rgb[0] * 3 + rgb[1] * 6 + rgb[2]) / 10;
+		if (bg)
+			snprintf(buf, sz, "7");
+		else
+			snprintf(buf, sz, luma < 128 ? "2" : "22");
+		return;
+	}
+
+	if (theme.depth == CD_True && (color & THEME_RGB)) {
+		snprintf(buf, sz, "%d;2;%d;%d;%d", bg ? 48 : 38,
+			(color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+		return;
+	}
+
+	byte_t index = theme.depth == CD_16
+		? theme_nearest(color, 0, 16)
+		: theme_nearest(color, 0, 256);
+
+	if (index < 8)
+		snprintf(buf, sz, "%d", (bg ? 40 : 30) + index);
+	else if (index < 16)
+		snprintf(buf, sz, "%d", (bg ? 100 : 90) + index - 8);
+	else
+		snprintf(buf, sz, "%d;5;%d", bg ? 48 : 38, index);
+}
+
+/// The CSS class for `color', for CD_Html.
+///
+static void
+_theme_class(uint32_t color, char *buf, size_t sz)
+{
+	if (color & THEME_RGB)
+		snprintf(buf, sz, "x%06x", color & 0xFFFFFF);
+	else
+		snprintf(buf, sz, "c%d", color & 0xFF);
+}
+
+/// Store an escape sequence in the pool, returning the copy that's already there
+/// if the same sequence was stored before.
+///
+static char *
+_theme_intern(const char *seq)
+{
+	for (size_t i = 0; i < theme.pool_sz; i += strlen(&theme.pool[i]) + 1)
+		if (!strcmp(&theme.pool[i], seq))
+			return &theme.pool[i];
+
+	size_t len = strlen(seq) + 1;
+	if (theme.pool_sz + len > sizeof(theme.pool))
+		errx(1, "theme: out of space for escape sequences");
+
+	char *ret = memcpy(&theme.pool[theme.pool_sz], seq, len);
+	theme.pool_sz += len;
+	return ret;
+}
+
+/// Work out the color depth of the terminal from $COLORTERM and $TERM. Terminals
+/// we don't know anything about are assumed to support 256 colors, which is
+/// what huxdemp has always used.
+///
+#ifndef HUXD_NO_MAIN
+static enum ColorDepth
+theme_depth(void)
+{
+	char *env_COLORTERM = getenv("COLORTERM");
+	char *env_TERM = getenv("TERM");
+
+	if (env_COLORTERM && (!strcmp(env_COLORTERM, "truecolor")
+			|| !strcmp(env_COLORTERM, "24bit")))
+		return CD_True;
+
+	if (!env_TERM)
+		return CD_256;
+
+	size_t len = strlen(env_TERM);
+	if (strstr(env_TERM, "direct"))
+		return CD_True;
+	if (strstr(env_TERM, "256"))
+		return CD_256;
+	if (strstr(env_TERM, "-mono") || (len > 2 && !strcmp(&env_TERM[len - 2], "-m"))
+			|| !strncmp(env_TERM, "vt1", 3) || !strncmp(env_TERM, "vt2", 3))
+		return CD_Mono;
+	if (!strcmp(env_TERM, "linux") || !strcmp(env_TERM, "ansi")
+			|| !strncmp(env_TERM, "cons", 4) || strstr(env_TERM, "16color"))
+		return CD_16;
+
+	return CD_256;
+}
+#endif
+
+/// Compile `styles'/`theme_colors' into escape sequences. Must be called after
+/// the last call to config().
+///
+static void
+theme_compile(enum ColorDepth depth)
+{
+	char fg[32], bg[32], seq[80];
+
+	theme.depth = depth;
+	theme.pool_sz = 0;
+	theme.last = NULL;
+
+	if (depth == CD_Html) {
+		theme.reset = theme.close = _theme_intern("</span>");
+
+		for (size_t i = 0; i < 256; ++i) {
+			_theme_class(theme_colors[i] ? theme_colors[i] : styles[i], fg, sizeof(fg));
+			snprintf(seq, sizeof(seq), "<span class=\"%s\">", fg);
+			theme.fg[i] = _theme_intern(seq);
+		}
+
+		theme.offset = _theme_intern("<span class=\"o\">");
+		theme.utf8 = _theme_intern("<span class=\"u\">");
+		return;
+	}
+
+	theme.reset = _theme_intern("\x1b[m");
+	theme.close = _theme_intern("");
+
+	for (size_t i = 0; i < 256; ++i) {
+		uint32_t color = theme_colors[i] ? theme_colors[i] : styles[i];
+		_theme_params(color, false, fg, sizeof(fg));
+		snprintf(seq, sizeof(seq), "\x1b[%sm", fg);
+		theme.fg[i] = _theme_intern(seq);
+	}
+
+	_theme_params(theme_colors[TS_Offset], false, fg, sizeof(fg));
+	snprintf(seq, sizeof(seq), "\x1b[%sm", fg);
+	theme.offset = _theme_intern(seq);
+
+	_theme_params(theme_colors[TS_Utf8Bg], true, bg, sizeof(bg));
+	_theme_params(theme_colors[TS_Utf8Fg], false, fg, sizeof(fg));
+	snprintf(seq, sizeof(seq), "\x1b[%s;%sm", bg, fg);
+	theme.utf8 = _theme_intern(seq);
+}
+
+/// Switch to the escape sequence `frag', unless it's already in effect.
+///
+static inline void
+theme_set(char *frag, FILE *out)
+{
+	if (frag != theme.last) {
+		if (theme.last != NULL)
+			fputs(theme.close, out);
+		fputs(frag, out);
+		theme.last = frag;
+	}
+}
+
+static inline void
+theme_reset(FILE *out)
+{
+	if (theme.last != NULL) {
+		fputs(theme.reset, out);
+		theme.last = NULL;
+	}
+}
+
+/// Print `len' bytes of text in a column, escaping them if they're going into
+/// HTML.
+///
+static void
+theme_write(const char *text, size_t len, FILE *out)
+{
+	if (theme.depth != CD_Html) {
+		fwrite(text, 1, len, out);
+		return;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		switch (text[i]) {
+		break; case '<': fputs("&lt;", out);
+		break; case '>': fputs("&gt;", out);
+		break; case '&': fputs("&amp;", out);
+		break; default:  fputc(text[i], out);
+		}
+	}
+}
+
+static inline void
+theme_text(const char *text, FILE *out)
+{
+	if (theme.depth != CD_Html)
+		fputs(text, out);
+	else
+		theme_write(text, strlen(text), out);
+}
+
+#ifndef HUXD_NO_MAIN
+static void
+_theme_css(const char *class, uint32_t fg, uint32_t bg, _Bool has_bg, FILE *out)
+{
+	byte_t rgb[3];
+	_theme_unpack(fg, rgb);
+	fprintf(out, ".%s{color:#%02x%02x%02x", class, rgb[0], rgb[1], rgb[2]);
+	if (has_bg) {
+		_theme_unpack(bg, rgb);
+		fprintf(out, ";background:#%02x%02x%02x", rgb[0], rgb[1], rgb[2]);
+	}
+	fprintf(out, "}\n");
+}
+
+/// The start and end of an HTML document for -H. The stylesheet only has the
+/// classes that are actually used by the theme.
+///
+static void
+theme_html_begin(FILE *out)
+{
+	fprintf(out, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">\n");
+	fprintf(out, "<style>\npre.huxd{background:#000;color:#e5e5e5}\n");
+
+	char class[16];
+	for (size_t i = 0; i < 256; ++i) {
+		_Bool seen = false;
+		for (size_t j = 0; j < i && !seen; ++j)
+			seen = theme.fg[j] == theme.fg[i];
+		if (seen) continue;
+
+		uint32_t color = theme_colors[i] ? theme_colors[i] : styles[i];
+		_theme_class(color, class, sizeof(class));
+		_theme_css(class, color, 0, false, out);
+	}
+	_theme_css("o", theme_colors[TS_Offset], 0, false, out);
+	_theme_css("u", theme_colors[TS_Utf8Fg], theme_colors[TS_Utf8Bg], true, out);
+
+	fprintf(out, "</style></head><body><pre class=\"huxd\">");
+}
+
+static void
+theme_html_end(FILE *out)
+{
+	fprintf(out, "</pre></body></html>\n");
+}
+#endif
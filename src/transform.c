@@ -0,0 +1,292 @@
+/// Input transforms, applied (in order) to the bytes read from the input before
+/// they reach any of the display functions. This allows dumping XOR-obfuscated or
+/// base64/hex-encoded data without decoding it with some other tool first.
+///
+/// Each stage works on a whole buffer at a time, and the simple ones (xor, add,
+/// rol) are written as straight loops over the buffer so that the compiler can
+/// vectorize them. The decoding stages only ever shrink the buffer, so everything
+/// happens in place.
+///
+/// Stages that need to remember something between buffers (the position in the
+/// xor key, half-decoded base64 groups, etc) keep it in their struct Transform,
+/// which is reset for each file with transform_reset().
+///
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TRANSFORMS 16
+#define MAX_XOR_KEY    256
+
+enum TransformKind {
+	TR_Xor, TR_Add, TR_Rol, TR_Base64, TR_Hex,
+};
+
+struct Transform {
+	enum TransformKind kind;
+
+	/// The xor key, repeated until it's at least MAX_XOR_KEY bytes long (and then
+	/// repeated once more), so that a run of `ks_len' bytes can be xor'd with a
+	/// fixed starting phase and no modulo in the inner loop.
+	byte_t ks[MAX_XOR_KEY * 2];
+	size_t key_sz, ks_len;
+
+	/// Amount to add (for `add') or rotate left by (for `rol').
+	byte_t amount;
+
+	/// Number of bytes this stage has seen so far. For xor, this determines which
+	/// byte of the key to use.
+	uint64_t pos;
+
+	/// Bit accumulator for the decoding stages, and the source offset of the
+	/// first input character that contributed to the pending output byte.
+	uint32_t acc;
+	size_t acc_bits;
+	uint64_t acc_src;
+};
+
+static struct Transform transforms[MAX_TRANSFORMS];
+static size_t transforms_sz = 0;
+
+/// Decoding tables for the base64 and hex stages. 0xFF marks characters that are
+/// not part of the alphabet; those are silently skipped so that line breaks,
+/// spaces and separators in the input don't matter. B64_PAD marks the `=' that
+/// pads out the end of a base64 group.
+///
+#define B64_PAD 0xFE
+
+static byte_t t_base64[256];
+static byte_t t_hexdigit[256];
+
+static void
+_transform_tables(void)
+{
+	static const char *b64 =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	memset(t_base64, 0xFF, sizeof(t_base64));
+	memset(t_hexdigit, 0xFF, sizeof(t_hexdigit));
+
+	for (size_t i = 0; i < 64; ++i)
+		t_base64[(byte_t)b64[i]] = i;
+	/* URL-safe alphabet. */
+	t_base64['-'] = 62, t_base64['_'] = 63;
+	t_base64['='] = B64_PAD;
+
+	for (size_t i = 0; i < 10; ++i)
+		t_hexdigit['0' + i] = i;
+	for (size_t i = 0; i < 6; ++i)
+		t_hexdigit['a' + i] = t_hexdigit['A' + i] = 10 + i;
+}
+
+#ifndef HUXD_NO_MAIN
+/// Parse the key given to `xor:'. The key is a string of hex digits, optionally
+/// prefixed with "0x"; "5a" is a single-byte key, "deadbeef" a four-byte one.
+///
+static size_t
+_transform_parse_key(const char *s, byte_t *key)
+{
+	if (!strncmp(s, "0x", 2))
+		s += 2;
+
+	size_t len = strlen(s);
+	if (len == 0 || len % 2 != 0 || len / 2 > MAX_XOR_KEY)
+		return 0;
+
+	for (size_t i = 0; i < len; i += 2) {
+		byte_t hi = t_hexdigit[(byte_t)s[i]], lo = t_hexdigit[(byte_t)s[i + 1]];
+		if (hi == 0xFF || lo == 0xFF)
+			return 0;
+		key[i / 2] = (hi << 4) | lo;
+	}
+
+	return len / 2;
+}
+
+/// Parse a single stage of a transform chain (one item of the -x option) and
+/// append it to the chain.
+///
+/// Possible values:
+/// * xor:KEY   xor with a repeating key (hex digits, e.g. "xor:5a", "xor:c0ffee")
+/// * add:N     add N to each byte (modulo 256); sub:N subtracts instead
+/// * rol:N     rotate each byte left by N bits; ror:N rotates right
+/// * base64    decode base64 (standard or URL-safe alphabet)
+/// * hex       decode pairs of hex digits
+///
+static void
+transform_add(char *stage)
+{
+	if (t_base64[0] != 0xFF)
+		_transform_tables();
+
+	if (transforms_sz >= ARRAY_LEN(transforms))
+		errx(1, "-x recieved more than %zu stages.", ARRAY_LEN(transforms));
+
+	struct Transform *t = &transforms[transforms_sz];
+	memset(t, 0x0, sizeof(*t));
+
+	char *arg = strchr(stage, ':');
+	if (arg) *arg++ = '\0';
+
+	if (!strcmp(stage, "base64") || !strcmp(stage, "b64")) {
+		t->kind = TR_Base64;
+	} else if (!strcmp(stage, "hex")) {
+		t->kind = TR_Hex;
+	} else if (!arg) {
+		errx(1, "-x: unknown transform '%s'", stage);
+	} else if (!strcmp(stage, "xor")) {
+		byte_t key[MAX_XOR_KEY];
+		t->kind = TR_Xor;
+		t->key_sz = _transform_parse_key(arg, key);
+		if (t->key_sz == 0)
+			errx(1, "-x: '%s' is not a valid xor key", arg);
+
+		t->ks_len = t->key_sz * (MAX_XOR_KEY / t->key_sz);
+		for (size_t i = 0; i < ARRAY_LEN(t->ks); ++i)
+			t->ks[i] = key[i % t->key_sz];
+	} else if (!strcmp(stage, "add") || !strcmp(stage, "sub")) {
+		long n = strtol(arg, NULL, 0);
+		t->kind = TR_Add;
+		t->amount = (byte_t)(stage[0] == 's' ? -n : n);
+	} else if (!strcmp(stage, "rol") || !strcmp(stage, "ror")) {
+		long n = strtol(arg, NULL, 0) & 7;
+		t->kind = TR_Rol;
+		t->amount = (byte_t)(stage[2] == 'r' ? (8 - n) & 7 : n);
+	} else {
+		errx(1, "-x: unknown transform '%s'", stage);
+	}
+
+	++transforms_sz;
+}
+#endif
+
+/// Reset the state of each stage before a new file is processed.
+///
+/// The xor key phase of stages that come before any decoding stage is aligned to
+/// the offset where reading starts (so that `-s' doesn't throw the key off); the
+/// rest start counting from zero, since they see decoded bytes.
+///
+static void
+transform_reset(uint64_t start)
+{
+	for (size_t i = 0; i < transforms_sz; ++i) {
+		struct Transform *t = &transforms[i];
+		t->pos = start;
+		t->acc = t->acc_bits = t->acc_src = 0;
+
+		if (t->kind == TR_Base64 || t->kind == TR_Hex)
+			start = 0;
+	}
+}
+
+/// Whether any stage decodes its input, so that the bytes that come out of the
+/// chain are no longer at the offsets they were read from.
+///
+static _Bool
+transform_decodes(void)
+{
+	for (size_t i = 0; i < transforms_sz; ++i) {
+		if (transforms[i].kind == TR_Base64 || transforms[i].kind == TR_Hex)
+			return true;
+	}
+	return false;
+}
+
+static size_t
+_transform_xor(struct Transform *t, byte_t *buf, size_t len)
+{
+	size_t phase = t->pos % t->key_sz;
+	for (size_t i = 0; i < len; i += t->ks_len) {
+		size_t n = MIN(len - i, t->ks_len);
+		const byte_t *ks = &t->ks[phase];
+		for (size_t j = 0; j < n; ++j)
+			buf[i + j] ^= ks[j];
+	}
+	return len;
+}
+
+static size_t
+_transform_add(struct Transform *t, byte_t *buf, size_t len)
+{
+	byte_t amount = t->amount;
+	for (size_t i = 0; i < len; ++i)
+		buf[i] += amount;
+	return len;
+}
+
+static size_t
+_transform_rol(struct Transform *t, byte_t *buf, size_t len)
+{
+	byte_t n = t->amount;
+	if (n == 0) return len;
+	for (size_t i = 0; i < len; ++i)
+		buf[i] = (byte_t)(buf[i] << n) | (byte_t)(buf[i] >> (8 - n));
+	return len;
+}
+
+/// The two decoding stages. Both are bit accumulators fed from a lookup table:
+/// base64 adds 6 bits per character, hex adds 4, and a byte is emitted whenever
+/// there are 8 or more bits waiting.
+///
+/// If `srcmap' isn't NULL, it holds the source offset of each input byte, and is
+/// compacted along with the data so that each output byte maps to the first input
+/// character that encoded it.
+///
+static size_t
+_transform_decode(struct Transform *t, const byte_t *table, size_t bits,
+		byte_t *buf, size_t len, uint64_t *srcmap)
+{
+	size_t o = 0;
+	for (size_t i = 0; i < len; ++i) {
+		byte_t v = table[buf[i]];
+		if (v == B64_PAD) {
+			/* The group is over; the bits padding it out aren't data. */
+			t->acc = 0, t->acc_bits = 0;
+			continue;
+		}
+		if (v == 0xFF) continue;
+
+		uint64_t src = srcmap ? srcmap[i] : 0;
+		if (t->acc_bits == 0)
+			t->acc_src = src;
+
+		t->acc = (t->acc << bits) | v;
+		t->acc_bits += bits;
+
+		if (t->acc_bits >= 8) {
+			t->acc_bits -= 8;
+			if (srcmap)
+				srcmap[o] = t->acc_src;
+			if (t->acc_bits > 0)
+				t->acc_src = src;
+			buf[o++] = (byte_t)(t->acc >> t->acc_bits);
+			t->acc &= (1u << t->acc_bits) - 1;
+		}
+	}
+	return o;
+}
+
+/// Run `buf' through each stage of the transform chain, returning the new length
+/// of the buffer.
+///
+static size_t
+transform_apply(byte_t *buf, size_t len, uint64_t *srcmap)
+{
+	for (size_t i = 0; i < transforms_sz && len > 0; ++i) {
+		struct Transform *t = &transforms[i];
+		size_t in = len;
+
+		switch (t->kind) {
+		break; case TR_Xor:    len = _transform_xor(t, buf, len);
+		break; case TR_Add:    len = _transform_add(t, buf, len);
+		break; case TR_Rol:    len = _transform_rol(t, buf, len);
+		break; case TR_Base64: len = _transform_decode(t, t_base64, 6, buf, len, srcmap);
+		break; case TR_Hex:    len = _transform_decode(t, t_hexdigit, 4, buf, len, srcmap);
+		}
+
+		t->pos += in;
+	}
+
+	return len;
+}
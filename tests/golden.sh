@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Dump the fixtures with each of a set of options, using the kernels named by
+# KERNEL (see src/kernels.c), and compare the output with the golden files, which
+# are the same whatever the kernels.
+#
+# usage: golden.sh HUXDEMP KERNEL [update]
+#
+# Exits with 77 (which CTest counts as skipped) if the CPU can't use KERNEL.
+# With `update', the golden files are written instead of compared; use the
+# scalar kernels for that.
+#
+huxdemp=$1
+kernel=$2
+update=$3
+dir=$(dirname "$0")
+
+unset HUXD_COLORS NO_COLOR COLORTERM
+TERM=xterm-256color
+export TERM
+
+if ! err=$("$huxdemp" -P never --kernel "$kernel" "$dir/fixtures/mixed.bin" 2>&1 >/dev/null); then
+	case $err in
+	*"not one of the kernels this CPU can use"*)
+		echo "$kernel: not supported on this CPU, skipping"
+		exit 77 ;;
+	esac
+	echo "$kernel: huxdemp failed: $err"
+	exit 1
+fi
+
+failed=0
+
+# name, then the options it's dumped with.
+while read -r name opts; do
+	for fixture in "$dir"/fixtures/*; do
+		golden="$dir/golden/$(basename "$fixture" .bin).$name"
+		# shellcheck disable=SC2086
+		out=$("$huxdemp" -P never --kernel "$kernel" $opts "$fixture"; echo x)
+
+		if [ "$update" = update ]; then
+			printf '%s' "${out%x}" > "$golden"
+		elif [ "$(cat "$golden"; echo x)" != "$out" ]; then
+			echo "$kernel: $(basename "$golden") differs (huxdemp $opts)"
+			failed=1
+		fi
+	done
+done <<CASES
+plain    -C never
+color    -C always
+html     -H
+l1       -C never -l 1
+l7       -C never -l 7
+l32      -C never -l 32
+l128     -C never -l 128
+cp437    -C never -t cp437
+classic  -C never -t classic
+cclassic -C always -t classic -l 24
+halves   -C never -f offset,bytes-left,ascii-left,bytes-right,ascii-right
+CASES
+
+exit $failed
@@ -6,9 +6,55 @@
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define STR_(X) #X
+#define STR(X) STR_(X)
+
+/*
+ * The hash used for the registry of embedded files. It's compiled here to find a
+ * seed, and copied verbatim into the output so that the lookup uses the same one.
+ */
+#define EMBEDDED_HASH \
+	static uint32_t \
+	embedded_hash(const char *s, uint32_t seed) \
+	{ \
+		uint32_t h = 2166136261u ^ seed; \
+		while (*s) h = (h ^ (unsigned char)*s++) * 16777619u; \
+		return h ^ (h >> 15); \
+	}
+
+EMBEDDED_HASH
+
+/*
+ * Find a seed for which every name lands in its own slot of a table of `size'
+ * slots, and fill in `table' with the index of the name in each slot (or -1).
+ * The names must all be different.
+ */
+static uint32_t
+perfect_seed(char **names, size_t n, int *table, size_t size)
+{
+	for (uint32_t seed = 0;; ++seed) {
+		size_t i;
+		for (i = 0; i < size; ++i)
+			table[i] = -1;
+
+		for (i = 0; i < n; ++i) {
+			size_t slot = embedded_hash(names[i], seed) & (size - 1);
+			if (table[slot] != -1)
+				break;
+			table[slot] = (int)i;
+		}
+
+		if (i == n)
+			return seed;
+	}
+}
+
 int
 main(int argc, char **argv)
 {
@@ -23,6 +69,11 @@ main(int argc, char **argv)
 		"	char *data;\n"
 		"} embedded_files[] = {\n");
 
+	char **names = calloc((size_t)argc, sizeof(char *));
+	if (!names) {
+		err(1, "calloc");
+	}
+
 	for (size_t i = 1; i < (size_t)argc; ++i) {
 		char *path = argv[i];
 		char *name = argv[i];
@@ -32,6 +83,14 @@ main(int argc, char **argv)
 			*colon = '\0';
 			name = colon + 1;
 		}
+		names[i - 1] = name;
+
+		/* No seed can tell two of the same name apart. */
+		for (size_t j = 0; j < i - 1; ++j) {
+			if (!strcmp(names[j], name)) {
+				errx(1, "%s: embedded more than once", name);
+			}
+		}
 
 		FILE *in = fopen(path, "r");
 		if (!in) {
@@ -83,5 +142,33 @@ main(int argc, char **argv)
 
 	printf("};\n");
 
+	/*
+	 * A perfect hash table from names to indices in embedded_files[], at most
+	 * half full, so that a seed is quick to find.
+	 */
+	size_t n = (size_t)argc - 1;
+	size_t size = 1;
+	while (size < n * 2) {
+		size <<= 1;
+	}
+
+	int *table = calloc(size, sizeof(int));
+	if (!table) {
+		err(1, "calloc");
+	}
+	uint32_t seed = perfect_seed(names, n, table, size);
+
+	printf("\n%s\n\n", STR(EMBEDDED_HASH));
+	printf("#define EMBEDDED_HASH_SEED %" PRIu32 "u\n", seed);
+	printf("#define EMBEDDED_TABLE_SZ  %zu\n\n", size);
+	printf("static const int embedded_table[EMBEDDED_TABLE_SZ] = {");
+	for (size_t i = 0; i < size; ++i) {
+		printf("%s%d", i ? ", " : " ", table[i]);
+	}
+	printf(" };\n");
+
+	free(table);
+	free(names);
+
 	return 0;
 }